@@ -0,0 +1,117 @@
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "section_database.h"
+#include "tile_provider.h"
+#include "worker_pool.h"
+#include "world_generator.h"
+
+namespace {
+  // tiles named <x>-<y>.png
+  bool parse_tile_name(const std::string& name, int& x, int& y) {
+    auto dash = name.find('-');
+    auto dot = name.rfind(".png");
+    if (dash == std::string::npos || dot == std::string::npos || dot < dash)
+      return false;
+    auto x_result = std::from_chars(name.data(), name.data() + dash, x);
+    auto y_result = std::from_chars(name.data() + dash + 1, name.data() + dot, y);
+    return x_result.ec == std::errc() && x_result.ptr == name.data() + dash &&
+           y_result.ec == std::errc() && y_result.ptr == name.data() + dot;
+  }
+
+  void wait_for_tiles(WorldGenerator& world_generator, const std::vector<Location2D>& locs) {
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool ready = false;
+    world_generator.when_ready(locs, [&] {
+      std::unique_lock<std::mutex> lock(mutex);
+      ready = true;
+      cv.notify_one();
+    });
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&] { return ready; });
+  }
+} // namespace
+
+// bake <tile_dir> <out_file>
+// Generates every section whose elevation tile is in <tile_dir>/elevation and writes them to a
+// section database the server can map with its section_db argument
+int main(int argc, char* argv[]) {
+  if (argc < 3) {
+    std::cerr << "usage: bake <tile_dir> <out_file>" << std::endl;
+    return 1;
+  }
+  std::string tile_dir = argv[1];
+  std::string out_file = argv[2];
+
+  std::vector<std::pair<int, int>> tiles;
+  std::error_code ec;
+  for (auto& entry : std::filesystem::directory_iterator(tile_dir + "/elevation", ec)) {
+    int x, y;
+    if (entry.is_regular_file() && parse_tile_name(entry.path().filename().string(), x, y))
+      tiles.emplace_back(x, y);
+  }
+  if (ec || tiles.empty()) {
+    std::cerr << "no elevation tiles in " << tile_dir << "/elevation" << std::endl;
+    return 1;
+  }
+  std::cout << "Baking " << tiles.size() << " tiles from " << tile_dir << std::endl;
+
+  auto start = std::chrono::steady_clock::now();
+  WorldGenerator world_generator(std::make_unique<LocalTileProvider>(tile_dir));
+  SectionDatabaseWriter writer;
+  std::mutex writer_mutex;
+  std::atomic<std::size_t> skipped = 0;
+  {
+    WorkerPool pool;
+    for (auto tile : tiles) {
+      pool.submit([&, tile] {
+        auto [min, max] = WorldGenerator::get_sections_of_tile(tile.first, tile.second);
+        std::vector<Location2D> locs;
+        for (int y = min[1]; y <= max[1]; ++y)
+          for (int x = min[0]; x <= max[0]; ++x)
+            if (WorldGenerator::get_tile_of_section(Location2D{x, y}) == tile)
+              locs.push_back(Location2D{x, y});
+
+        std::vector<Section> sections(locs.size());
+        std::vector<bool> baked(locs.size(), true);
+        wait_for_tiles(world_generator, locs);
+        try {
+          world_generator.get_sections(locs, sections);
+        } catch (const std::exception&) {
+          // a missing neighbouring landcover tile only loses the sections near that edge
+          for (std::size_t i = 0; i < locs.size(); ++i) {
+            try {
+              sections[i] = world_generator.get_section(locs[i]);
+            } catch (const std::exception&) {
+              baked[i] = false;
+              ++skipped;
+            }
+          }
+        }
+
+        std::unique_lock<std::mutex> lock(writer_mutex);
+        for (std::size_t i = 0; i < locs.size(); ++i)
+          if (baked[i])
+            writer.add(locs[i], sections[i]);
+      });
+    }
+  }
+
+  try {
+    writer.write(out_file);
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << "Baked " << writer.get_num_sections() << " sections (" << skipped << " skipped) into " << out_file
+            << " (" << std::filesystem::file_size(out_file) / 1024 << "KB) in " << elapsed.count() << "s" << std::endl;
+  return 0;
+}
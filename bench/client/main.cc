@@ -0,0 +1,320 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "alloc_tracker.h"
+#include "chunk.h"
+#include "chunk_lod.h"
+#include "lod_loader.h"
+#include "lod_mesh_generator.h"
+#include "mesh_generator.h"
+#include "mesh_utils.h"
+#include "open-simplex-noise.h"
+#include "region.h"
+#include "WorldGeneration/world_generator.h"
+
+namespace {
+  using Clock = std::chrono::high_resolution_clock;
+  using VoxelFn = std::function<Voxel(int x, int y, int z)>;
+
+  // the chunk being measured, surrounded by its 26 neighbours
+  const Location center{0, 0, 0};
+
+  struct Corpus {
+    std::string name;
+    VoxelFn voxel_at;
+  };
+
+  struct Sample {
+    double ns;
+    std::uint64_t allocations;
+    std::size_t vertices;
+  };
+
+  struct Stats {
+    double median;
+    double mean;
+    double stddev;
+    double min;
+  };
+
+  Stats compute_stats(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    double sum = 0;
+    for (auto v : values)
+      sum += v;
+    double mean = sum / values.size();
+    double sq = 0;
+    for (auto v : values)
+      sq += (v - mean) * (v - mean);
+    double stddev = values.size() > 1 ? std::sqrt(sq / (values.size() - 1)) : 0;
+    return Stats{values[values.size() / 2], mean, stddev, values.front()};
+  }
+
+  template <typename F>
+  Sample measure(F&& f) {
+    auto allocations_before = alloc_tracker::get_total_count();
+    auto start = Clock::now();
+    std::size_t vertices = f();
+    auto end = Clock::now();
+    auto allocations_after = alloc_tracker::get_total_count();
+    return Sample{
+      static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()),
+      allocations_after - allocations_before,
+      vertices};
+  }
+
+  void report(const std::string& corpus, const std::string& bench, const std::vector<Sample>& samples, double voxels) {
+    std::vector<double> ns_per_voxel;
+    ns_per_voxel.reserve(samples.size());
+    for (auto& sample : samples)
+      ns_per_voxel.push_back(sample.ns / voxels);
+    auto stats = compute_stats(ns_per_voxel);
+    auto& last = samples.back();
+    std::cout << std::left << std::setw(12) << corpus << std::setw(22) << bench << std::right << std::fixed
+              << std::setprecision(2)
+              << std::setw(10) << stats.median
+              << std::setw(10) << stats.mean
+              << std::setw(10) << stats.stddev
+              << std::setw(10) << stats.min
+              << std::setw(12) << last.vertices
+              << std::setw(10) << last.allocations << std::endl;
+  }
+
+  Chunk make_chunk(const Location& loc, const VoxelFn& voxel_at) {
+    Chunk chunk(loc[0], loc[1], loc[2]);
+    bool empty = true;
+    for (int z = 0; z < Chunk::sz_z; ++z) {
+      for (int y = 0; y < Chunk::sz_y; ++y) {
+        for (int x = 0; x < Chunk::sz_x; ++x) {
+          auto voxel = voxel_at(loc[0] * Chunk::sz_x + x, loc[1] * Chunk::sz_y + y, loc[2] * Chunk::sz_z + z);
+          if (voxel == Voxel::empty)
+            continue;
+          chunk.set_voxel(x, y, z, voxel);
+          empty = false;
+        }
+      }
+    }
+    if (empty)
+      chunk.set_flag(ChunkFlags::Empty);
+    return chunk;
+  }
+
+  std::vector<Location> neighbourhood() {
+    std::vector<Location> locations;
+    for (int z = -1; z <= 1; ++z)
+      for (int y = -1; y <= 1; ++y)
+        for (int x = -1; x <= 1; ++x)
+          locations.push_back(Location{center[0] + x, center[1] + y, center[2] + z});
+    return locations;
+  }
+
+  int hills_height(int x, int z) {
+    return 14 + static_cast<int>(8 * std::sin(x / 9.0) * std::cos(z / 11.0));
+  }
+
+  std::vector<Corpus> make_corpora(const WorldGenerator& world_generator, osn_context* noise) {
+    std::vector<Corpus> corpora;
+
+    corpora.push_back({"flat", [](int x, int y, int z) {
+                         if (y < 12)
+                           return Voxel::dirt;
+                         if (y == 12)
+                           return Voxel::grass;
+                         return Voxel::empty;
+                       }});
+
+    corpora.push_back({"hills", [](int x, int y, int z) {
+                         int height = hills_height(x, z);
+                         if (y < height - 3)
+                           return Voxel::stone;
+                         if (y <= height)
+                           return Voxel::dirt;
+                         return Voxel::empty;
+                       }});
+
+    // forests are baked once, trees spill over chunk boundaries like they do in game
+    auto trees = std::make_shared<std::unordered_map<Int3D, Voxel, LocationHash>>();
+    constexpr int ground = 8;
+    for (int z = -Chunk::sz_z - 2; z < 2 * Chunk::sz_z + 2; z += 5) {
+      for (int x = -Chunk::sz_x - 2; x < 2 * Chunk::sz_x + 2; x += 5) {
+        std::uint32_t seed = common::Hash(static_cast<std::uint32_t>(x) * 73856093u ^ static_cast<std::uint32_t>(z) * 19349663u);
+        int jx = static_cast<int>(common::RangeRand(0, 3, seed));
+        int jz = static_cast<int>(common::RangeRand(0, 3, seed + 1));
+        for (auto& [coord, voxel] : world_generator.build_tree(x + jx, ground + 1, z + jz))
+          (*trees)[coord] = voxel;
+      }
+    }
+    corpora.push_back({"forest", [trees](int x, int y, int z) {
+                         if (y <= ground)
+                           return Voxel::dirt;
+                         auto it = trees->find(Int3D{x, y, z});
+                         if (it != trees->end())
+                           return it->second;
+                         return Voxel::empty;
+                       }});
+
+    corpora.push_back({"caves", [noise](int x, int y, int z) {
+                         double n = open_simplex_noise3(noise, x / 12.0, y / 12.0, z / 12.0);
+                         return n > -0.1 ? Voxel::stone : Voxel::empty;
+                       }});
+
+    corpora.push_back({"checkerboard", [](int x, int y, int z) {
+                         return ((x + y + z) & 1) ? Voxel::stone : Voxel::empty;
+                       }});
+
+    corpora.push_back({"water", [](int x, int y, int z) {
+                         int floor = 4 + static_cast<int>(3 * std::sin(x / 7.0) * std::sin(z / 5.0));
+                         if (y <= floor)
+                           return Voxel::sand;
+                         if (y < 20)
+                           return Voxel::water_full;
+                         return Voxel::empty;
+                       }});
+
+    return corpora;
+  }
+
+  void bench_corpus(const Corpus& corpus, int reps) {
+    Region region;
+    LodLoader lod_loader;
+    for (auto& loc : neighbourhood()) {
+      auto chunk = make_chunk(loc, corpus.voxel_at);
+      lod_loader.create_lods(chunk);
+      region.add_chunk(std::move(chunk));
+    }
+    auto& chunk = region.get_chunk(center);
+    auto voxels = chunk.get_voxels();
+    constexpr double chunk_voxels = Chunk::sz;
+
+    std::vector<Sample> samples;
+
+    MeshGenerator mesh_generator;
+    for (int i = 0; i < reps + 1; ++i) {
+      auto sample = measure([&]() {
+        mesh_generator.mesh_chunk(region, center);
+        return mesh_generator.get_meshes().at(center).size();
+      });
+      sample.vertices += mesh_generator.get_irregular_mesh(center).size() + mesh_generator.get_water_mesh(center).size();
+      mesh_generator.clear_diffs();
+      // first run warms the allocator and caches
+      if (i > 0)
+        samples.push_back(sample);
+    }
+    report(corpus.name, "mesh_chunk", samples, chunk_voxels);
+
+    samples.clear();
+    for (int i = 0; i < reps + 1; ++i) {
+      auto lod_mesh_generator = std::make_unique<LodMeshGenerator>();
+      auto sample = measure([&]() {
+        lod_mesh_generator->mesh_chunk<LodLevel::lod1>(lod_loader, center);
+        return lod_mesh_generator->get_mesh<LodLevel::lod1>(center).size();
+      });
+      if (i > 0)
+        samples.push_back(sample);
+    }
+    report(corpus.name, "lod_mesh_chunk<lod1>", samples, ChunkLod<LodLevel::lod1>::sz);
+
+    samples.clear();
+    for (int i = 0; i < reps + 1; ++i) {
+      auto sample = measure([&]() {
+        ChunkLod<LodLevel::lod1> lod(voxels);
+        return static_cast<std::size_t>(lod.get_voxel(0, 0, 0) != Voxel::empty);
+      });
+      sample.vertices = 0;
+      if (i > 0)
+        samples.push_back(sample);
+    }
+    report(corpus.name, "ChunkLod<lod1>", samples, chunk_voxels);
+
+    samples.clear();
+    for (int i = 0; i < reps + 1; ++i) {
+      auto sample = measure([&]() {
+        ChunkLod<LodLevel::lod2> lod(voxels);
+        return static_cast<std::size_t>(lod.get_voxel(0, 0, 0) != Voxel::empty);
+      });
+      sample.vertices = 0;
+      if (i > 0)
+        samples.push_back(sample);
+    }
+    report(corpus.name, "ChunkLod<lod2>", samples, chunk_voxels);
+
+    // gather the cube voxels and their neighbourhoods up front so only get_textures is timed
+    std::vector<std::pair<Voxel, std::array<Voxel, 6>>> cubes;
+    for (int z = 0; z < Chunk::sz_z; ++z) {
+      for (int y = 0; y < Chunk::sz_y; ++y) {
+        for (int x = 0; x < Chunk::sz_x; ++x) {
+          auto voxel = chunk.get_voxel(x, y, z);
+          if (!vops::is_cube(voxel))
+            continue;
+          int gx = center[0] * Chunk::sz_x + x;
+          int gy = center[1] * Chunk::sz_y + y;
+          int gz = center[2] * Chunk::sz_z + z;
+          cubes.emplace_back(voxel, std::array<Voxel, 6>{
+                                      region.get_voxel(gx - 1, gy, gz),
+                                      region.get_voxel(gx + 1, gy, gz),
+                                      region.get_voxel(gx, gy - 1, gz),
+                                      region.get_voxel(gx, gy + 1, gz),
+                                      region.get_voxel(gx, gy, gz - 1),
+                                      region.get_voxel(gx, gy, gz + 1)});
+        }
+      }
+    }
+    if (cubes.empty())
+      return;
+
+    samples.clear();
+    for (int i = 0; i < reps + 1; ++i) {
+      auto sample = measure([&]() {
+        std::uint32_t sink = 0;
+        for (auto& [voxel, adjacent] : cubes) {
+          auto textures = MeshUtils::get_textures(voxel, adjacent);
+          sink += textures[py].get();
+        }
+        return static_cast<std::size_t>(sink & 1);
+      });
+      sample.vertices = 0;
+      if (i > 0)
+        samples.push_back(sample);
+    }
+    report(corpus.name, "get_textures", samples, static_cast<double>(cubes.size()));
+  }
+} // namespace
+
+int main(int argc, char* argv[]) {
+  int reps = 30;
+  std::string only;
+  if (argc > 1)
+    reps = std::max(1, std::atoi(argv[1]));
+  if (argc > 2)
+    only = argv[2];
+
+  WorldGenerator world_generator;
+  osn_context* noise;
+  open_simplex_noise(1337, &noise);
+  auto corpora = make_corpora(world_generator, noise);
+
+  std::cout << reps << " repetitions per benchmark, ns/voxel statistics" << std::endl;
+  std::cout << std::left << std::setw(12) << "corpus" << std::setw(22) << "benchmark" << std::right
+            << std::setw(10) << "median"
+            << std::setw(10) << "mean"
+            << std::setw(10) << "stddev"
+            << std::setw(10) << "min"
+            << std::setw(12) << "vertices"
+            << std::setw(10) << "allocs" << std::endl;
+
+  for (auto& corpus : corpora) {
+    if (!only.empty() && corpus.name != only)
+      continue;
+    bench_corpus(corpus, reps);
+  }
+
+  open_simplex_noise_free(noise);
+  return 0;
+}
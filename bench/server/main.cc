@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+#include "tile_provider.h"
+#include "world_generator.h"
+
+namespace {
+  using Clock = std::chrono::high_resolution_clock;
+
+  // same window the client asks for
+  constexpr int section_distance = 7;
+
+  // png tiles made up on the spot so the bench never needs the network or a tile directory
+  class SyntheticTileProvider : public TileProvider {
+  public:
+    std::string fetch(const TileKey& key) override {
+      constexpr int size = 256;
+      // colours the landcover tiles use
+      constexpr int landcover_colours[] = {25800, 25600, 16777036, 16759586, 11842740, 15790320, 38560, 53109, 16443040};
+      std::vector<unsigned char> pixels(size * size * 3);
+      for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+          auto* pixel = &pixels[(y * size + x) * 3];
+          if (key.kind == TileKind::elevation) {
+            int elevation = 32768 + ((key.x * 7 + key.y * 3 + x + y) % 600);
+            pixel[0] = elevation >> 8;
+            pixel[1] = elevation & 0xff;
+            pixel[2] = 0;
+          } else {
+            int colour = landcover_colours[((x / 16) + (y / 16) + key.x + key.y) % std::size(landcover_colours)];
+            pixel[0] = colour >> 16;
+            pixel[1] = (colour >> 8) & 0xff;
+            pixel[2] = colour & 0xff;
+          }
+        }
+      }
+      int length;
+      auto* png = stbi_write_png_to_mem(pixels.data(), size * 3, size, size, 3, &length);
+      std::string bytes(reinterpret_cast<char*>(png), length);
+      STBIW_FREE(png);
+      return bytes;
+    }
+
+    std::string get_name() const override {
+      return "synthetic tiles";
+    }
+  };
+
+  std::vector<Location2D> make_window(Location2D center) {
+    std::vector<Location2D> locs;
+    for (int x = center[0] - section_distance; x < center[0] + section_distance; ++x)
+      for (int z = center[1] - section_distance; z < center[1] + section_distance; ++z)
+        locs.push_back(Location2D{x, z});
+    return locs;
+  }
+
+  bool same_section(const Section& a, const Section& b) {
+    return a.elevation == b.elevation && a.landcover == b.landcover;
+  }
+
+  template <typename F>
+  double sections_per_second(const std::vector<std::vector<Location2D>>& windows, int reps, F&& f) {
+    std::size_t num_sections = 0;
+    auto start = Clock::now();
+    for (int rep = 0; rep < reps; ++rep) {
+      for (auto& window : windows) {
+        f(window);
+        num_sections += window.size();
+      }
+    }
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+    return num_sections / elapsed.count();
+  }
+} // namespace
+
+int main(int argc, char* argv[]) {
+  int reps = 20;
+  int num_windows = 64;
+  std::string tile_dir;
+  if (argc > 1)
+    reps = std::max(1, std::atoi(argv[1]));
+  if (argc > 2)
+    num_windows = std::max(1, std::atoi(argv[2]));
+  if (argc > 3)
+    tile_dir = argv[3];
+
+  std::unique_ptr<TileProvider> provider;
+  if (tile_dir.empty())
+    provider = std::make_unique<SyntheticTileProvider>();
+  else
+    provider = std::make_unique<LocalTileProvider>(tile_dir);
+  WorldGenerator world_generator(std::move(provider));
+
+  // windows scattered so some straddle tile edges, the way a walking player's do
+  std::vector<std::vector<Location2D>> windows;
+  for (int i = 0; i < num_windows; ++i)
+    windows.push_back(make_window(Location2D{i * 37 - 1000, i * 23 - 700}));
+
+  // load every tile up front, only section generation is timed
+  {
+    std::mutex mutex;
+    std::condition_variable cv;
+    int remaining = num_windows;
+    for (auto& window : windows) {
+      world_generator.when_ready(window, [&] {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (--remaining == 0)
+          cv.notify_one();
+      });
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&] { return remaining == 0; });
+  }
+
+  std::size_t mismatches = 0;
+  std::vector<Section> sections;
+  for (auto& window : windows) {
+    sections.resize(window.size());
+    world_generator.get_sections(window, sections);
+    for (std::size_t i = 0; i < window.size(); ++i) {
+      if (!same_section(sections[i], world_generator.get_section(window[i])))
+        ++mismatches;
+    }
+  }
+
+  auto per_section = sections_per_second(windows, reps, [&](const std::vector<Location2D>& window) {
+    for (auto& loc : window)
+      sections[0] = world_generator.get_section(loc);
+  });
+  auto batched = sections_per_second(windows, reps, [&](const std::vector<Location2D>& window) {
+    sections.resize(window.size());
+    world_generator.get_sections(window, sections);
+  });
+
+  std::cout << num_windows << " windows of " << windows[0].size() << " sections, " << reps << " repetitions, one thread" << std::endl;
+  std::cout << std::fixed << std::setprecision(0);
+  std::cout << std::left << std::setw(14) << "get_section" << std::right << std::setw(12) << per_section << " sections/s" << std::endl;
+  std::cout << std::left << std::setw(14) << "get_sections" << std::right << std::setw(12) << batched << " sections/s" << std::endl;
+  std::cout << std::setprecision(2) << "speedup " << batched / per_section << "x, " << mismatches << " mismatched sections" << std::endl;
+  std::cout << world_generator.get_tile_fetcher().report() << std::endl;
+  return mismatches == 0 ? 0 : 1;
+}
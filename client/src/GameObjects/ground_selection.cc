@@ -1,6 +1,7 @@
 #include "ground_selection.h"
 #include <glm/ext.hpp>
 #include "input.h"
+#include "memory_budget.h"
 #include "renderer.h"
 #include "options.h"
 #include "sim.h"
@@ -9,6 +10,7 @@ GroundSelection::GroundSelection() {
   set_scene_component(std::make_unique<SceneComponent>());
   auto& vertices = scene_component_->get_vertices();
   vertices.resize(1000000);
+  MemoryBudget::instance()->add(MemoryCategory::cpu_meshes, vertices.size());
   scene_component_->set_flag(SceneComponentFlags::Dynamic);
   scene_component_->set_primitive_type(PrimitiveType::Triangles);
   auto& vertex_attributes = scene_component_->get_vertex_attributes();
@@ -41,4 +41,7 @@ namespace cefmsg {
       "viewChange",
       {{"view", view}});
   }
+  void ProfilerUpdate(const nlohmann::json& stats) {
+    SendMessageToJS("profilerUpdate", stats);
+  }
 } // namespace cefmsg
\ No newline at end of file
@@ -12,6 +12,7 @@ namespace cefmsg {
   void ItemSelectorInit(const std::vector<std::string>& item_names);
   void ItemSelectorShow(bool show);
   void ViewChange(const std::string& view);
+  void ProfilerUpdate(const nlohmann::json& stats);
 } // namespace cefmsg
 
 #endif // MESSAGE_BUILDER_H
\ No newline at end of file
@@ -209,7 +209,7 @@ void WorldEditor::generate(const std::unordered_set<Int3D, LocationHash>& surfac
     int z = static_cast<int>(p.y) + min_z;
     int y = recover.at(Int2D{x, z}) + 1;
     Voxel voxel = Voxel::grass;
-    float probability = common::random_probability();
+    float probability = common::NormRand(common::HashPosition(x, y, z));
     if (probability > 0.66) {
       voxel = Voxel::sunflower;
     } else if (probability > 0.33) {
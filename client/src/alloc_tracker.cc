@@ -0,0 +1,171 @@
+#include "alloc_tracker.h"
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+#include <sstream>
+#include <vector>
+
+namespace {
+  alloc_tracker::Tag untagged{AllocSubsystem::untagged, "untagged"};
+  std::atomic<alloc_tracker::Tag*> tags{nullptr};
+  std::atomic<std::uint64_t> total_count{0};
+  std::atomic<std::uint64_t> total_bytes{0};
+
+  // plain pointer so reading it never needs dynamic initialization
+  thread_local alloc_tracker::Tag* current_tag = nullptr;
+
+  std::atomic<std::uint64_t> frames{0};
+  std::uint64_t reported_frames = 0;
+  std::uint64_t frame_start_bytes = 0;
+  std::uint64_t peak_frame_bytes = 0;
+
+  const char* get_subsystem_name(AllocSubsystem subsystem) {
+    switch (subsystem) {
+    case AllocSubsystem::untagged:
+      return "untagged";
+    case AllocSubsystem::region:
+      return "region";
+    case AllocSubsystem::meshing:
+      return "meshing";
+    case AllocSubsystem::rendering:
+      return "rendering";
+    case AllocSubsystem::input:
+      return "input";
+    case AllocSubsystem::networking:
+      return "networking";
+    case AllocSubsystem::world_generation:
+      return "world_generation";
+    case AllocSubsystem::ui:
+      return "ui";
+    default:
+      return "unknown";
+    }
+  }
+} // namespace
+
+namespace alloc_tracker {
+  Tag::Tag(AllocSubsystem subsystem, const char* site) : subsystem(subsystem), site(site) {
+    next = tags.load(std::memory_order_relaxed);
+    while (!tags.compare_exchange_weak(next, this, std::memory_order_release, std::memory_order_relaxed))
+      ;
+  }
+
+  Scope::Scope(Tag& tag) : previous_(current_tag) {
+    current_tag = &tag;
+  }
+
+  Scope::~Scope() {
+    current_tag = previous_;
+  }
+
+  void record(std::size_t size) {
+    auto* tag = current_tag ? current_tag : &untagged;
+    tag->count.fetch_add(1, std::memory_order_relaxed);
+    tag->bytes.fetch_add(size, std::memory_order_relaxed);
+    total_count.fetch_add(1, std::memory_order_relaxed);
+    total_bytes.fetch_add(size, std::memory_order_relaxed);
+  }
+
+  std::uint64_t get_total_count() {
+    return total_count.load(std::memory_order_relaxed);
+  }
+
+  std::uint64_t get_total_bytes() {
+    return total_bytes.load(std::memory_order_relaxed);
+  }
+
+  void end_frame() {
+    auto bytes = get_total_bytes();
+    peak_frame_bytes = std::max(peak_frame_bytes, bytes - frame_start_bytes);
+    frame_start_bytes = bytes;
+    frames.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  std::string report() {
+    struct Line {
+      AllocSubsystem subsystem;
+      const char* site;
+      std::uint64_t count;
+      std::uint64_t bytes;
+    };
+    std::vector<Line> lines;
+    constexpr auto num_subsystems = static_cast<std::size_t>(AllocSubsystem::num_subsystems);
+    std::array<std::pair<std::uint64_t, std::uint64_t>, num_subsystems> subsystems{};
+
+    for (auto* tag = tags.load(std::memory_order_acquire); tag != nullptr; tag = tag->next) {
+      auto count = tag->count.load(std::memory_order_relaxed);
+      auto bytes = tag->bytes.load(std::memory_order_relaxed);
+      Line line{tag->subsystem, tag->site, count - tag->reported_count, bytes - tag->reported_bytes};
+      tag->reported_count = count;
+      tag->reported_bytes = bytes;
+      if (line.count == 0)
+        continue;
+      auto& subsystem = subsystems[static_cast<std::size_t>(line.subsystem)];
+      subsystem.first += line.count;
+      subsystem.second += line.bytes;
+      lines.push_back(line);
+    }
+
+    auto now = frames.load(std::memory_order_relaxed);
+    double num_frames = std::max<std::uint64_t>(1, now - reported_frames);
+    reported_frames = now;
+
+    std::sort(lines.begin(), lines.end(), [](const Line& a, const Line& b) { return a.bytes > b.bytes; });
+
+    std::stringstream stream;
+    stream << std::fixed << std::setprecision(1);
+    stream << "allocations per frame over " << static_cast<std::uint64_t>(num_frames) << " frames"
+           << " (peak frame " << peak_frame_bytes << " bytes)" << std::endl;
+    for (std::size_t i = 0; i < num_subsystems; ++i) {
+      auto [count, bytes] = subsystems[i];
+      if (count == 0)
+        continue;
+      stream << "  " << std::left << std::setw(40) << get_subsystem_name(static_cast<AllocSubsystem>(i)) << std::right
+             << std::setw(10) << count / num_frames << " allocs"
+             << std::setw(14) << bytes / num_frames << " bytes" << std::endl;
+      for (auto& line : lines) {
+        if (static_cast<std::size_t>(line.subsystem) != i || line.subsystem == AllocSubsystem::untagged)
+          continue;
+        stream << "    " << std::left << std::setw(38) << line.site << std::right
+               << std::setw(10) << line.count / num_frames << " allocs"
+               << std::setw(14) << line.bytes / num_frames << " bytes" << std::endl;
+      }
+    }
+    peak_frame_bytes = 0;
+    return stream.str();
+  }
+} // namespace alloc_tracker
+
+#ifdef TRACK_ALLOCATIONS
+// Aligned and sized variants fall through to these or to the default implementations
+void* operator new(std::size_t size) {
+  alloc_tracker::record(size);
+  if (void* p = std::malloc(size == 0 ? 1 : size))
+    return p;
+  throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) {
+  return operator new(size);
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  alloc_tracker::record(size);
+  return std::malloc(size == 0 ? 1 : size);
+}
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept {
+  return operator new(size, tag);
+}
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+void operator delete[](void* p) noexcept {
+  std::free(p);
+}
+void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+void operator delete[](void* p, std::size_t) noexcept {
+  std::free(p);
+}
+#endif
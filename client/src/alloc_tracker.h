@@ -0,0 +1,75 @@
+#ifndef ALLOC_TRACKER_H
+#define ALLOC_TRACKER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+enum class AllocSubsystem {
+  untagged,
+  region,
+  meshing,
+  rendering,
+  input,
+  networking,
+  world_generation,
+  ui,
+
+  num_subsystems
+};
+
+// Opt-in allocation profiler. Building with TRACK_ALLOCATIONS replaces the global operator new/delete,
+// and every allocation is charged to the innermost ALLOC_SCOPE on the allocating thread.
+// Without it ALLOC_SCOPE compiles to nothing and the counters stay at zero
+namespace alloc_tracker {
+  struct Tag {
+    Tag(AllocSubsystem subsystem, const char* site);
+
+    AllocSubsystem subsystem;
+    const char* site;
+    std::atomic<std::uint64_t> count{0};
+    std::atomic<std::uint64_t> bytes{0};
+    // snapshot at the last report, only touched by the thread calling report()
+    std::uint64_t reported_count = 0;
+    std::uint64_t reported_bytes = 0;
+    Tag* next = nullptr;
+  };
+
+  class Scope {
+  public:
+    Scope(Tag& tag);
+    ~Scope();
+    Scope(const Scope& other) = delete;
+    Scope& operator=(const Scope& other) = delete;
+
+  private:
+    Tag* previous_;
+  };
+
+  constexpr bool enabled() {
+#ifdef TRACK_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  void record(std::size_t size);
+  std::uint64_t get_total_count();
+  std::uint64_t get_total_bytes();
+  // marks a frame boundary, report() averages over the frames since the previous report
+  void end_frame();
+  std::string report();
+} // namespace alloc_tracker
+
+#define ALLOC_SCOPE_CONCAT_INNER(a, b) a##b
+#define ALLOC_SCOPE_CONCAT(a, b) ALLOC_SCOPE_CONCAT_INNER(a, b)
+#ifdef TRACK_ALLOCATIONS
+#define ALLOC_SCOPE(subsystem, site)                                                      \
+  static alloc_tracker::Tag ALLOC_SCOPE_CONCAT(alloc_tag_, __LINE__){subsystem, site}; \
+  alloc_tracker::Scope ALLOC_SCOPE_CONCAT(alloc_scope_, __LINE__) { ALLOC_SCOPE_CONCAT(alloc_tag_, __LINE__) }
+#else
+#define ALLOC_SCOPE(subsystem, site)
+#endif
+
+#endif
@@ -1,23 +1,26 @@
 #include "chunk.h"
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <queue>
+#include "chunk_runs.h"
 
 Chunk::Chunk(int x, int y, int z)
     : location_{x, y, z}, voxels_(sz, Voxel::empty) {
 }
 
-Chunk::Chunk(const Location& loc, const unsigned char* data, int data_size) : location_{loc}, voxels_(sz, Voxel::empty) {
-  int vidx = 0;
-  for (int i = 0; i < data_size; i += 4) {
-    // memory alignment...
-    std::uint32_t run = *(int*)(&data[i]);
-    auto voxel = static_cast<Voxel>((common::chunk_data_voxel_mask & run) >> 16);
-    std::uint32_t run_length = common::chunk_data_run_length_mask & run;
-    for (int n = 0; n < run_length; ++n) {
-      auto [x, y, z] = flat_index_to_3d_zxy(vidx++);
-      set_voxel(x, y, z, voxel);
-    }
-  }
+std::optional<Chunk> Chunk::from_runs(const Location& loc, const unsigned char* data, int data_size, bool allow_short) {
+  if (data_size % sizeof(std::uint32_t) != 0)
+    return {};
+  std::vector<std::uint32_t> runs(data_size / sizeof(std::uint32_t));
+  std::memcpy(runs.data(), data, runs.size() * sizeof(std::uint32_t));
+  Chunk chunk(loc[0], loc[1], loc[2]);
+  bool decoded = allow_short ? common::decode_chunk_runs_prefix(runs, chunk.voxels_) : common::decode_chunk_runs(runs, chunk.voxels_);
+  if (!decoded)
+    return {};
+  if (std::all_of(chunk.voxels_.begin(), chunk.voxels_.end(), [](Voxel voxel) { return voxel == Voxel::empty; }))
+    chunk.set_flag(ChunkFlags::Empty);
+  return chunk;
 }
 
 const Location& Chunk::get_location() const {
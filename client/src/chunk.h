@@ -2,6 +2,7 @@
 #define CHUNK_H
 
 #include <array>
+#include <optional>
 #include <unordered_set>
 #include <vector>
 #include "common.h"
@@ -18,7 +19,9 @@ enum class ChunkFlags : uint32_t {
 class Chunk : public FlagManager<ChunkFlags> {
 public:
   Chunk(int x, int y, int z);
-  Chunk(const Location& loc, const unsigned char* data, int data_size);
+  // data is the chunk's runs, see chunk_runs.h. Empty if they don't decode to a whole chunk.
+  // With allow_short runs that end early are fine and the rest of the chunk stays empty, only db rows need it
+  static std::optional<Chunk> from_runs(const Location& loc, const unsigned char* data, int data_size, bool allow_short = false);
 
   const Location& get_location() const;
   Voxel get_voxel(int x, int y, int z) const;
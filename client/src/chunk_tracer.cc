@@ -0,0 +1,170 @@
+#include "chunk_tracer.h"
+#include <algorithm>
+#include <sstream>
+
+ChunkTracer::ChunkTracer() : start_(Clock::now()) {}
+
+std::int64_t ChunkTracer::now() const {
+  return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start_).count();
+}
+
+void ChunkTracer::section_requested(const Location2D& loc) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  sections_[loc] = SectionTrace{now(), -1};
+}
+
+void ChunkTracer::section_received(const Location2D& loc) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto& section = sections_[loc];
+  section.received = now();
+  if (section.requested < 0)
+    section.requested = section.received;
+}
+
+void ChunkTracer::forget_section(const Location2D& loc) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  sections_.erase(loc);
+}
+
+// The section stages come from the 5x5 sections WorldGenerator::ready_to_fill waits on. The round trip is
+// the one of the section that arrived last, the chunk can't be filled any sooner
+void ChunkTracer::chunk_fill_started(const Location& loc) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto time = now();
+  ChunkTrace trace{loc, {}};
+  trace.stages.fill(-1);
+  trace.stages[fill_start] = time;
+  std::int64_t requested_min = time;
+  SectionTrace last;
+  for (int x = -2; x <= 2; ++x) {
+    for (int z = -2; z <= 2; ++z) {
+      auto it = sections_.find(Location2D{loc[0] + x, loc[2] + z});
+      if (it == sections_.end() || it->second.received < 0)
+        continue;
+      requested_min = std::min(requested_min, it->second.requested);
+      if (it->second.received > last.received)
+        last = it->second;
+    }
+  }
+  if (last.received < 0)
+    last = SectionTrace{time, time};
+  trace.stages[requested] = requested_min;
+  trace.stages[last_requested] = last.requested;
+  trace.stages[last_section] = last.received;
+  chunks_[loc] = trace;
+}
+
+void ChunkTracer::chunk_fill_finished(const Location& loc) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  advance(loc, fill_end);
+}
+
+void ChunkTracer::chunk_sent_to_mesher(const Location& loc) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  advance(loc, sent_to_mesher);
+}
+
+void ChunkTracer::chunk_meshed(const Location& loc) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  advance(loc, meshed);
+}
+
+void ChunkTracer::chunk_uploaded(const Location& loc) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto it = chunks_.find(loc);
+  if (it == chunks_.end() || it->second.stages[meshed] < 0)
+    return;
+  it->second.stages[uploaded] = now();
+  complete(it->second);
+  chunks_.erase(it);
+}
+
+void ChunkTracer::forget_chunk(const Location& loc) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  chunks_.erase(loc);
+}
+
+// only the first pass through a stage counts, remeshes after edits aren't part of the lifecycle
+void ChunkTracer::advance(const Location& loc, Stage stage) {
+  auto it = chunks_.find(loc);
+  if (it == chunks_.end() || it->second.stages[stage] >= 0)
+    return;
+  it->second.stages[stage] = now();
+}
+
+void ChunkTracer::complete(const ChunkTrace& trace) {
+  for (int i = 0; i < num_transitions; ++i)
+    transitions_[i].record(std::max<std::int64_t>(0, trace.stages[i + 1] - trace.stages[i]));
+  auto total = trace.stages[uploaded] - trace.stages[requested];
+  total_.record(total);
+
+  auto slower = [](const ChunkTrace& a, const ChunkTrace& b) {
+    return (a.stages[uploaded] - a.stages[requested]) > (b.stages[uploaded] - b.stages[requested]);
+  };
+  if (worst_offenders_.size() < max_worst_offenders) {
+    worst_offenders_.push_back(trace);
+    std::sort(worst_offenders_.begin(), worst_offenders_.end(), slower);
+  } else if (slower(trace, worst_offenders_.back())) {
+    worst_offenders_.back() = trace;
+    std::sort(worst_offenders_.begin(), worst_offenders_.end(), slower);
+  }
+}
+
+const char* ChunkTracer::get_transition_name(int transition) {
+  switch (transition) {
+  case requested:
+    return "request wait";
+  case last_requested:
+    return "server round trip";
+  case last_section:
+    return "stream queue";
+  case fill_start:
+    return "fill_chunk";
+  case fill_end:
+    return "adjacents wait";
+  case sent_to_mesher:
+    return "mesh";
+  case meshed:
+    return "gpu upload";
+  default:
+    return "unknown";
+  }
+}
+
+std::string ChunkTracer::report() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  std::stringstream stream;
+  stream << "chunk lifecycle (" << total_.get_count() << " chunks, " << chunks_.size() << " in flight)" << std::endl;
+  for (int i = 0; i < num_transitions; ++i)
+    stream << "  " << get_transition_name(i) << ": " << transitions_[i].summary("us") << std::endl;
+  stream << "  total: " << total_.summary("us") << std::endl;
+  if (!worst_offenders_.empty()) {
+    stream << "  worst offenders:" << std::endl;
+    for (auto& trace : worst_offenders_) {
+      stream << "    " << trace.location << " total=" << trace.stages[uploaded] - trace.stages[requested] << "us";
+      for (int i = 0; i < num_transitions; ++i)
+        stream << " | " << get_transition_name(i) << "=" << trace.stages[i + 1] - trace.stages[i];
+      stream << std::endl;
+    }
+  }
+  worst_offenders_.clear();
+  return stream.str();
+}
+
+nlohmann::json ChunkTracer::to_json() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  nlohmann::json transitions = nlohmann::json::array();
+  for (int i = 0; i < num_transitions; ++i) {
+    transitions.push_back(
+      {{"name", get_transition_name(i)},
+       {"p50", transitions_[i].get_percentile(50)},
+       {"p99", transitions_[i].get_percentile(99)},
+       {"max", transitions_[i].get_max()}});
+  }
+  return {
+    {"completed", total_.get_count()},
+    {"inFlight", chunks_.size()},
+    {"totalP50", total_.get_percentile(50)},
+    {"totalP99", total_.get_percentile(99)},
+    {"transitions", transitions}};
+}
@@ -0,0 +1,85 @@
+#ifndef CHUNK_TRACER_H
+#define CHUNK_TRACER_H
+
+#include <array>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "latency_histogram.h"
+#include "types.h"
+
+// Follows every chunk from the request of its sections to the frame it is first uploaded to the gpu,
+// so streaming stalls can be attributed to a stage. Stages are recorded from both the sim and render threads
+class ChunkTracer final {
+public:
+  enum Stage {
+    requested,
+    // when the section that arrived last was asked for, it's the one that gates the chunk
+    last_requested,
+    last_section,
+    fill_start,
+    fill_end,
+    sent_to_mesher,
+    meshed,
+    uploaded,
+
+    num_stages
+  };
+
+  static ChunkTracer* instance() {
+    static ChunkTracer* instance = new ChunkTracer();
+    return instance;
+  }
+
+  ChunkTracer(const ChunkTracer& other) = delete;
+  ChunkTracer* operator=(const ChunkTracer* other) = delete;
+
+  void section_requested(const Location2D& loc);
+  void section_received(const Location2D& loc);
+  void forget_section(const Location2D& loc);
+  void chunk_fill_started(const Location& loc);
+  void chunk_fill_finished(const Location& loc);
+  void chunk_sent_to_mesher(const Location& loc);
+  void chunk_meshed(const Location& loc);
+  void chunk_uploaded(const Location& loc);
+  void forget_chunk(const Location& loc);
+
+  // histograms for every stage transition followed by the slowest chunks since the last report
+  std::string report();
+  nlohmann::json to_json() const;
+
+  static constexpr int num_transitions = num_stages - 1;
+  static constexpr int max_worst_offenders = 10;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct SectionTrace {
+    std::int64_t requested = -1;
+    std::int64_t received = -1;
+  };
+
+  struct ChunkTrace {
+    Location location;
+    std::array<std::int64_t, num_stages> stages;
+  };
+
+  ChunkTracer();
+  std::int64_t now() const;
+  void advance(const Location& loc, Stage stage);
+  void complete(const ChunkTrace& trace);
+  static const char* get_transition_name(int transition);
+
+  mutable std::mutex mutex_;
+  Clock::time_point start_;
+  std::unordered_map<Location2D, SectionTrace, Location2DHash> sections_;
+  std::unordered_map<Location, ChunkTrace, LocationHash> chunks_;
+  std::array<common::LatencyHistogram, num_transitions> transitions_;
+  common::LatencyHistogram total_;
+  std::vector<ChunkTrace> worst_offenders_;
+};
+
+#endif
@@ -3,6 +3,7 @@
 #include <filesystem>
 #include <string>
 #include <vector>
+#include "chunk_runs.h"
 #include "common.h"
 
 DbManager::DbManager() {
@@ -46,9 +47,31 @@ DbManager::DbManager() {
       throw std::runtime_error("Failed to initialize DbManager");
     }
   }
+
+  // added after the other tables, so dbs from before it get it here
+  std::string section_table =
+    "create table if not exists Section("
+    "\tx integer not null,"
+    "\tz integer not null,"
+    "\televation integer not null,"
+    "\tlandcover blob not null,"
+    "\tprimary key (x,z)"
+    ") without rowid;";
+  char* err_msg;
+  failure = sqlite3_exec(db_, section_table.c_str(), NULL, 0, &err_msg);
+  if (failure) {
+    std::cerr << "Failed to create table: " << err_msg << std::endl;
+    sqlite3_free(err_msg);
+    throw std::runtime_error("Failed to initialize DbManager");
+  }
+  // prepared once, sections are read and written in batches every time the player moves
+  sqlite3_prepare_v2(db_, "select elevation, landcover from Section where x = ? and z = ?;", -1, &load_section_stmt_, nullptr);
+  sqlite3_prepare_v2(db_, "insert or replace into Section(x,z,elevation,landcover) values(?,?,?,?);", -1, &save_section_stmt_, nullptr);
 }
 
 DbManager::~DbManager() {
+  sqlite3_finalize(load_section_stmt_);
+  sqlite3_finalize(save_section_stmt_);
   sqlite3_close(db_);
 }
 
@@ -63,7 +86,11 @@ std::optional<Chunk> DbManager::load_chunk_if_exists(const Location& loc) {
   if (rc == SQLITE_ROW) {
     const unsigned char* data = static_cast<const unsigned char*>(sqlite3_column_blob(stmt, 0));
     int data_size = sqlite3_column_bytes(stmt, 0);
-    auto chunk = Chunk(loc, data, data_size);
+    // chunks saved before the final run was written end early, the rest stays empty.
+    // A row that doesn't decode at all is generated again
+    auto chunk = Chunk::from_runs(loc, data, data_size, true);
+    if (!chunk)
+      std::cerr << "Discarding malformed chunk " << loc[0] << " " << loc[1] << " " << loc[2] << " from db" << std::endl;
     sqlite3_finalize(stmt);
     return chunk;
   } else {
@@ -76,23 +103,7 @@ void DbManager::save_chunk(const Chunk& chunk) {
   std::vector<std::uint32_t> runs;
   auto& loc = chunk.get_location();
   runs.reserve(Chunk::sz); // worst case
-  auto last_voxel = chunk.get_voxel(0, 0, 0);
-  std::uint32_t run_length = 0;
-  for (int y = 0; y < Chunk::sz_y; ++y) {
-    for (int x = 0; x < Chunk::sz_x; ++x) {
-      for (int z = 0; z < Chunk::sz_z; ++z) {
-        auto voxel = chunk.get_voxel(x, y, z);
-        if (voxel == last_voxel) {
-          ++run_length;
-        } else {
-          std::uint32_t run = (static_cast<std::uint32_t>(last_voxel) << 16) | run_length;
-          runs.push_back(run);
-          last_voxel = voxel;
-          run_length = 1;
-        }
-      }
-    }
-  }
+  common::encode_chunk_runs(chunk.get_voxels(), runs);
   std::string sql = "insert or replace into Chunk(x,y,z,data) values(?,?,?,?);";
   sqlite3_stmt* stmt;
   sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr);
@@ -105,6 +116,39 @@ void DbManager::save_chunk(const Chunk& chunk) {
   sqlite3_finalize(stmt);
 }
 
+void DbManager::save_sections(std::span<const Section* const> sections) {
+  if (sections.empty())
+    return;
+  sqlite3_exec(db_, "begin;", NULL, 0, NULL);
+  for (auto* section : sections) {
+    auto& loc = section->get_location();
+    auto& landcover = section->get_landcover();
+    sqlite3_bind_int(save_section_stmt_, 1, loc[0]);
+    sqlite3_bind_int(save_section_stmt_, 2, loc[1]);
+    sqlite3_bind_int(save_section_stmt_, 3, section->get_elevation());
+    sqlite3_bind_blob(save_section_stmt_, 4, landcover.data(), landcover.size() * sizeof(common::LandCover), SQLITE_STATIC);
+    sqlite3_step(save_section_stmt_);
+    sqlite3_reset(save_section_stmt_);
+  }
+  sqlite3_exec(db_, "commit;", NULL, 0, NULL);
+}
+
+void DbManager::load_sections(std::span<const Location2D> locs, std::vector<Section>& sections) {
+  sqlite3_exec(db_, "begin;", NULL, 0, NULL);
+  for (auto& loc : locs) {
+    sqlite3_bind_int(load_section_stmt_, 1, loc[0]);
+    sqlite3_bind_int(load_section_stmt_, 2, loc[1]);
+    if (sqlite3_step(load_section_stmt_) == SQLITE_ROW &&
+        sqlite3_column_bytes(load_section_stmt_, 1) == common::landcover_tiles_per_sector) {
+      int elevation = sqlite3_column_int(load_section_stmt_, 0);
+      auto* landcover = static_cast<const std::uint8_t*>(sqlite3_column_blob(load_section_stmt_, 1));
+      sections.emplace_back(loc, elevation, landcover);
+    }
+    sqlite3_reset(load_section_stmt_);
+  }
+  sqlite3_exec(db_, "commit;", NULL, 0, NULL);
+}
+
 void DbManager::load_camera(Camera& camera) {
   sqlite3_stmt* stmt;
   std::string sql = "select * from Player;";
@@ -2,9 +2,12 @@
 #define DB_MANAGER_H
 
 #include <optional>
+#include <span>
+#include <vector>
 #include <sqlite3.h>
 #include "chunk.h"
 #include "camera.h"
+#include "section.h"
 
 class DbManager {
 public:
@@ -14,9 +17,15 @@ public:
   void save_camera(const Camera& camera);
   void load_camera(Camera& camera);
   std::optional<Chunk> load_chunk_if_exists(const Location& loc);
+  // sections never change once generated, so any the server sent before are read from here
+  void save_sections(std::span<const Section* const> sections);
+  // appends the sections found, in the order of locs
+  void load_sections(std::span<const Location2D> locs, std::vector<Section>& sections);
 
 private:
   sqlite3* db_;
+  sqlite3_stmt* load_section_stmt_ = nullptr;
+  sqlite3_stmt* save_section_stmt_ = nullptr;
 };
 
 #endif
\ No newline at end of file
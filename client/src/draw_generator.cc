@@ -1,37 +1,66 @@
 #include "draw_generator.h"
+#include "alloc_tracker.h"
 
 DrawGenerator::DrawGenerator(Renderer& renderer) : renderer_(renderer) {}
 
 void DrawGenerator::generate_and_dispatch(const SceneComponent& scene_component) {
-  DrawCommand command;
+  ALLOC_SCOPE(AllocSubsystem::rendering, "DrawGenerator::generate_and_dispatch");
+  auto& packet = get_packet(scene_component);
+  DrawCommand command = packet.command;
+  command.vertex_count = scene_component.get_vertex_count();
+  command.index_count = scene_component.get_indices().size();
+
+  auto uniforms = renderer_.get_frame_arena().allocate<UniformBinding>(1);
+  uniforms[0] = UniformBinding{packet.model_uniform_id, UniformType::Matrix4f, (void*)&scene_component.get_model_transform()};
+  command.uniforms = uniforms;
+  renderer_.render(command);
+}
+
+DrawGenerator::DrawPacket& DrawGenerator::get_packet(const SceneComponent& scene_component) {
+  std::uint32_t component_id = scene_component.get_id();
+  if (component_id >= packets_.size())
+    packets_.resize(component_id + 1);
+  auto& packet = packets_[component_id];
+  if (!packet.compiled || packet.material_version != scene_component.get_material_version())
+    compile(scene_component, packet);
+  return packet;
+}
+
+void DrawGenerator::compile(const SceneComponent& scene_component, DrawPacket& packet) {
+  auto& command = packet.command;
   std::uint32_t component_id = scene_component.get_id();
   auto& material = scene_component.get_material();
   auto& shader_name = material.get_name();
-  auto& shader = renderer_.get_shader(shader_name);
+  auto shader = renderer_.get_shader(shader_name);
   command.shader_id = shader.get_id();
   command.vertex_buffer_id = renderer_.get_vertex_buffer_id(component_id);
+  command.vertex_array_id = renderer_.get_vertex_array_id(component_id);
   auto& indices = scene_component.get_indices();
   if (indices.size() > 0)
     command.index_buffer_id = renderer_.get_index_buffer_id(component_id);
   else
     command.index_buffer_id = -1;
-  command.vertex_count = scene_component.get_vertex_count();
-  command.index_count = scene_component.get_indices().size();
   command.instance_count = 0;
   command.primitive_type = scene_component.get_primitive_type();
-  GLuint model_id = renderer_.get_uniform_id(shader_name, "model");
-  command.uniforms.emplace_back(model_id, UniformType::Matrix4f, (void*)&scene_component.get_model_transform());
+  packet.model_uniform_id = renderer_.get_uniform_id(shader_name, "model");
+
+  packet.texture_bindings.clear();
   auto& texture_binding_points = shader.get_texture_binding_points();
   for (auto& [name, binding_point] : texture_binding_points) {
     GLuint texture_id = renderer_.get_texture(name);
-    command.texture_bindings.emplace_back(texture_id, binding_point);
+    packet.texture_bindings.emplace_back(texture_id, binding_point);
   }
+  packet.uniform_buffer_bindings.clear();
   auto& uniform_buffer_binding_points = shader.get_uniform_buffer_binding_points();
   for (auto& [name, binding_point] : uniform_buffer_binding_points) {
     GLuint buffer_id = renderer_.get_uniform_buffer(name);
-    command.uniform_buffer_bindings.emplace_back(buffer_id, binding_point);
+    packet.uniform_buffer_bindings.emplace_back(buffer_id, binding_point);
   }
+  command.texture_bindings = packet.texture_bindings;
+  command.uniform_buffer_bindings = packet.uniform_buffer_bindings;
   command.blend = material.get_blend_mode() == Material::BlendMode::Opaque;
   command.depth_test = material.get_material_domain() == Material::MaterialDomain::Surface;
-  renderer_.render(command);
-}
\ No newline at end of file
+
+  packet.material_version = scene_component.get_material_version();
+  packet.compiled = true;
+}
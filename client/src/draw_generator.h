@@ -1,6 +1,7 @@
 #ifndef DRAW_GENERATOR_H
 #define DRAW_GENERATOR_H
 
+#include <vector>
 #include "renderer.h"
 #include "scene_component.h"
 
@@ -10,7 +11,22 @@ public:
   void generate_and_dispatch(const SceneComponent& scene_component);
 
 private:
+  // everything about a draw that only changes with the component's material,
+  // resolved once so dispatching doesn't hash shader, texture or uniform names
+  struct DrawPacket {
+    bool compiled = false;
+    std::uint32_t material_version;
+    DrawCommand command;
+    GLint model_uniform_id;
+    std::vector<UniformBufferBinding> uniform_buffer_bindings;
+    std::vector<TextureBinding> texture_bindings;
+  };
+  DrawPacket& get_packet(const SceneComponent& scene_component);
+  void compile(const SceneComponent& scene_component, DrawPacket& packet);
+
   Renderer& renderer_;
+  // indexed by component id, ids are handed out sequentially by Renderer::register_scene_component
+  std::vector<DrawPacket> packets_;
 };
 
-#endif
\ No newline at end of file
+#endif
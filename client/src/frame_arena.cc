@@ -0,0 +1,35 @@
+#include "frame_arena.h"
+#include <cstdint>
+
+FrameArena::FrameArena(std::size_t capacity) : block_(new std::byte[capacity]), capacity_(capacity) {}
+
+void* FrameArena::allocate_bytes(std::size_t size, std::size_t alignment) {
+  auto base = reinterpret_cast<std::uintptr_t>(block_.get());
+  auto aligned = (base + offset_ + alignment - 1) & ~(alignment - 1);
+  if (aligned + size <= base + capacity_) {
+    offset_ = aligned + size - base;
+    return reinterpret_cast<void*>(aligned);
+  }
+  // operator new[] is aligned for any fundamental type
+  overflow_.emplace_back(new std::byte[size]);
+  overflow_bytes_ += size;
+  return overflow_.back().get();
+}
+
+void FrameArena::reset() {
+  if (overflow_bytes_ > 0) {
+    capacity_ = 2 * (capacity_ + overflow_bytes_);
+    block_.reset(new std::byte[capacity_]);
+    overflow_.clear();
+    overflow_bytes_ = 0;
+  }
+  offset_ = 0;
+}
+
+std::size_t FrameArena::get_used() const {
+  return offset_ + overflow_bytes_;
+}
+
+std::size_t FrameArena::get_capacity() const {
+  return capacity_;
+}
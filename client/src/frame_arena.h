@@ -0,0 +1,43 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+// Linear allocator for data that only lives until the end of the frame, reset by Renderer::render_scene.
+// Overflow goes to extra blocks which are folded into one bigger block on the next reset,
+// so after the first few frames allocating from it never touches the heap
+class FrameArena {
+public:
+  FrameArena(std::size_t capacity);
+  FrameArena(const FrameArena& other) = delete;
+  FrameArena& operator=(const FrameArena& other) = delete;
+
+  template <typename T>
+  std::span<T> allocate(std::size_t count) {
+    static_assert(std::is_trivially_destructible_v<T>, "frame arena never runs destructors");
+    void* p = allocate_bytes(sizeof(T) * count, alignof(T));
+    T* data = static_cast<T*>(p);
+    for (std::size_t i = 0; i < count; ++i)
+      new (data + i) T();
+    return std::span<T>(data, count);
+  }
+  void reset();
+  std::size_t get_used() const;
+  std::size_t get_capacity() const;
+
+private:
+  void* allocate_bytes(std::size_t size, std::size_t alignment);
+
+  std::unique_ptr<std::byte[]> block_;
+  std::size_t capacity_;
+  std::size_t offset_ = 0;
+  std::vector<std::unique_ptr<std::byte[]>> overflow_;
+  std::size_t overflow_bytes_ = 0;
+};
+
+#endif
@@ -101,6 +101,8 @@ void LodMeshGenerator::mesh_chunk(LodLoader& lod_loader, const Location& locatio
   }
 }
 
+template void LodMeshGenerator::mesh_chunk<LodLevel::lod1>(LodLoader& lod_loader, const Location& location);
+
 void LodMeshGenerator::consume_lod_loader(LodLoader& lod_loader) {
   auto& diffs = lod_loader.get_diffs();
   for (auto& diff : diffs) {
@@ -29,6 +29,9 @@ public:
   template <LodLevel level>
   const std::vector<LodVertex>& get_mesh(const Location& loc) const;
 
+  template <LodLevel level>
+  void mesh_chunk(LodLoader& lod_loader, const Location& location);
+
   static constexpr int defacto_vertices_per_lod1_mesh = 10000;
   
 private:
@@ -42,8 +45,6 @@ private:
     std::vector<LodVertex>& get();
   };
 
-  template <LodLevel level>
-  void mesh_chunk(LodLoader& lod_loader, const Location& location);
   template <LodLevel level>
   std::array<Voxel, 6> get_adjacent_voxels(
     const ChunkLod<level>& lod, std::array<const ChunkLod<level>*, 6>& adjacent_lods, int x, int y, int z);
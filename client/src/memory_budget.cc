@@ -0,0 +1,107 @@
+#include "memory_budget.h"
+#include "options.h"
+
+MemoryBudget::MemoryBudget() : budget_(static_cast<std::int64_t>(Options::memory_budget_mb) * 1024 * 1024) {
+  for (auto& usage : usage_)
+    usage.store(0);
+}
+
+void MemoryBudget::add(MemoryCategory category, std::int64_t bytes) {
+  usage_[static_cast<std::size_t>(category)].fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void MemoryBudget::sub(MemoryCategory category, std::int64_t bytes) {
+  usage_[static_cast<std::size_t>(category)].fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+void MemoryBudget::set(MemoryCategory category, std::int64_t bytes) {
+  usage_[static_cast<std::size_t>(category)].store(bytes, std::memory_order_relaxed);
+}
+
+std::int64_t MemoryBudget::get_usage(MemoryCategory category) const {
+  return usage_[static_cast<std::size_t>(category)].load(std::memory_order_relaxed);
+}
+
+std::int64_t MemoryBudget::get_total_usage() const {
+  std::int64_t total = 0;
+  for (auto& usage : usage_)
+    total += usage.load(std::memory_order_relaxed);
+  return total;
+}
+
+std::int64_t MemoryBudget::get_budget() const {
+  return budget_.load(std::memory_order_relaxed);
+}
+
+void MemoryBudget::set_budget(std::int64_t bytes) {
+  budget_.store(bytes, std::memory_order_relaxed);
+}
+
+bool MemoryBudget::over_budget() const {
+  return get_total_usage() > get_budget();
+}
+
+nlohmann::json MemoryBudget::to_json() const {
+  nlohmann::json categories;
+  for (std::size_t i = 0; i < num_categories; ++i) {
+    auto category = static_cast<MemoryCategory>(i);
+    categories[get_category_name(category)] = get_usage(category);
+  }
+  return {
+    {"budget", get_budget()},
+    {"total", get_total_usage()},
+    {"categories", categories}};
+}
+
+const char* MemoryBudget::get_category_name(MemoryCategory category) {
+  switch (category) {
+  case MemoryCategory::chunks:
+    return "chunks";
+  case MemoryCategory::sections:
+    return "sections";
+  case MemoryCategory::cpu_meshes:
+    return "cpuMeshes";
+  case MemoryCategory::gpu_buffers:
+    return "gpuBuffers";
+  case MemoryCategory::undo_history:
+    return "undoHistory";
+  default:
+    return "unknown";
+  }
+}
+
+MemoryCharge::MemoryCharge(const MemoryCharge& other) : category_(other.category_) {
+  set(other.bytes_);
+}
+
+MemoryCharge::MemoryCharge(MemoryCharge&& other) noexcept : category_(other.category_), bytes_(other.bytes_) {
+  other.bytes_ = 0;
+}
+
+MemoryCharge& MemoryCharge::operator=(const MemoryCharge& other) {
+  if (this != &other) {
+    set(0);
+    category_ = other.category_;
+    set(other.bytes_);
+  }
+  return *this;
+}
+
+MemoryCharge& MemoryCharge::operator=(MemoryCharge&& other) noexcept {
+  if (this != &other) {
+    set(0);
+    category_ = other.category_;
+    bytes_ = other.bytes_;
+    other.bytes_ = 0;
+  }
+  return *this;
+}
+
+MemoryCharge::~MemoryCharge() {
+  set(0);
+}
+
+void MemoryCharge::set(std::int64_t bytes) {
+  MemoryBudget::instance()->add(category_, bytes - bytes_);
+  bytes_ = bytes;
+}
@@ -0,0 +1,69 @@
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <nlohmann/json.hpp>
+
+enum class MemoryCategory {
+  chunks,
+  sections,
+  cpu_meshes,
+  gpu_buffers,
+  undo_history,
+
+  num_categories
+};
+
+// Central accounting of the big memory consumers, updated from both the sim and render threads.
+// The total budget is what the sim evicts against, see Sim::enforce_memory_budget
+class MemoryBudget final {
+public:
+  static MemoryBudget* instance() {
+    static MemoryBudget* instance = new MemoryBudget();
+    return instance;
+  }
+
+  MemoryBudget(const MemoryBudget& other) = delete;
+  MemoryBudget* operator=(const MemoryBudget* other) = delete;
+
+  void add(MemoryCategory category, std::int64_t bytes);
+  void sub(MemoryCategory category, std::int64_t bytes);
+  void set(MemoryCategory category, std::int64_t bytes);
+  std::int64_t get_usage(MemoryCategory category) const;
+  std::int64_t get_total_usage() const;
+  std::int64_t get_budget() const;
+  void set_budget(std::int64_t bytes);
+  bool over_budget() const;
+  nlohmann::json to_json() const;
+
+  static const char* get_category_name(MemoryCategory category);
+
+private:
+  MemoryBudget();
+
+  static constexpr std::size_t num_categories = static_cast<std::size_t>(MemoryCategory::num_categories);
+  std::array<std::atomic<std::int64_t>, num_categories> usage_;
+  std::atomic<std::int64_t> budget_;
+};
+
+// Bytes an object holds in a category, on the budget for as long as the object lives. Copies charge their
+// bytes again and moves hand them over, so an object can keep its own usage up to date as a plain member
+class MemoryCharge final {
+public:
+  explicit MemoryCharge(MemoryCategory category) : category_(category) {}
+  MemoryCharge(const MemoryCharge& other);
+  MemoryCharge(MemoryCharge&& other) noexcept;
+  MemoryCharge& operator=(const MemoryCharge& other);
+  MemoryCharge& operator=(MemoryCharge&& other) noexcept;
+  ~MemoryCharge();
+
+  void set(std::int64_t bytes);
+
+private:
+  MemoryCategory category_;
+  std::int64_t bytes_ = 0;
+};
+
+#endif
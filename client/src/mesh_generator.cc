@@ -4,6 +4,9 @@
 #include <cmath>
 #include <iostream>
 #include <glm/ext.hpp>
+#include "alloc_tracker.h"
+#include "chunk_tracer.h"
+#include "memory_budget.h"
 #include "mesh_utils.h"
 
 MeshGenerator::MeshGenerator() {}
@@ -267,6 +270,7 @@ void MeshGenerator::consume_region(Region& region) {
       //      auto start = std::chrono::high_resolution_clock::now();
       random_seed_ = 0;
       mesh_chunk(region, loc);
+      ChunkTracer::instance()->chunk_meshed(loc);
       diffs_.emplace_back(loc, Diff::creation);
 
       /*             auto end = std::chrono::high_resolution_clock::now();
@@ -283,6 +287,16 @@ void MeshGenerator::consume_region(Region& region) {
   /* if (num_meshed > 0)
     std::cout << "Average execution time: " << total_duration / num_meshed << " microseconds" << std::endl; */
   region.clear_diffs();
+
+  std::int64_t mesh_bytes = 0;
+  for (auto& [_, mesh] : meshes_)
+    mesh_bytes += mesh.capacity() * sizeof(CubeVertex);
+  for (auto& [_, mesh] : irregular_meshes_)
+    mesh_bytes += mesh.capacity() * sizeof(Vertex);
+  for (auto& [_, mesh] : water_meshes_)
+    mesh_bytes += mesh.capacity() * sizeof(Vertex);
+  MemoryBudget::instance()->add(MemoryCategory::cpu_meshes, mesh_bytes - mesh_bytes_);
+  mesh_bytes_ = mesh_bytes;
 }
 
 const std::vector<MeshGenerator::Diff>& MeshGenerator::get_diffs() const {
@@ -290,6 +304,8 @@ const std::vector<MeshGenerator::Diff>& MeshGenerator::get_diffs() const {
 }
 
 void MeshGenerator::clear_diffs() {
+  MemoryBudget::instance()->sub(MemoryCategory::cpu_meshes, mesh_bytes_);
+  mesh_bytes_ = 0;
   meshes_.clear();
   irregular_meshes_.clear();
   water_meshes_.clear();
@@ -305,12 +321,15 @@ const Location& MeshGenerator::get_origin() const {
 }
 
 const std::vector<CubeVertex> MeshGenerator::get_mesh(const Location& loc) const {
+  ALLOC_SCOPE(AllocSubsystem::meshing, "MeshGenerator::get_mesh");
   return meshes_.at(loc);
 }
 const std::vector<Vertex> MeshGenerator::get_irregular_mesh(const Location& loc) const {
+  ALLOC_SCOPE(AllocSubsystem::meshing, "MeshGenerator::get_irregular_mesh");
   return irregular_meshes_.at(loc);
 }
 
 const std::vector<Vertex> MeshGenerator::get_water_mesh(const Location& loc) const {
+  ALLOC_SCOPE(AllocSubsystem::meshing, "MeshGenerator::get_water_mesh");
   return water_meshes_.at(loc);
 }
\ No newline at end of file
@@ -28,12 +28,13 @@ public:
   const std::vector<Diff>& get_diffs() const;
   const Location& get_origin() const;
   void clear_diffs();
+  // public so the bench target can drive the mesher directly
+  void mesh_chunk(const Region& region, const Location& location);
   static constexpr int defacto_vertices_per_mesh = 80000;
   static constexpr int defacto_vertices_per_irregular_mesh = 4000;
   static constexpr int defacto_vertices_per_water_mesh = 3000;
 
 private:
-  void mesh_chunk(const Region& region, const Location& location);
   void mesh_noncube(std::vector<Vertex>& mesh, glm::vec3& position, Voxel voxel);
   void mesh_water(std::vector<Vertex>& mesh, glm::vec3& position, Voxel voxel, std::array<Voxel, 6>& adjacent);
   std::array<Voxel, 6> get_adjacent_voxels(const Chunk& chunk, std::array<const Chunk*, 6>& adjacent_chunks, int x, int y, int z) const;
@@ -46,6 +47,7 @@ private:
   Location origin_;
   bool origin_set_ = false;
   std::uint32_t random_seed_ = 0;
+  std::int64_t mesh_bytes_ = 0;
 };
 
 #endif
\ No newline at end of file
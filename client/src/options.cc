@@ -4,6 +4,11 @@
 
 int Options::window_width = 2560;
 int Options::window_height = 1440;
+int Options::memory_budget_mb = 1024;
+bool Options::server_chunks = false;
+bool Options::shared_memory = true;
+bool Options::compression = true;
+bool Options::trace_report = false;
 
 Options* Options::instance(int argc, char* argv[]) {
   static Options* instance = new Options(argc, argv);
@@ -19,6 +24,19 @@ Options::Options(int argc, char* argv[]) {
     this->dir = dir;
   else
     throw std::invalid_argument("Path provided is not an existing directory.");
+
+  for (int i = 2; i < argc; ++i) {
+    if (std::string(argv[i]) == "--server-chunks")
+      server_chunks = true;
+    else if (std::string(argv[i]) == "--tcp")
+      shared_memory = false;
+    else if (std::string(argv[i]) == "--no-compression")
+      compression = false;
+    else if (std::string(argv[i]) == "--trace-report")
+      trace_report = true;
+    else
+      std::cerr << "Ignoring unknown option " << argv[i] << std::endl;
+  }
 }
 
 std::string Options::get_shader_path(const std::string& name) {
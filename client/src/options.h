@@ -19,6 +19,15 @@ public:
   std::string get_ui_path(const std::string& name);
   static int window_width;
   static int window_height;
+  static int memory_budget_mb;
+  // --server-chunks, chunks are generated by the server instead of from sections here
+  static bool server_chunks;
+  // cleared by --tcp, otherwise the connection moves to shared memory if the server can map it
+  static bool shared_memory;
+  // cleared by --no-compression, otherwise frames over TCP are compressed if the server agrees
+  static bool compression;
+  // --trace-report, print the chunk lifecycle and prefetch reports to stdout as well as the profiler
+  static bool trace_report;
 
 private:
   static constexpr const char* shaders_dir = "shaders";
@@ -24,4 +24,21 @@ Item Player::get_active_item() {
 
 void Player::set_active_item(Item item) {
   active_item_ = item;
-}
\ No newline at end of file
+}
+
+void Player::sample_position(std::chrono::steady_clock::time_point now) {
+  position_history_.emplace_back(now, position_);
+  while (position_history_.size() > 2 && now - position_history_.front().first > velocity_window)
+    position_history_.pop_front();
+}
+
+glm::dvec3 Player::get_velocity() const {
+  if (position_history_.size() < 2)
+    return glm::dvec3(0);
+  auto& [start, from] = position_history_.front();
+  auto& [end, to] = position_history_.back();
+  double seconds = std::chrono::duration<double>(end - start).count();
+  if (seconds <= 0)
+    return glm::dvec3(0);
+  return (to - from) / seconds;
+}
@@ -2,6 +2,9 @@
 #define PLAYER_H
 
 #include <array>
+#include <chrono>
+#include <deque>
+#include <utility>
 #include <vector>
 #include "camera.h"
 #include "types.h"
@@ -16,9 +19,16 @@ public:
   void set_last_location(Location& location);
   void set_active_item(Item item);
   Item get_active_item();
+  // once per step, velocity is averaged over the samples from the last velocity_window
+  void sample_position(std::chrono::steady_clock::time_point now);
+  // world units per second, zero until there are two samples
+  glm::dvec3 get_velocity() const;
+
+  static constexpr auto velocity_window = std::chrono::milliseconds(500);
 
 private:
   glm::dvec3 position_;
+  std::deque<std::pair<std::chrono::steady_clock::time_point, glm::dvec3>> position_history_;
   Location last_location_;
   Item active_item_;
 };
@@ -5,9 +5,16 @@
 #include <iostream>
 #include <optional>
 #include <queue>
+#include "alloc_tracker.h"
+#include "chunk_tracer.h"
+#include "memory_budget.h"
+
+namespace {
+  constexpr std::int64_t chunk_bytes = sizeof(Chunk) + sizeof(Voxel) * Chunk::sz;
+  constexpr std::int64_t history_entry_bytes = sizeof(int) + sizeof(Int3D) + sizeof(Voxel);
+}
 
 int Region::max_sz = 512;
-int Region::max_sz_internal = Region::max_sz * 2;
 
 std::unordered_map<Location, Chunk, LocationHash>& Region::get_chunks() {
   return chunks_;
@@ -47,8 +54,7 @@ std::array<Location, 6> Region::get_adjacent_locations(const Location& loc) cons
 void Region::delete_furthest_chunk(const Location& loc) {
   if (chunks_sent_.size() >= max_sz) {
     int max_difference = 0;
-    Chunk* chunk_to_delete = nullptr;
-    const Location* to_delete;
+    const Location* to_delete = nullptr;
     for (auto& location : chunks_sent_) {
       auto& chunk = chunks_.at(location);
       if (chunk.check_flag(ChunkFlags::Deleted)) {
@@ -58,17 +64,24 @@ void Region::delete_furthest_chunk(const Location& loc) {
       int difference = LocationMath::distance(loc, location);
       if (difference > max_difference) {
         max_difference = difference;
-        chunk_to_delete = &chunk;
         to_delete = &location;
       }
     }
-    chunk_to_delete->set_flag(ChunkFlags::Deleted);
-    diffs_.emplace_back(*to_delete, Diff::deletion);
-    chunks_sent_.erase(*to_delete);
+    delete_sent_chunk(*to_delete);
   }
 }
 
+// The mesher and renderer drop the chunk's mesh when they see the diff, it's erased once they have.
+// Its bytes come off the budget now so eviction doesn't keep going for what's already on its way out
+void Region::delete_sent_chunk(Location loc) {
+  chunks_.at(loc).set_flag(ChunkFlags::Deleted);
+  MemoryBudget::instance()->sub(MemoryCategory::chunks, chunk_bytes);
+  diffs_.emplace_back(loc, Diff::deletion);
+  chunks_sent_.erase(loc);
+}
+
 void Region::chunk_to_mesh_generator(const Location& loc) {
+  ChunkTracer::instance()->chunk_sent_to_mesher(loc);
   delete_furthest_chunk(loc);
   diffs_.emplace_back(loc, Diff::creation);
   chunks_sent_.insert(loc);
@@ -76,7 +89,20 @@ void Region::chunk_to_mesh_generator(const Location& loc) {
 
 void Region::add_chunk(Chunk&& chunk) {
   auto loc = chunk.get_location();
-  chunks_.insert({loc, std::move(chunk)});
+  auto held = remote_edits_.find(loc);
+  if (held != remote_edits_.end()) {
+    for (auto& [idx, voxel] : held->second) {
+      chunk.set_voxel(idx, voxel);
+      if (voxel != Voxel::empty)
+        chunk.unset_flag(ChunkFlags::Empty);
+    }
+    remote_edits_.erase(held);
+  }
+  // empty chunks are never meshed, their trace ends here
+  if (chunk.check_flag(ChunkFlags::Empty))
+    ChunkTracer::instance()->forget_chunk(loc);
+  if (chunks_.insert({loc, std::move(chunk)}).second)
+    MemoryBudget::instance()->add(MemoryCategory::chunks, chunk_bytes);
 
   auto adjacent = get_adjacent_locations(loc);
 
@@ -112,45 +138,43 @@ void Region::clear_diffs() {
   for (auto& diff : diffs_) {
     auto& loc = diff.location;
     if (diff.kind == Region::Diff::deletion) {
-      chunks_.erase(loc);
-      // std::cout<<"deleting at "<<loc<<std::endl;
-      auto adjacent = get_adjacent_locations(loc);
-      for (auto& location : adjacent) {
-        ++adjacents_missing_[location];
-      }
+      erase_chunk(loc);
     }
   }
 
-  if (chunks_.size() > max_sz_internal) {
-    std::vector<Location> loaded_locations;
-    for (auto& [location, _] : chunks_) {
-      if (!chunks_sent_.contains(location))
-        loaded_locations.push_back(location);
-    }
+  diffs_.clear();
+}
 
-    auto& player_location_ = player_.get_last_location();
-    std::sort(
-      loaded_locations.begin(), loaded_locations.end(),
-      [&player_location_](const Location l1, const Location l2) {
-        auto d1 = LocationMath::distance(l1, player_location_);
-        auto d2 = LocationMath::distance(l2, player_location_);
-        return d1 > d2;
-      });
-    int to_remove = chunks_.size() - max_sz_internal;
-
-    for (int i = 0; i < to_remove; ++i) {
-      auto& location = loaded_locations[i];
-      chunks_.erase(location);
-      // std::cout<<"removing at "<<location<<std::endl;
-
-      auto adjacent = get_adjacent_locations(loaded_locations[i]);
-      for (auto& location : adjacent) {
-        ++adjacents_missing_[location];
-      }
-    }
+void Region::erase_chunk(const Location& loc) {
+  auto it = chunks_.find(loc);
+  if (it == chunks_.end())
+    return;
+  if (!it->second.check_flag(ChunkFlags::Deleted))
+    MemoryBudget::instance()->sub(MemoryCategory::chunks, chunk_bytes);
+  chunks_.erase(it);
+  ChunkTracer::instance()->forget_chunk(loc);
+  auto adjacent = get_adjacent_locations(loc);
+  for (auto& location : adjacent) {
+    ++adjacents_missing_[location];
   }
+}
 
-  diffs_.clear();
+std::vector<Location> Region::get_evictable_chunks() const {
+  std::vector<Location> locations;
+  for (auto& [location, chunk] : chunks_) {
+    if (!chunk.check_flag(ChunkFlags::Deleted))
+      locations.push_back(location);
+  }
+  return locations;
+}
+
+// Chunks that never made it to the mesh generator go straight away, meshed ones go the way
+// delete_furthest_chunk sends them so their mesh and draw command are released too
+void Region::evict_chunk(const Location& loc) {
+  if (chunks_sent_.contains(loc))
+    delete_sent_chunk(loc);
+  else
+    erase_chunk(loc);
 }
 
 Location Region::location_from_global_coord(int x, int y, int z) {
@@ -197,6 +221,7 @@ Player& Region::get_player() {
 
 // Credit: https://github.com/francisengelmann/fast_voxel_traversal
 std::vector<Int3D> Region::raycast(const glm::dvec3& pos, const glm::dvec3& dir, int num_voxels) {
+  ALLOC_SCOPE(AllocSubsystem::region, "Region::raycast");
   std::vector<Int3D> visited_voxels;
   visited_voxels.reserve(num_voxels);
 
@@ -337,6 +362,7 @@ void Region::raycast_place(const glm::dvec3& pos, const glm::dvec3& dir, Voxel v
           auto& chunk = chunks_.at(loc);
           auto local = Chunk::to_local(coord);
           chunk.set_voxel(local[0], local[1], local[2], voxel);
+          record_local_edit(loc, Chunk::get_index(local), voxel);
           updated_since_reset_.insert(loc);
 
           if (!chunks_sent_.contains(loc)) {
@@ -365,6 +391,7 @@ void Region::raycast_remove(const Camera& camera) {
       auto voxel = chunk.get_voxel(local[0], local[1], local[2]);
       if (voxel != Voxel::empty) {
         chunk.set_voxel(local[0], local[1], local[2], Voxel::empty);
+        record_local_edit(loc, Chunk::get_index(local), Voxel::empty);
         updated_since_reset_.insert(loc);
         diffs_.emplace_back(loc, Diff::creation);
         update_adjacent_chunks(coord);
@@ -410,6 +437,45 @@ bool Region::set_voxel_if_possible(const Location& loc, int idx, Voxel voxel) {
   return true;
 }
 
+void Region::record_local_edit(const Location& loc, int idx, Voxel voxel) {
+  local_edits_[loc].insert_or_assign(static_cast<std::uint16_t>(idx), voxel);
+}
+
+std::unordered_map<Location, std::map<std::uint16_t, Voxel>, LocationHash> Region::take_local_edits() {
+  return std::exchange(local_edits_, {});
+}
+
+void Region::apply_remote_edits(const Location& loc, std::span<const VoxelEdit> edits) {
+  auto it = chunks_.find(loc);
+  if (it == chunks_.end()) {
+    auto& held = remote_edits_[loc];
+    for (auto& edit : edits)
+      held.insert_or_assign(edit.index, edit.voxel);
+    return;
+  }
+  auto& chunk = it->second;
+  std::unordered_set<Location, LocationHash> dirty;
+  for (auto& edit : edits) {
+    if (chunk.get_voxel(edit.index) == edit.voxel)
+      continue;
+    chunk.set_voxel(edit.index, edit.voxel);
+    auto local = Chunk::flat_index_to_3d(edit.index);
+    tag_dirty_locs(dirty, loc, Int3D{local[0], local[1], local[2]});
+  }
+  for (auto& loc : dirty)
+    signal_chunk_update(loc);
+}
+
+void Region::forget_remote_edits(const Location& loc) {
+  remote_edits_.erase(loc);
+}
+
+void Region::forget_remote_edits(const Location2D& column) {
+  std::erase_if(remote_edits_, [&column](const auto& item) {
+    return item.first[0] == column[0] && item.first[2] == column[1];
+  });
+}
+
 bool Region::set_voxel_with_history(const Int3D& coord, Voxel voxel) {
   auto loc = Region::location_from_global_coord(coord);
   auto it = chunks_.find(loc);
@@ -420,37 +486,53 @@ bool Region::set_voxel_with_history(const Int3D& coord, Voxel voxel) {
   int idx = Chunk::get_index(local_coord);
   Voxel before = chunk.get_voxel(idx);
   chunk.set_voxel(idx, voxel);
-  update_history_.emplace(coord, before);
-  ++update_sizes_.top();
+  record_local_edit(loc, idx, voxel);
+  update_history_.emplace_back(coord, before);
+  ++update_sizes_.back();
+  MemoryBudget::instance()->add(MemoryCategory::undo_history, history_entry_bytes);
   return true;
 }
 
 void Region::start_counting_swaps() {
-  update_sizes_.emplace(0);
+  update_sizes_.emplace_back(0);
 }
 
 void Region::undo_last_update() {
   if (update_sizes_.size() == 0)
     return;
   std::unordered_set<Location, LocationHash> dirty;
-  int size = update_sizes_.top();
+  int size = update_sizes_.back();
   for (int i = 0; i < size; ++i) {
-    auto& swap = update_history_.top();
+    auto& swap = update_history_.back();
     auto loc = Region::location_from_global_coord(swap.coord);
     auto local_coord = Chunk::to_local(swap.coord);
     int idx = Chunk::get_index(local_coord);
     bool success = set_voxel_if_possible(loc, idx, swap.voxel);
-    if (success)
+    if (success) {
+      record_local_edit(loc, idx, swap.voxel);
       tag_dirty_locs(dirty, loc, local_coord);
-    update_history_.pop();
+    }
+    update_history_.pop_back();
   }
 
-  update_sizes_.pop();
+  update_sizes_.pop_back();
+  MemoryBudget::instance()->sub(MemoryCategory::undo_history, size * history_entry_bytes);
 
   for (auto& loc : dirty)
     signal_chunk_update(loc);
 }
 
+// Forget the oldest undoable update, returns false once there is nothing left to drop
+bool Region::trim_update_history() {
+  if (update_sizes_.size() <= 1)
+    return false;
+  int size = update_sizes_.front();
+  update_history_.erase(update_history_.begin(), update_history_.begin() + size);
+  update_sizes_.pop_front();
+  MemoryBudget::instance()->sub(MemoryCategory::undo_history, size * history_entry_bytes);
+  return true;
+}
+
 void Region::tag_dirty_locs(std::unordered_set<Location, LocationHash>& dirty, const Location& loc, const Int3D& local_coord) {
   dirty.insert(loc);
   if (local_coord[0] == 0) {
@@ -2,8 +2,10 @@
 #define REGION_H
 
 #include <functional>
+#include <map>
 #include <memory>
-#include <stack>
+#include <deque>
+#include <span>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -46,7 +48,18 @@ public:
   bool set_voxel_with_history(const Int3D& coord, Voxel voxel);
   void start_counting_swaps();
   void undo_last_update();
+  bool trim_update_history();
+  // every loaded chunk that isn't already on its way out, meshed or not
+  std::vector<Location> get_evictable_chunks() const;
+  void evict_chunk(const Location& loc);
   void signal_chunk_update(const Location& loc);
+  // voxels changed here since the last call, by chunk, for the server to pass on
+  std::unordered_map<Location, std::map<std::uint16_t, Voxel>, LocationHash> take_local_edits();
+  // edits made by other clients, held until the chunk is added if it isn't loaded
+  void apply_remote_edits(const Location& loc, std::span<const VoxelEdit> edits);
+  // drops held edits the server will send again when the chunk or section is asked for again
+  void forget_remote_edits(const Location& loc);
+  void forget_remote_edits(const Location2D& column);
   static void tag_dirty_locs(std::unordered_set<Location, LocationHash>& dirty, const Location& loc, const Int3D& local_coord);
 
   static std::vector<Int3D> raycast(const glm::dvec3& pos, const glm::dvec3& dir, int num_voxels = 12);
@@ -57,6 +70,9 @@ public:
     const glm::dvec3& pos, const glm::dvec3& dir, int max_tries, std::vector<Voxel>& voxels,
     const std::function<bool(Voxel v)>& kind_test) const;
 
+  // Meshed chunks are capped by the draw command buckets in TerrainGraphics, past that the furthest is
+  // deleted for each new one. Below it the memory budget evicts them furthest first with everything else.
+  // The buckets' gpu buffers are allocated up front and only grow, evicting frees a bucket not its bytes
   static int max_sz;
 
 private:
@@ -67,9 +83,12 @@ private:
 
   void chunk_to_mesh_generator(const Location& loc);
   void delete_furthest_chunk(const Location& loc);
+  void delete_sent_chunk(Location loc);
+  void erase_chunk(const Location& loc);
   std::array<Location, 6> get_adjacent_locations(const Location& loc) const;
   void update_adjacent_chunks(const Int3D& coord);
   bool set_voxel_if_possible(const Location& loc, int idx, Voxel voxel);
+  void record_local_edit(const Location& loc, int idx, Voxel voxel);
 
   std::unordered_map<Location, Chunk, LocationHash> chunks_;
   std::unordered_set<Location, LocationHash> chunks_sent_;
@@ -77,10 +96,10 @@ private:
   std::vector<Diff> diffs_;
   Player player_;
   std::unordered_set<Location, LocationHash> updated_since_reset_;
-  std::stack<CoordHistory> update_history_;
-  std::stack<int> update_sizes_;
-  // has to be at least as big as max_sz
-  static int max_sz_internal;
+  std::deque<CoordHistory> update_history_;
+  std::deque<int> update_sizes_;
+  std::unordered_map<Location, std::map<std::uint16_t, Voxel>, LocationHash> local_edits_;
+  std::unordered_map<Location, std::map<std::uint16_t, Voxel>, LocationHash> remote_edits_;
 };
 
 #endif // REGION_H
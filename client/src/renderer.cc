@@ -7,6 +7,8 @@
 #include <utility>
 #include <glm/ext.hpp>
 #include <glm/gtc/random.hpp>
+#include "chunk_tracer.h"
+#include "memory_budget.h"
 #include "options.h"
 #include "render_utils.h"
 #include "sim.h"
@@ -241,6 +243,7 @@ void Renderer::consume_mesh_generator(MeshGenerator& mesh_generator) {
     auto& loc = diff.location;
     if (diff.kind == MeshGenerator::Diff::creation) {
       terrain_.create(loc, mesh_generator);
+      ChunkTracer::instance()->chunk_uploaded(loc);
     } else if (diff.kind == MeshGenerator::Diff::deletion) {
       terrain_.destroy(loc);
     } else if (diff.kind == MeshGenerator::Diff::origin) {
@@ -268,6 +271,7 @@ void Renderer::consume_camera(const Camera& camera) {
 }
 
 void Renderer::render_scene() {
+  frame_arena_.reset();
   glEnable(GL_CULL_FACE);
   glEnable(GL_DEPTH_TEST);
   glEnable(GL_BLEND);
@@ -394,8 +398,7 @@ void Renderer::render(const DrawCommand& command) {
   for (auto& binding : command.texture_bindings)
     glBindTextureUnit(binding.unit, binding.id);
 
-  GLuint vao = vbo_to_vao_[command.vertex_buffer_id];
-  glBindVertexArray(vao);
+  glBindVertexArray(command.vertex_array_id);
 
   GLenum draw_mode;
   switch (command.primitive_type) {
@@ -447,6 +450,9 @@ std::uint32_t Renderer::register_scene_component(const SceneComponent& scene_com
   glBindBuffer(GL_ARRAY_BUFFER, vbo);
   auto& vertices = scene_component.get_vertices();
   glBufferData(GL_ARRAY_BUFFER, sizeof(std::uint8_t) * vertices.size(), vertices.data(), draw_type);
+  // components live as long as the renderer and upload_buffer_data only writes into what's here, so this is
+  // never given back
+  MemoryBudget::instance()->add(MemoryCategory::gpu_buffers, sizeof(std::uint8_t) * vertices.size());
 
   auto& indices = scene_component.get_indices();
   if (indices.size() > 0) {
@@ -455,6 +461,7 @@ std::uint32_t Renderer::register_scene_component(const SceneComponent& scene_com
     index_buffer_ids_[id] = ebo;
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indices.size(), indices.data(), draw_type);
+    MemoryBudget::instance()->add(MemoryCategory::gpu_buffers, sizeof(unsigned int) * indices.size());
   }
 
   auto& attributes = scene_component.get_vertex_attributes();
@@ -611,6 +618,8 @@ const Shader Renderer::get_shader(const std::string& name) const {
 
 GLuint Renderer::get_vertex_buffer_id(std::uint32_t component_id) { return vertex_buffer_ids_[component_id]; }
 GLuint Renderer::get_index_buffer_id(std::uint32_t component_id) { return index_buffer_ids_[component_id]; }
+GLuint Renderer::get_vertex_array_id(std::uint32_t component_id) { return vbo_to_vao_[vertex_buffer_ids_[component_id]]; }
+FrameArena& Renderer::get_frame_arena() { return frame_arena_; }
 GLint Renderer::get_uniform_id(const std::string& shader_name, const std::string& uniform_name) const {
   auto& shader = shaders_.at(shader_name);
   GLuint id = shader.get_id();
@@ -2,9 +2,11 @@
 #define RENDERER_H
 
 #include <array>
+#include <span>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include "camera.h"
+#include "frame_arena.h"
 #include "lod_mesh_generator.h"
 #include "mesh_generator.h"
 #include "region.h"
@@ -42,6 +44,7 @@ struct DrawCommand {
 
   int vertex_buffer_id;
   int index_buffer_id;
+  int vertex_array_id;
 
   int vertex_count;
   int index_count;
@@ -49,9 +52,10 @@ struct DrawCommand {
 
   PrimitiveType primitive_type;
 
-  std::vector<UniformBinding> uniforms;
-  std::vector<UniformBufferBinding> uniform_buffer_bindings;
-  std::vector<TextureBinding> texture_bindings;
+  // point into DrawGenerator's cached packets or the frame arena
+  std::span<const UniformBinding> uniforms;
+  std::span<const UniformBufferBinding> uniform_buffer_bindings;
+  std::span<const TextureBinding> texture_bindings;
 
   bool depth_test;
   bool blend;
@@ -92,9 +96,11 @@ public:
   const Shader get_shader(const std::string& name) const;
   GLuint get_vertex_buffer_id(std::uint32_t component_id);
   GLuint get_index_buffer_id(std::uint32_t component_id);
+  GLuint get_vertex_array_id(std::uint32_t component_id);
   GLint get_uniform_id(const std::string& shader_name, const std::string& uniform_name) const;
   const UniformValue& get_uniform_value(const std::string& uniform_name) const;
   void set_uniform_value(const std::string& uniform_name, const UniformValue& value);
+  FrameArena& get_frame_arena();
 
   static double aspect_ratio;
   static double fov;
@@ -112,6 +118,7 @@ private:
   std::unordered_map<std::uint32_t, GLuint> vertex_buffer_ids_;
   std::unordered_map<std::uint32_t, GLuint> index_buffer_ids_;
   std::unordered_map<GLuint, GLuint> vbo_to_vao_;
+  FrameArena frame_arena_{frame_arena_size};
   GLuint pingpong_primary_fbo_;
   GLuint pingpong_primary_cbo_;
   GLuint composite_shader_;
@@ -175,6 +182,7 @@ private:
   GLuint light_space_matrices_ubo_;
   static std::array<float, 3> cascade_far_planes;
 
+  static constexpr std::size_t frame_arena_size = 64 * 1024;
   std::uint32_t next_component_id_ = 0;
   unsigned int frame_ = 0;
 };
@@ -6,7 +6,11 @@ SceneComponent::SceneComponent() {}
 std::uint32_t SceneComponent::get_id() const { return id_; }
 void SceneComponent::set_id(std::uint32_t id) { id_ = id; }
 const Material& SceneComponent::get_material() const { return material_; }
-void SceneComponent::set_material(const Material& mat) { material_ = mat; }
+void SceneComponent::set_material(const Material& mat) {
+  material_ = mat;
+  ++material_version_;
+}
+std::uint32_t SceneComponent::get_material_version() const { return material_version_; }
 const glm::mat4& SceneComponent::get_model_transform() const { return model_transform_; }
 void SceneComponent::set_model_transform(const glm::mat4& transform) { model_transform_ = transform; }
 const std::vector<std::uint8_t>& SceneComponent::get_vertices() const { return vertices_; }
@@ -33,6 +33,8 @@ public:
 
   const Material& get_material() const;
   void set_material(const Material& mat);
+  // bumped by set_material, cached draw packets recompile when it changes
+  std::uint32_t get_material_version() const;
 
   const glm::mat4& get_model_transform() const;
   void set_model_transform(const glm::mat4& transform);
@@ -57,6 +59,7 @@ public:
 private:
   std::uint32_t id_;
   Material material_;
+  std::uint32_t material_version_ = 0;
   glm::mat4 model_transform_;
   unsigned int vertex_count_;
   std::vector<std::uint8_t> vertices_;
@@ -5,6 +5,7 @@
 #include <vector>
 #include "update_generated.h"
 #include "common.h"
+#include "memory_budget.h"
 #include "types.h"
 
 class Section {
@@ -14,6 +15,8 @@ public:
   static constexpr int sz = common::chunk_sz_x * common::chunk_sz_z;
 
   Section(const fbs_update::Section* section);
+  // landcover holds landcover_tiles_per_sector entries
+  Section(const Location2D& location, int elevation, const std::uint8_t* landcover);
   const Location2D& get_location() const;
   int get_elevation() const;
   const std::vector<common::LandCover>& get_landcover() const;
@@ -23,10 +26,13 @@ public:
   bool has_subsection_elevations() const;
   const std::vector<int>& get_subsection_elevations() const;
   int get_subsection_elevation(int x, int z) const;
+  // features are charged to the memory budget once set_features_loaded says they're all in
   void insert_into_features(int x, int y, int z, Voxel voxel);
   void set_features_loaded(bool loaded);
   bool is_features_loaded() const;
-  std::vector<std::pair<int,Voxel>>& get_features(const Location& location);
+  // empty if no feature reaches into the chunk at location
+  const std::vector<std::pair<int, Voxel>>& get_features(const Location& location) const;
+  std::int64_t get_memory_usage() const;
 
 private:
   Location2D location_;
@@ -38,6 +44,8 @@ private:
 
   std::unordered_map<Location, std::vector<std::pair<int, Voxel>>, LocationHash> features_;
   bool features_loaded_ = false;
+
+  MemoryCharge memory_charge_{MemoryCategory::sections};
 };
 
 #endif
@@ -0,0 +1,89 @@
+#include "section_prefetcher.h"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include "chunk.h"
+
+std::vector<Location2D> SectionPrefetcher::get_cone(const Location2D& column, const glm::dvec3& velocity, int window_distance) const {
+  std::vector<Location2D> cone;
+  // sections are a chunk column wide
+  auto heading = glm::dvec2(velocity.x / Chunk::sz_x, velocity.z / Chunk::sz_z);
+  double speed = glm::length(heading);
+  if (speed < min_speed)
+    return cone;
+  heading /= speed;
+
+  int look_ahead = std::min(max_look_ahead, static_cast<int>(std::ceil(speed * (round_trip_seconds_ + look_ahead_margin))));
+  int reach = window_distance + look_ahead;
+  double min_cos = std::cos(cone_half_angle);
+  for (int x = -reach; x <= reach; ++x) {
+    for (int z = -reach; z <= reach; ++z) {
+      if (x >= -window_distance && x < window_distance && z >= -window_distance && z < window_distance)
+        continue;
+      auto offset = glm::dvec2(x, z);
+      double distance = glm::length(offset);
+      if (distance > reach || glm::dot(offset / distance, heading) < min_cos)
+        continue;
+      cone.push_back(Location2D{column[0] + x, column[1] + z});
+    }
+  }
+  return cone;
+}
+
+void SectionPrefetcher::record_round_trip(std::int64_t us) {
+  round_trip_seconds_ += round_trip_smoothing * (us / 1e6 - round_trip_seconds_);
+}
+
+void SectionPrefetcher::prefetched(const Location2D& loc) {
+  if (outstanding_.try_emplace(loc).second)
+    ++num_prefetched_;
+}
+
+bool SectionPrefetcher::is_prefetched(const Location2D& loc) const {
+  return outstanding_.contains(loc);
+}
+
+void SectionPrefetcher::received(const Location2D& loc, std::size_t bytes) {
+  auto it = outstanding_.find(loc);
+  if (it == outstanding_.end())
+    return;
+  it->second.received = true;
+  it->second.bytes = bytes;
+  received_bytes_ += bytes;
+}
+
+void SectionPrefetcher::entered_window(const Location2D& loc) {
+  if (outstanding_.erase(loc))
+    ++hits_;
+}
+
+void SectionPrefetcher::dropped(const Location2D& loc) {
+  auto it = outstanding_.find(loc);
+  if (it == outstanding_.end())
+    return;
+  ++wasted_;
+  wasted_bytes_ += it->second.bytes;
+  outstanding_.erase(it);
+}
+
+std::string SectionPrefetcher::report() const {
+  std::stringstream stream;
+  auto settled = hits_ + wasted_;
+  stream << "prefetch: " << num_prefetched_ << " sections, " << hits_ << " hits, " << wasted_ << " wasted";
+  if (settled > 0)
+    stream << " (" << 100 * hits_ / settled << "% hit rate)";
+  stream << ", " << wasted_bytes_ << " of " << received_bytes_ << " bytes wasted, round trip "
+         << static_cast<int>(round_trip_seconds_ * 1000) << "ms" << std::endl;
+  return stream.str();
+}
+
+nlohmann::json SectionPrefetcher::to_json() const {
+  return {
+    {"prefetched", num_prefetched_},
+    {"outstanding", outstanding_.size()},
+    {"hits", hits_},
+    {"wasted", wasted_},
+    {"receivedBytes", received_bytes_},
+    {"wastedBytes", wasted_bytes_},
+    {"roundTripMs", round_trip_seconds_ * 1000}};
+}
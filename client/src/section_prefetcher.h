@@ -0,0 +1,56 @@
+#ifndef SECTION_PREFETCHER_H
+#define SECTION_PREFETCHER_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "glm/ext.hpp"
+#include "types.h"
+
+// Picks sections ahead of a moving player to ask for before they enter the streaming window. The cone
+// reaches as far past the window as the player travels in a round trip plus look_ahead_margin, and
+// tracks whether what it asked for was used so the look-ahead can be tuned
+class SectionPrefetcher {
+public:
+  // sections in the cone outside the window of half size window_distance around column
+  std::vector<Location2D> get_cone(const Location2D& column, const glm::dvec3& velocity, int window_distance) const;
+  // request to arrival of a section, smoothed
+  void record_round_trip(std::int64_t us);
+
+  // asked for only because it was in the cone
+  void prefetched(const Location2D& loc);
+  bool is_prefetched(const Location2D& loc) const;
+  void received(const Location2D& loc, std::size_t bytes);
+  // reached the window, the prefetch paid off
+  void entered_window(const Location2D& loc);
+  // dropped or evicted, wasted unless it already reached the window
+  void dropped(const Location2D& loc);
+
+  std::string report() const;
+  nlohmann::json to_json() const;
+
+  static constexpr double look_ahead_margin = 0.5;
+  static constexpr int max_look_ahead = 24;
+  // slower than this, in sections per second, and nothing is prefetched
+  static constexpr double min_speed = 0.5;
+  static constexpr double cone_half_angle = 0.5;
+  static constexpr double round_trip_smoothing = 0.1;
+
+private:
+  struct Prefetch {
+    bool received = false;
+    std::size_t bytes = 0;
+  };
+
+  std::unordered_map<Location2D, Prefetch, Location2DHash> outstanding_;
+  double round_trip_seconds_ = 0.25;
+  std::uint64_t num_prefetched_ = 0;
+  std::uint64_t hits_ = 0;
+  std::uint64_t wasted_ = 0;
+  std::uint64_t received_bytes_ = 0;
+  std::uint64_t wasted_bytes_ = 0;
+};
+
+#endif
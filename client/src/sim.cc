@@ -12,14 +12,19 @@
 #include "UserControllers/build_controller.h"
 #include "UserControllers/first_person_controller.h"
 #include "UserControllers/options_controller.h"
+#include "alloc_tracker.h"
 #include "chunk.h"
+#include "chunk_tracer.h"
 #include "common.h"
 #include "common_generated.h"
 #include "input.h"
 #include "item.h"
+#include "memory_budget.h"
+#include "options.h"
 #include "readerwriterqueue.h"
 #include "request_generated.h"
 #include "section.h"
+#include "section_batch.h"
 #include "update_generated.h"
 
 Sim::Sim(GLFWwindow* window, TCPClient& tcp_client)
@@ -63,10 +68,24 @@ Sim::Sim(GLFWwindow* window, TCPClient& tcp_client)
 
 void Sim::stream_chunks() {
   int num_new_chunks = 0;
-  auto stream_column = [this, &num_new_chunks](Location column) -> void {
+  auto done = [this, &num_new_chunks]() {
+    return num_new_chunks == max_chunks_to_stream_per_step || chunks_to_request_.size() == max_chunks_to_request_per_step;
+  };
+  auto stream_column = [this, &num_new_chunks, &done](Location column) -> void {
     for (int y = render_min_y_offset; y <= render_max_y_offset; ++y) {
       auto location = Location{column[0], column[1] + y, column[2]};
+      if (Options::server_chunks) {
+        if (region_.has_chunk(location) || requested_chunks_.contains(location))
+          continue;
+        // the server has every edit, so nothing comes from the local db
+        ChunkTracer::instance()->chunk_fill_started(location);
+        chunks_to_request_.push_back(location);
+        if (done())
+          return;
+        continue;
+      }
       if (!region_.has_chunk(location) && world_generator_.ready_to_fill(location, sections_)) {
+        ChunkTracer::instance()->chunk_fill_started(location);
         std::optional<Chunk> chunk;
         auto possible_chunk = db_manager_.load_chunk_if_exists(location);
 
@@ -76,6 +95,7 @@ void Sim::stream_chunks() {
           chunk.emplace(location[0], location[1], location[2]);
           world_generator_.fill_chunk(*chunk, sections_);
         }
+        ChunkTracer::instance()->chunk_fill_finished(location);
         region_.add_chunk(std::move(*chunk));
 
         if (++num_new_chunks == max_chunks_to_stream_per_step)
@@ -97,7 +117,7 @@ void Sim::stream_chunks() {
   for (int r = 0; r <= region_distance; ++r) {
     Location column = Location{loc[0] - r, loc[1], loc[2] - r};
     stream_column(column);
-    if (num_new_chunks == max_chunks_to_stream_per_step)
+    if (done())
       return;
     for (int i = 0; i < 3; ++i) {
       auto mods = column_modifiers[i];
@@ -105,14 +125,14 @@ void Sim::stream_chunks() {
         column[0] += mods.first;
         column[2] += mods.second;
         stream_column(column);
-        if (num_new_chunks == max_chunks_to_stream_per_step)
+        if (done())
           return;
       }
     }
     for (int moves = 0; moves < 2 * r - 1; ++moves) {
       --column[2];
       stream_column(column);
-      if (num_new_chunks == max_chunks_to_stream_per_step)
+      if (done())
         return;
     }
   }
@@ -120,74 +140,201 @@ void Sim::stream_chunks() {
 
 void Sim::step(std::int64_t ms) {
   bool new_sections = false;
+  // saved together once the queue is drained, one transaction a step rather than one a batch
+  std::vector<const Section*> received_sections;
   Message message;
   auto& q = tcp_client_.get_queue();
   bool success = q.try_dequeue(message);
   while (success) {
+    flatbuffers::Verifier verifier(message.data(), message.size());
+    if (!fbs_update::VerifyUpdateBuffer(verifier)) {
+      std::cerr << "dropping malformed update" << std::endl;
+      success = q.try_dequeue(message);
+      continue;
+    }
     auto* update = fbs_update::GetUpdate(message.data());
     switch (update->kind_type()) {
     case fbs_update::UpdateKind_Region: {
       new_sections = true;
-      auto* region = update->kind_as_Region();
-      auto* sections = region->sections();
+      auto* sections = update->kind_as_Region()->sections();
       for (int i = 0; i < sections->size(); ++i) {
         auto* section_update = sections->Get(i);
         auto* loc = section_update->location();
-        auto x = loc->x(), z = loc->y();
-        auto location = Location2D{x, z};
-        if (!sections_.contains(location)) {
-          sections_.insert({location, Section(section_update)});
-          requested_sections_.erase(location);
+        auto location = Location2D{loc->x(), loc->y()};
+        if (accept_section(location, message.size() / sections->size())) {
+          auto [it, _] = sections_.insert({location, Section(section_update)});
+          received_sections.push_back(&it->second);
         }
       }
-      if (sections_.size() > max_sections) {
-        std::vector<Location2D> section_locs;
-        section_locs.reserve(sections_.size());
-        for (auto& [location, _] : sections_)
-          section_locs.push_back(location);
-        auto& player = region_.get_player();
-        auto& pos = player.get_position();
-        auto loc = Chunk::pos_to_loc(pos);
-        auto player_location2d = Location2D{loc[0], loc[2]};
-        std::sort(
-          section_locs.begin(), section_locs.end(),
-          [&player_location2d](const Location2D l1, const Location2D l2) {
-            auto d1 = LocationMath::distance(l1, player_location2d);
-            auto d2 = LocationMath::distance(l2, player_location2d);
-            return d1 > d2;
-          });
-        int to_remove = sections_.size() - max_sections;
-        for (int i = 0; i < to_remove; ++i) {
-          auto& location = section_locs[i];
-          sections_.erase(location);
+    } break;
+    case fbs_update::UpdateKind_Sections: {
+      new_sections = true;
+      auto* batch = update->kind_as_Sections();
+      // they're still in requested_sections_, the retry asks for them again
+      if (auto* failed = batch->failed(); failed && failed->size() > 0 && !section_retry_at_)
+        section_retry_at_ = std::chrono::steady_clock::now() + section_retry_delay;
+      auto count = batch->count();
+      auto* origin = batch->origin();
+      if (count == 0 || !origin)
+        break;
+      auto* coords = batch->coords();
+      auto* elevations = batch->elevations();
+      auto* packed_landcover = batch->landcover();
+      // count is only trusted once it matches what was sent, it sizes everything below
+      if (!coords || !elevations || !packed_landcover || elevations->size() != count) {
+        std::cerr << "dropping malformed section batch" << std::endl;
+        break;
+      }
+      std::vector<std::int32_t> xs(count), zs(count);
+      std::vector<std::uint8_t> landcover(count * common::landcover_tiles_per_sector);
+      if (!common::decode_section_coords({coords->data(), coords->size()}, origin->x(), origin->y(), xs, zs) ||
+          !common::unpack_landcover({packed_landcover->data(), packed_landcover->size()}, landcover)) {
+        std::cerr << "dropping malformed section batch" << std::endl;
+        break;
+      }
+      for (std::uint32_t i = 0; i < count; ++i) {
+        auto location = Location2D{xs[i], zs[i]};
+        if (accept_section(location, message.size() / count)) {
+          auto section = Section(location, elevations->Get(i), &landcover[i * common::landcover_tiles_per_sector]);
+          auto [it, _] = sections_.insert({location, std::move(section)});
+          received_sections.push_back(&it->second);
         }
       }
     } break;
+    case fbs_update::UpdateKind_Chunks: {
+      auto* chunks = update->kind_as_Chunks()->chunks();
+      if (!chunks)
+        break;
+      for (int i = 0; i < chunks->size(); ++i) {
+        auto* chunk_update = chunks->Get(i);
+        auto* loc = chunk_update->location();
+        if (!loc)
+          continue;
+        auto location = Location{loc->x(), loc->y(), loc->z()};
+        // a chunk without runs failed on the server, it's asked for again next time it's streamed
+        requested_chunks_.erase(location);
+        if (region_.has_chunk(location))
+          continue;
+        if (!chunk_update->runs()) {
+          ChunkTracer::instance()->forget_chunk(location);
+          continue;
+        }
+        auto* runs = chunk_update->runs();
+        auto chunk = Chunk::from_runs(location, reinterpret_cast<const unsigned char*>(runs->data()), runs->size() * sizeof(std::uint32_t));
+        if (!chunk) {
+          // like a failed chunk, it's asked for again next time it's streamed
+          std::cerr << "dropping malformed chunk " << location[0] << " " << location[1] << " " << location[2] << std::endl;
+          ChunkTracer::instance()->forget_chunk(location);
+          continue;
+        }
+        ChunkTracer::instance()->chunk_fill_finished(location);
+        region_.add_chunk(std::move(*chunk));
+      }
+    } break;
+    case fbs_update::UpdateKind_Edits: {
+      auto* chunks = update->kind_as_Edits()->chunks();
+      if (!chunks)
+        break;
+      std::vector<VoxelEdit> edits;
+      for (int i = 0; i < chunks->size(); ++i) {
+        auto* chunk_edits = chunks->Get(i);
+        auto* loc = chunk_edits->location();
+        auto* voxel_edits = chunk_edits->edits();
+        if (!loc || !voxel_edits)
+          continue;
+        edits.clear();
+        for (int j = 0; j < voxel_edits->size(); ++j) {
+          auto* edit = voxel_edits->Get(j);
+          if (edit->index() < Chunk::sz && edit->voxel() < static_cast<std::uint8_t>(Voxel::voxel_enum_size))
+            edits.push_back(VoxelEdit{edit->index(), static_cast<Voxel>(edit->voxel())});
+        }
+        region_.apply_remote_edits(Location{loc->x(), loc->y(), loc->z()}, edits);
+      }
+    } break;
     }
     success = q.try_dequeue(message);
   }
+  db_manager_.save_sections(received_sections);
 
   auto& player = region_.get_player();
   auto& pos = player.get_position();
   auto loc = Chunk::pos_to_loc(pos);
   auto& last_location = player.get_last_location();
-  if (loc != last_location) {
+  player.sample_position(std::chrono::steady_clock::now());
+  // with server chunks nothing here needs sections
+  if (loc != last_location && !Options::server_chunks) {
+    auto cone = section_prefetcher_.get_cone(Location2D{loc[0], loc[2]}, player.get_velocity(), section_distance);
+    std::unordered_set<Location2D, Location2DHash> in_cone(cone.begin(), cone.end());
+    auto in_window = [&loc](const Location2D& location) {
+      return location[0] >= loc[0] - section_distance && location[0] < loc[0] + section_distance &&
+             location[1] >= loc[2] - section_distance && location[1] < loc[2] + section_distance;
+    };
+    std::erase_if(requested_sections_, [this, &in_window, &in_cone](const auto& item) {
+      auto& location = item.first;
+      if (in_window(location) || in_cone.contains(location))
+        return false;
+      ChunkTracer::instance()->forget_section(location);
+      section_prefetcher_.dropped(location);
+      released_sections_.push_back(location);
+      region_.forget_remote_edits(location);
+      return true;
+    });
+    // sections still in flight are asked for again, the new request cancels what's left of the old one
     std::vector<Location2D> locs;
     for (int x = -section_distance; x < section_distance; ++x) {
       for (int z = -section_distance; z < section_distance; ++z) {
         auto location = Location2D{loc[0] + x, loc[2] + z};
-        if (!(sections_.contains(location) || requested_sections_.contains(location)))
+        section_prefetcher_.entered_window(location);
+        if (!sections_.contains(location))
           locs.push_back(location);
       }
     }
+    for (auto& location : cone) {
+      if (!sections_.contains(location))
+        locs.push_back(location);
+    }
+    // sections from an earlier run are used straight away, the server only needs to know they're held.
+    // Anything in flight was already looked for
+    std::vector<Location2D> uncached;
+    for (auto& location : locs) {
+      if (!requested_sections_.contains(location))
+        uncached.push_back(location);
+    }
+    std::vector<Section> cached;
+    db_manager_.load_sections(uncached, cached);
+    std::vector<Location2D> held;
+    held.reserve(cached.size());
+    for (auto& section : cached) {
+      auto location = section.get_location();
+      held.push_back(location);
+      sections_.insert({location, std::move(section)});
+    }
+    std::erase_if(locs, [this](const Location2D& location) { return sections_.contains(location); });
+    for (auto& location : locs) {
+      if (!in_window(location))
+        section_prefetcher_.prefetched(location);
+    }
+    if (locs.size() > 0 || held.size() > 0)
+      request_sections(locs, held);
+  } else if (section_retry_at_ && std::chrono::steady_clock::now() >= *section_retry_at_) {
+    section_retry_at_.reset();
+    std::vector<Location2D> locs;
+    for (auto& [location, _] : requested_sections_) {
+      if (!sections_.contains(location))
+        locs.push_back(location);
+    }
     if (locs.size() > 0)
-      request_sections(locs);
+      request_sections(locs, {});
   }
   stream_chunks();
+  if (!chunks_to_request_.empty())
+    request_chunks();
+  send_edits();
   player.set_last_location(loc);
 
   auto process_inputs = [this](auto& event_queue, InputEvent::Kind input_event_kind) {
     using EventType = typename std::remove_reference<decltype(event_queue)>::type::value_type;
+    ALLOC_SCOPE(AllocSubsystem::input, "Sim::process_inputs");
     EventType event;
     bool success = event_queue.try_dequeue(event);
     while (success) {
@@ -288,6 +435,23 @@ void Sim::step(std::int64_t ms) {
     ready_to_mesh_ = false;
   }
 
+  enforce_memory_budget();
+  if (step_ % profiler_update_interval == 0) {
+    cefmsg::ProfilerUpdate(
+      {{"memory", MemoryBudget::instance()->to_json()},
+       {"chunkLatency", ChunkTracer::instance()->to_json()},
+       {"prefetch", section_prefetcher_.to_json()}});
+  }
+  if (Options::trace_report && step_ > 0 && step_ % chunk_trace_report_interval == 0) {
+    std::cout << ChunkTracer::instance()->report();
+    std::cout << section_prefetcher_.report();
+  }
+  if constexpr (alloc_tracker::enabled()) {
+    alloc_tracker::end_frame();
+    if (step_ > 0 && step_ % alloc_report_interval == 0)
+      std::cout << alloc_tracker::report();
+  }
+
   auto& updated_since_reset = region_.get_updated_since_reset();
   for (auto& loc : updated_since_reset) {
     if (!region_.has_chunk(loc))
@@ -300,27 +464,176 @@ void Sim::step(std::int64_t ms) {
   ++step_;
 }
 
-void Sim::request_sections(std::vector<Location2D>& locs) {
+// Evicts furthest-first across the chunk and section caches until usage is back under the budget.
+// Anything inside the streaming/request window is kept, otherwise it would just be loaded again next step.
+// Meshed chunks go too, which frees their draw command but not gpu bytes, see Region::max_sz
+void Sim::enforce_memory_budget() {
+  auto* memory_budget = MemoryBudget::instance();
+  if (!memory_budget->over_budget())
+    return;
+
+  auto loc = Chunk::pos_to_loc(region_.get_player().get_position());
+  auto player_location2d = Location2D{loc[0], loc[2]};
+  auto column_distance = [&player_location2d](int x, int z) {
+    return std::max(std::abs(x - player_location2d[0]), std::abs(z - player_location2d[1]));
+  };
+
+  std::vector<std::pair<double, Location>> chunk_candidates;
+  for (auto& location : region_.get_evictable_chunks()) {
+    if (column_distance(location[0], location[2]) > region_distance)
+      chunk_candidates.emplace_back(LocationMath::distance(Location2D{location[0], location[2]}, player_location2d), location);
+  }
+  std::vector<std::pair<double, Location2D>> section_candidates;
+  for (auto& [location, _] : sections_) {
+    if (column_distance(location[0], location[1]) > section_distance)
+      section_candidates.emplace_back(LocationMath::distance(location, player_location2d), location);
+  }
+  auto furthest_first = [](const auto& a, const auto& b) { return a.first > b.first; };
+  std::sort(chunk_candidates.begin(), chunk_candidates.end(), furthest_first);
+  std::sort(section_candidates.begin(), section_candidates.end(), furthest_first);
+
+  std::size_t i = 0, j = 0;
+  while (memory_budget->over_budget() && (i < chunk_candidates.size() || j < section_candidates.size())) {
+    bool evict_chunk =
+      j == section_candidates.size() ||
+      (i < chunk_candidates.size() && chunk_candidates[i].first >= section_candidates[j].first);
+    if (evict_chunk) {
+      auto& location = chunk_candidates[i++].second;
+      region_.evict_chunk(location);
+      if (Options::server_chunks) {
+        released_chunks_.push_back(location);
+        region_.forget_remote_edits(location);
+      }
+    } else {
+      auto& location = section_candidates[j++].second;
+      released_sections_.push_back(location);
+      region_.forget_remote_edits(location);
+      section_prefetcher_.dropped(location);
+      sections_.erase(location);
+      ChunkTracer::instance()->forget_section(location);
+    }
+  }
+
+  while (memory_budget->over_budget() && region_.trim_update_history())
+    ;
+}
+
+bool Sim::accept_section(const Location2D& location, std::size_t bytes) {
+  // sections left behind since they were asked for were released, they'd go unreplicated
+  auto requested = requested_sections_.find(location);
+  if (sections_.contains(location) || requested == requested_sections_.end())
+    return false;
+  auto round_trip = std::chrono::steady_clock::now() - requested->second;
+  section_prefetcher_.record_round_trip(std::chrono::duration_cast<std::chrono::microseconds>(round_trip).count());
+  section_prefetcher_.received(location, bytes);
+  requested_sections_.erase(requested);
+  ChunkTracer::instance()->section_received(location);
+  return true;
+}
+
+void Sim::request_sections(std::vector<Location2D>& locs, const std::vector<Location2D>& held) {
+  ALLOC_SCOPE(AllocSubsystem::networking, "Sim::request_sections");
+  section_retry_at_.reset();
   flatbuffers::FlatBufferBuilder builder(common::max_msg_buffer_size);
 
-  std::vector<fbs_common::Location2D> locations;
+  auto player_loc = Chunk::pos_to_loc(region_.get_player().get_position());
+  auto& front = get_camera().get_front();
+  auto forward = glm::dvec2(front.x, front.z);
+  if (glm::length(forward) > 0)
+    forward = glm::normalize(forward);
 
+  std::vector<std::pair<std::uint16_t, Location2D>> prioritised;
+  prioritised.reserve(locs.size());
   for (auto& loc : locs) {
-    fbs_common::Location2D location(loc[0], loc[1]);
-    locations.push_back(location);
-    requested_sections_.insert(loc);
+    auto offset = glm::dvec2(loc[0] - player_loc[0], loc[1] - player_loc[2]);
+    double distance = glm::length(offset);
+    // 1 straight ahead up to 3 straight behind
+    double facing = distance > 0 ? 2 - glm::dot(offset / distance, forward) : 1;
+    auto priority = std::min<double>(distance * facing * section_priority_scale, std::numeric_limits<std::uint16_t>::max() - 1);
+    prioritised.emplace_back(static_cast<std::uint16_t>(priority), loc);
+  }
+  std::sort(prioritised.begin(), prioritised.end());
+
+  std::vector<fbs_common::Location2D> locations;
+  std::vector<std::uint16_t> priorities;
+  locations.reserve(prioritised.size());
+  priorities.reserve(prioritised.size());
+  for (auto& [priority, loc] : prioritised) {
+    locations.push_back(fbs_common::Location2D(loc[0], loc[1]));
+    priorities.push_back(priority);
+    if (requested_sections_.try_emplace(loc, std::chrono::steady_clock::now()).second)
+      ChunkTracer::instance()->section_requested(loc);
   }
+  std::vector<fbs_common::Location2D> held_locations;
+  held_locations.reserve(held.size());
+  for (auto& loc : held)
+    held_locations.push_back(fbs_common::Location2D(loc[0], loc[1]));
   auto sections = builder.CreateVectorOfStructs(locations);
-  auto request = fbs_request::CreateRequest(builder, sections);
+  auto priorities_vector = builder.CreateVector(priorities);
+  auto held_sections = builder.CreateVectorOfStructs(held_locations);
+  auto request = fbs_request::CreateRequest(builder, sections, 0, 0, 0, 0, priorities_vector, ++section_epoch_, held_sections);
   fbs_request::FinishSizePrefixedRequestBuffer(builder, request);
 
   const auto* buffer_pointer = builder.GetBufferPointer();
   const auto buffer_size = builder.GetSize();
 
-  Message message(buffer_size);
+  auto message = common::MessagePool::instance()->acquire(buffer_pointer, buffer_size);
+  tcp_client_.write(message);
+}
+
+void Sim::request_chunks() {
+  ALLOC_SCOPE(AllocSubsystem::networking, "Sim::request_chunks");
+  flatbuffers::FlatBufferBuilder builder(common::max_msg_buffer_size);
+
+  std::vector<fbs_common::Location> locations;
+  locations.reserve(chunks_to_request_.size());
+  for (auto& loc : chunks_to_request_) {
+    locations.push_back(fbs_common::Location(loc[0], loc[1], loc[2]));
+    requested_chunks_.insert(loc);
+  }
+  chunks_to_request_.clear();
+  auto chunks = builder.CreateVectorOfStructs(locations);
+  auto request = fbs_request::CreateRequest(builder, 0, chunks);
+  fbs_request::FinishSizePrefixedRequestBuffer(builder, request);
 
-  std::memcpy(message.data(), buffer_pointer, buffer_size);
+  auto message = common::MessagePool::instance()->acquire(builder.GetBufferPointer(), builder.GetSize());
+  tcp_client_.write(message);
+}
+
+void Sim::send_edits() {
+  auto local_edits = region_.take_local_edits();
+  if (local_edits.empty() && released_sections_.empty() && released_chunks_.empty())
+    return;
+  ALLOC_SCOPE(AllocSubsystem::networking, "Sim::send_edits");
+  flatbuffers::FlatBufferBuilder builder(common::max_msg_buffer_size);
+
+  std::vector<flatbuffers::Offset<fbs_common::ChunkEdits>> chunk_edits;
+  std::vector<fbs_common::VoxelEdit> voxel_edits;
+  for (auto& [loc, edits] : local_edits) {
+    voxel_edits.clear();
+    for (auto& [idx, voxel] : edits)
+      voxel_edits.push_back(fbs_common::VoxelEdit(idx, static_cast<std::uint8_t>(voxel)));
+    fbs_common::Location location(loc[0], loc[1], loc[2]);
+    auto edits_vector = builder.CreateVectorOfStructs(voxel_edits);
+    chunk_edits.push_back(fbs_common::CreateChunkEdits(builder, &location, edits_vector));
+  }
+  std::vector<fbs_common::Location2D> released_sections;
+  for (auto& loc : released_sections_)
+    released_sections.push_back(fbs_common::Location2D(loc[0], loc[1]));
+  std::vector<fbs_common::Location> released_chunks;
+  for (auto& loc : released_chunks_)
+    released_chunks.push_back(fbs_common::Location(loc[0], loc[1], loc[2]));
+  released_sections_.clear();
+  released_chunks_.clear();
+
+  auto request = fbs_request::CreateRequest(
+    builder, 0, 0,
+    builder.CreateVector(chunk_edits),
+    builder.CreateVectorOfStructs(released_sections),
+    builder.CreateVectorOfStructs(released_chunks));
+  fbs_request::FinishSizePrefixedRequestBuffer(builder, request);
 
+  auto message = common::MessagePool::instance()->acquire(builder.GetBufferPointer(), builder.GetSize());
   tcp_client_.write(message);
 }
 
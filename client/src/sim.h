@@ -4,6 +4,7 @@
 #include <chrono>
 #include <condition_variable>
 #include <mutex>
+#include <optional>
 #include <unordered_set>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -19,6 +20,7 @@
 #include "readerwriterqueue.h"
 #include "region.h"
 #include "renderer.h"
+#include "section_prefetcher.h"
 #include "tcp_client.h"
 #include "ui.h"
 #include "UserControllers/user_controller.h"
@@ -77,13 +79,29 @@ public:
   static constexpr int render_max_y_offset = 2;
   static constexpr int region_distance = 4;
   static constexpr int section_distance = region_distance + 3;
-  static constexpr int max_sections = 2 * 4 * section_distance * section_distance;
+  // section priority steps per section of distance
+  static constexpr double section_priority_scale = 16;
+  // how long after the server fails on sections they're asked for again
+  static constexpr auto section_retry_delay = std::chrono::seconds(1);
   static constexpr int frame_rate_target = 60;
   static constexpr int max_chunks_to_stream_per_step = 5;
+  static constexpr std::size_t max_chunks_to_request_per_step = 64;
+  static constexpr int profiler_update_interval = frame_rate_target;
+  static constexpr int chunk_trace_report_interval = 30 * frame_rate_target;
+  static constexpr int alloc_report_interval = 5 * frame_rate_target;
 
 private:
-  void request_sections(std::vector<Location2D>& locs);
+  // bookkeeping for a section the server sent, false if it's no longer wanted
+  bool accept_section(const Location2D& location, std::size_t bytes);
+  // nearest first and ahead of the camera before behind it, under a new epoch. held were read from the
+  // db, the server is only told about them so their edits are sent
+  void request_sections(std::vector<Location2D>& locs, const std::vector<Location2D>& held);
+  // sends chunks_to_request_ to the server
+  void request_chunks();
+  // sends the player's edits since the last step and anything released, if there is any
+  void send_edits();
   void stream_chunks();
+  void enforce_memory_budget();
 
   GLFWwindow* window_;
   TCPClient& tcp_client_;
@@ -108,8 +126,19 @@ private:
   std::condition_variable cv_;
   bool ready_to_mesh_ = true;
 
-  std::unordered_set<Location2D, Location2DHash> requested_sections_;
+  // when each was first asked for
+  std::unordered_map<Location2D, std::chrono::steady_clock::time_point, Location2DHash> requested_sections_;
   std::unordered_map<Location2D, Section, Location2DHash> sections_;
+  // every section request supersedes the last, the server drops what it hasn't started of older ones
+  std::uint64_t section_epoch_ = 0;
+  // set when the server failed on some sections, every request re-sends what's in flight so any request clears it
+  std::optional<std::chrono::steady_clock::time_point> section_retry_at_;
+  SectionPrefetcher section_prefetcher_;
+  std::unordered_set<Location, LocationHash> requested_chunks_;
+  std::vector<Location> chunks_to_request_;
+  // evicted since the last step, the server stops sending edits to them
+  std::vector<Location2D> released_sections_;
+  std::vector<Location> released_chunks_;
   Int3D ray_collision_;
   moodycamel::ReaderWriterQueue<WindowEvent> window_events_;
   bool player_controlled_ = true;
@@ -1,31 +1,122 @@
 #include "tcp_client.h"
+#include "compression.h"
+#include "handshake_generated.h"
+#include "options.h"
 
 TCPClient::TCPClient(asio::io_context& io_context)
-    : io_context_{io_context}, socket_{io_context} {
+    : io_context_{io_context}, socket_{io_context}, write_queue_(write_queue_soft_limit, write_queue_hard_limit) {
   tcp::resolver resolver(io_context_);
   auto* host = "127.0.0.1";
   auto endpoints = resolver.resolve(host, "7331");
   asio::connect(socket_, endpoints);
+  if (Options::shared_memory || Options::compression)
+    handshake();
   handle_connect(asio::error_code());
 }
 
+void TCPClient::handshake() {
+  std::unique_ptr<common::ShmChannel> channel;
+  if (Options::shared_memory)
+    channel = common::ShmChannel::create(common::ShmChannel::default_ring_size);
+  if (!channel && !Options::compression)
+    return;
+  flatbuffers::FlatBufferBuilder builder(256);
+  flatbuffers::Offset<flatbuffers::String> shm_name;
+  if (channel)
+    shm_name = builder.CreateString(channel->get_name());
+  auto codec = Options::compression ? fbs_handshake::Codec_Lz : fbs_handshake::Codec_None;
+  auto hello = fbs_handshake::CreateHello(builder, shm_name, codec);
+  auto handshake = fbs_handshake::CreateHandshake(builder, fbs_handshake::HandshakeKind_Hello, hello.Union());
+  fbs_handshake::FinishSizePrefixedHandshakeBuffer(builder, handshake);
+  asio::write(socket_, asio::buffer(builder.GetBufferPointer(), builder.GetSize()));
+
+  // nothing else is sent before the Welcome
+  asio::read(socket_, asio::buffer(header_buffer_));
+  auto header = common::decode_frame_header(header_buffer_.data());
+  if (header.length > common::max_message_size)
+    throw std::runtime_error("bad handshake frame");
+  std::vector<std::uint8_t> body(header.length);
+  asio::read(socket_, asio::buffer(body));
+  flatbuffers::Verifier verifier(body.data(), body.size());
+  if (!fbs_handshake::VerifyHandshakeBuffer(verifier))
+    throw std::runtime_error("bad handshake reply");
+  auto* welcome = fbs_handshake::GetHandshake(body.data())->kind_as_Welcome();
+  if (welcome && welcome->codec() == fbs_handshake::Codec_Lz) {
+    std::cout << "compressing frames over " << common::compression_threshold << " bytes" << std::endl;
+    compress_ = true;
+  }
+  if (!channel)
+    return;
+  if (!welcome || !welcome->shm()) {
+    std::cout << "server couldn't map " << channel->get_name() << ", staying on TCP" << std::endl;
+    return;
+  }
+
+  std::cout << "using shared memory " << channel->get_name() << std::endl;
+  shm_ = std::make_unique<common::ShmConnection>(
+    std::move(channel),
+    write_queue_hard_limit,
+    [this](Message body) { q_.enqueue(std::move(body)); },
+    [] { std::cerr << "shared memory connection closed" << std::endl; });
+  shm_->start();
+}
+
 void TCPClient::write(const Message& message) {
+  if (shm_) {
+    shm_->write(message);
+    return;
+  }
+  // called from the sim thread, the queue and socket are only touched on the io thread
+  auto frame = compress_ ? common::compress_frame(message) : message;
+  asio::post(io_context_, boost::bind(&TCPClient::queue_write, this, std::move(frame)));
+}
+
+void TCPClient::queue_write(const Message& message) {
+  if (!socket_.is_open())
+    return;
+  bool idle = write_queue_.push(message);
+  if (write_queue_.over_hard_limit()) {
+    std::cerr << "closing connection, " << write_queue_.get_queued_bytes() << " bytes queued" << std::endl;
+    socket_.close();
+    return;
+  }
+  if (idle)
+    start_write();
+}
+
+void TCPClient::start_write() {
+  auto& batch = write_queue_.start_batch();
+  write_buffers_.clear();
+  for (auto& message : batch)
+    write_buffers_.push_back(asio::buffer(message.data(), message.size()));
   asio::async_write(
     socket_,
-    asio::buffer(message.data(), message.size()),
-    boost::bind(&TCPClient::handle_write, this));
+    write_buffers_,
+    boost::bind(&TCPClient::handle_write, this, asio::placeholders::error));
 }
 
-void TCPClient::handle_write() {}
+void TCPClient::handle_write(const asio::error_code& error) {
+  if (error) {
+    std::cerr << "write failed: " << error.message() << std::endl;
+    write_queue_.clear();
+    return;
+  }
+  if (write_queue_.finish_batch())
+    start_write();
+}
 
 void TCPClient::handle_connect(const asio::error_code& error) {
   if (error)
     throw std::runtime_error(error.message());
   std::cout << "connection established" << std::endl;
 
+  read_header();
+}
+
+void TCPClient::read_header() {
   asio::async_read(
     socket_,
-    asio::buffer(read_buffer_, header_length),
+    asio::buffer(header_buffer_),
     boost::bind(
       &TCPClient::handle_read_header, this,
       asio::placeholders::error));
@@ -36,27 +127,44 @@ moodycamel::ReaderWriterQueue<Message>& TCPClient::get_queue() {
 }
 
 void TCPClient::handle_read_header(const asio::error_code& error) {
-  std::uint32_t body_length;
-  std::memcpy(&body_length, read_buffer_.data(), sizeof(body_length));
+  if (error) {
+    std::cerr << "read failed: " << error.message() << std::endl;
+    if (shm_)
+      shm_->close();
+    return;
+  }
+  auto header = common::decode_frame_header(header_buffer_.data());
+  if (header.length > common::max_message_size) {
+    std::cerr << "dropping connection, bad frame of " << header.length << " bytes" << std::endl;
+    socket_.close();
+    return;
+  }
+  body_buffer_ = common::MessagePool::instance()->acquire(header.length);
+  body_flags_ = header.flags;
 
   asio::async_read(
     socket_,
-    asio::buffer(read_buffer_, body_length),
+    asio::buffer(body_buffer_.data(), body_buffer_.size()),
     boost::bind(
       &TCPClient::handle_read_body, this,
-      asio::placeholders::error, body_length));
+      asio::placeholders::error));
 }
 
-void TCPClient::handle_read_body(const asio::error_code& error, std::uint32_t body_length) {
+void TCPClient::handle_read_body(const asio::error_code& error) {
+  if (error) {
+    std::cerr << "read failed: " << error.message() << std::endl;
+    return;
+  }
+  if (!common::decompress_body(body_flags_, body_buffer_)) {
+    std::cerr << "dropping connection, corrupt compressed frame" << std::endl;
+    socket_.close();
+    return;
+  }
+  // with shared memory the reader thread is the queue's only producer
+  if (shm_)
+    std::cerr << "ignoring " << body_buffer_.size() << " bytes sent over TCP" << std::endl;
+  else
+    q_.enqueue(std::move(body_buffer_));
 
-  Message message(body_length);
-  std::memcpy(message.data(), read_buffer_.data(), body_length);
-  q_.enqueue(std::move(message));
-
-  asio::async_read(
-    socket_,
-    asio::buffer(read_buffer_, header_length),
-    boost::bind(
-      &TCPClient::handle_read_header, this,
-      asio::placeholders::error));
+  read_header();
 }
@@ -5,10 +5,13 @@
 #endif
 #include "common.h"
 #include <array>
+#include <memory>
 #include <asio.hpp>
 #include <boost/bind/bind.hpp>
 #include "readerwriterqueue.h"
+#include "shm_transport.h"
 #include "types.h"
+#include "write_queue.h"
 
 using asio::ip::tcp;
 
@@ -20,16 +23,33 @@ public:
   moodycamel::ReaderWriterQueue<Message>& get_queue();
 
 private:
+  // sends a Hello offering a shared memory segment and compression, whichever Options allow, and
+  // blocks for the Welcome. Sets up whatever the server took
+  void handshake();
   void handle_connect(const asio::error_code& error);
   void handle_read_header(const asio::error_code& error);
-  void handle_read_body(const asio::error_code& error, std::uint32_t body_length);
-  void handle_write();
+  void handle_read_body(const asio::error_code& error);
+  void queue_write(const Message& message);
+  void start_write();
+  void handle_write(const asio::error_code& error);
+  void read_header();
 
   asio::io_context& io_context_;
   tcp::socket socket_;
-  std::array<std::uint8_t, common::max_msg_buffer_size> read_buffer_;
-  static constexpr int header_length = 4;
+  std::array<std::uint8_t, common::frame_header_length> header_buffer_;
+  // bodies are read straight into a pooled buffer which is then handed to the sim
+  Message body_buffer_;
+  std::uint8_t body_flags_ = 0;
+  // io thread only
+  common::WriteQueue write_queue_;
+  std::vector<asio::const_buffer> write_buffers_;
+  static constexpr std::size_t write_queue_soft_limit = 1024 * 1024;
+  static constexpr std::size_t write_queue_hard_limit = 2 * common::max_message_size;
   moodycamel::ReaderWriterQueue<Message> q_;
+  // once set the socket is only read to notice the server going away
+  std::unique_ptr<common::ShmConnection> shm_;
+  // set before the io thread starts, frames over compression_threshold go out compressed
+  bool compress_ = false;
 };
 
 #endif
\ No newline at end of file
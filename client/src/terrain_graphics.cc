@@ -3,6 +3,7 @@
 #include <type_traits>
 #include <GLFW/glfw3.h>
 #include "lod_loader.h"
+#include "memory_budget.h"
 #include "mesh_generator.h"
 #include "options.h"
 #include "region.h"
@@ -86,6 +87,10 @@ void TerrainGraphics::set_up() {
 
   glCreateBuffers(1, &mdh.loc_ssbo);
   glNamedBufferStorage(mdh.loc_ssbo, sizeof(glm::vec4) * mdh.commands.size(), nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+  MemoryBudget::instance()->add(
+    MemoryCategory::gpu_buffers,
+    mdh.vbo_size + (sizeof(DrawArraysIndirectCommand) + sizeof(glm::vec4)) * mdh.commands.size());
 }
 
 TerrainGraphics::TerrainGraphics() {
@@ -157,7 +162,12 @@ void TerrainGraphics::upload(
   if (mdh.loc_to_command_index.contains(loc)) {
     idx = mdh.loc_to_command_index[loc];
   } else {
-    idx = mdh.first_unoccupied++;
+    if (mdh.free_commands.empty()) {
+      idx = mdh.first_unoccupied++;
+    } else {
+      idx = mdh.free_commands.back();
+      mdh.free_commands.pop_back();
+    }
     auto& metadata = mdh.commands_metadata[idx];
 
     float loc_x = (loc[0] - origin_[0]) * Chunk::sz_x;
@@ -208,8 +218,11 @@ void TerrainGraphics::upload(
         mdh.vbo_size - metadata.buffer_size - pre_size);
     }
 
+    // the old buffer is gone, so its size comes off before the new one's goes on
+    MemoryBudget::instance()->sub(MemoryCategory::gpu_buffers, mdh.vbo_size);
     mdh.vbo_size += added_size;
     metadata.buffer_size += added_size;
+    MemoryBudget::instance()->add(MemoryCategory::gpu_buffers, mdh.vbo_size);
 
     // Shift the first index of every command following this one
     for (int i = idx + 1; i < mdh.commands.size(); ++i) {
@@ -241,15 +254,19 @@ void TerrainGraphics::upload(
   mdh.loc_to_command_index[loc] = idx;
 }
 
+// the memory budget can evict several chunks in a frame, so any number of commands can be free at once
 void TerrainGraphics::remove(const Location& loc, MultiDrawHandle& mdh) {
-  auto idx = mdh.loc_to_command_index[loc];
+  auto it = mdh.loc_to_command_index.find(loc);
+  if (it == mdh.loc_to_command_index.end())
+    return;
+  auto idx = it->second;
   auto& command = mdh.commands[idx];
   auto& metadata = mdh.commands_metadata[idx];
   command.count = 0;
   glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mdh.ibo);
   glBufferSubData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawArraysIndirectCommand) * idx, sizeof(DrawArraysIndirectCommand), &command);
-  mdh.loc_to_command_index.erase(loc);
-  mdh.first_unoccupied = idx;
+  mdh.loc_to_command_index.erase(it);
+  mdh.free_commands.push_back(idx);
 }
 
 void TerrainGraphics::destroy(const Location& loc) {
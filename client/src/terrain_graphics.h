@@ -59,7 +59,9 @@ private:
     std::vector<CommandMetadata> commands_metadata;
     unsigned int vbo_size = 0;
     std::unordered_map<Location, std::size_t, LocationHash> loc_to_command_index;
+    // commands never handed out start here, removed ones are reused first
     std::size_t first_unoccupied = 0;
+    std::vector<std::size_t> free_commands;
     GLuint loc_ssbo;
   };
 
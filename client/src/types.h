@@ -14,6 +14,7 @@
 #include <glm/glm.hpp>
 #include "common.h"
 #include "item.h"
+#include "message_buffer.h"
 
 enum Direction {
   nx,
@@ -197,6 +198,7 @@ namespace QuadCoord {
   constexpr glm::vec2 tr = glm::vec2(1.f, 1.f);
 } // namespace QuadCoord
 
-using Message = std::vector<std::uint8_t>;
+// framing is stripped, data() points at the flatbuffer
+using Message = common::MessageBuffer;
 
 #endif
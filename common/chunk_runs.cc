@@ -0,0 +1,62 @@
+#include "chunk_runs.h"
+
+namespace common {
+  namespace {
+    // longest run chunk_data_run_length_mask can hold
+    constexpr std::uint32_t max_run_length = chunk_data_run_length_mask;
+
+    constexpr int index_of(int x, int y, int z) {
+      return x + chunk_sz_x * (y + chunk_sz_y * z);
+    }
+
+    // how many voxels the runs covered, -1 if one of them is malformed
+    int decode_runs(std::span<const std::uint32_t> runs, std::span<Voxel> voxels) {
+      int i = 0;
+      for (auto run : runs) {
+        auto voxel = static_cast<Voxel>((chunk_data_voxel_mask & run) >> 16);
+        int run_length = chunk_data_run_length_mask & run;
+        if (voxel >= Voxel::voxel_enum_size || i + run_length > chunk_sz)
+          return -1;
+        for (int end = i + run_length; i < end; ++i) {
+          int z = i % chunk_sz_z;
+          int x = (i / chunk_sz_z) % chunk_sz_x;
+          int y = i / (chunk_sz_z * chunk_sz_x);
+          voxels[index_of(x, y, z)] = voxel;
+        }
+      }
+      return i;
+    }
+  } // namespace
+
+  void encode_chunk_runs(std::span<const Voxel> voxels, std::vector<std::uint32_t>& runs) {
+    runs.clear();
+    auto last_voxel = voxels[index_of(0, 0, 0)];
+    std::uint32_t run_length = 0;
+    auto push_run = [&runs](Voxel voxel, std::uint32_t length) {
+      runs.push_back((static_cast<std::uint32_t>(voxel) << 16) | length);
+    };
+    for (int y = 0; y < chunk_sz_y; ++y) {
+      for (int x = 0; x < chunk_sz_x; ++x) {
+        for (int z = 0; z < chunk_sz_z; ++z) {
+          auto voxel = voxels[index_of(x, y, z)];
+          if (voxel == last_voxel && run_length < max_run_length) {
+            ++run_length;
+          } else {
+            push_run(last_voxel, run_length);
+            last_voxel = voxel;
+            run_length = 1;
+          }
+        }
+      }
+    }
+    push_run(last_voxel, run_length);
+  }
+
+  bool decode_chunk_runs(std::span<const std::uint32_t> runs, std::span<Voxel> voxels) {
+    return decode_runs(runs, voxels) == chunk_sz;
+  }
+
+  bool decode_chunk_runs_prefix(std::span<const std::uint32_t> runs, std::span<Voxel> voxels) {
+    return decode_runs(runs, voxels) >= 0;
+  }
+} // namespace common
@@ -0,0 +1,22 @@
+#ifndef CHUNK_RUNS_H
+#define CHUNK_RUNS_H
+
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "common.h"
+#include "voxel.h"
+
+namespace common {
+  // Run-length encoding of a chunk's voxels, as stored in the client's db and sent by the server.
+  // Each run is (voxel << 16) | length, see chunk_data_voxel_mask and chunk_data_run_length_mask.
+  // Runs go z fastest, then x, then y. voxels are indexed x + sz_x * (y + sz_y * z) like Chunk stores them
+  void encode_chunk_runs(std::span<const Voxel> voxels, std::vector<std::uint32_t>& runs);
+  // false if the runs don't describe exactly one chunk, voxels past the last run are left alone
+  bool decode_chunk_runs(std::span<const std::uint32_t> runs, std::span<Voxel> voxels);
+  // like decode_chunk_runs but the runs may end early, for rows the client's db saved before the final run
+  // was written. False only if a run is malformed or goes past the end of the chunk
+  bool decode_chunk_runs_prefix(std::span<const std::uint32_t> runs, std::span<Voxel> voxels);
+} // namespace common
+
+#endif
@@ -3,26 +3,20 @@
 #include <shlobj.h>
 #endif
 #ifdef __linux__
+#include <linux/limits.h>
 #include <unistd.h>
 #endif
 #ifdef __APPLE__
 #include <mach-o/dyld.h>
+#include <sys/syslimits.h>
 #endif
 #include <filesystem>
 #include <iomanip>
 #include <iostream>
-#include <random>
+#include <limits>
 #include <sstream>
-#include <boost/random.hpp>
 #include "common.h"
 
-namespace {
-  std::random_device rd;
-  std::mt19937 gen(rd());
-  std::uniform_real_distribution<float> uniform_probability(0.0f, 1.0f);
-
-} // namespace
-
 namespace common {
 
   double dms_to_decimal(const std::string& dms) {
@@ -124,20 +118,6 @@ namespace common {
     return dir.string();
   }
 
-  float random_probability() {
-    return uniform_probability(gen);
-  }
-
-  float random_float(float low, float high) {
-    std::uniform_real_distribution<float> dist(low, high);
-    return dist(gen);
-  };
-
-  int random_int(int low, int high) {
-    std::uniform_int_distribution<int> dist(low, high);
-    return dist(gen);
-  }
-
   // Stateless and repeatable function that returns a
   // pseduo-random number in the range [0, 0xFFFFFFFF].
   std::uint32_t Hash(const std::uint32_t seed) {
@@ -172,4 +152,14 @@ namespace common {
     return offset + range * NormRand(seed);
   }
 
+  int RangeRandInt(int low, int high, std::uint32_t const seed) {
+    return low + static_cast<int>(Rand(seed) % static_cast<std::uint32_t>(high - low + 1));
+  }
+
+  std::uint32_t HashPosition(int x, int y, int z) {
+    auto seed = Hash(static_cast<std::uint32_t>(x));
+    seed = Hash(seed ^ static_cast<std::uint32_t>(y));
+    return Hash(seed ^ static_cast<std::uint32_t>(z));
+  }
+
 } // namespace common
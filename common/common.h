@@ -16,6 +16,10 @@ namespace common {
   std::uint32_t Rand(std::uint32_t const seed);
   float NormRand(std::uint32_t const seed);
   float RangeRand(const float offset, const float range, std::uint32_t const seed);
+  // in [low, high]
+  int RangeRandInt(int low, int high, std::uint32_t const seed);
+  // seed for whatever is generated at a world position, the same on every thread and every run
+  std::uint32_t HashPosition(int x, int y, int z);
 
   constexpr int equator_circumference = 40075000;
   constexpr int polar_circumference = 40008000;
@@ -42,9 +46,6 @@ namespace common {
     moss
   };
 
-  float random_probability();
-  float random_float(float low, float high);
-  int random_int(int low, int high);
   constexpr unsigned int create_bitmask(int start, int end) {
     return ((1 << (end - start + 1)) - 1) << start;
   }
@@ -0,0 +1,167 @@
+#include "compression.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace common {
+  namespace {
+    constexpr int hash_bits = 12;
+    constexpr std::size_t max_nibble = 15;
+    constexpr std::size_t compressed_length_size = 4;
+
+    std::uint32_t read32(const std::uint8_t* data) {
+      std::uint32_t value;
+      std::memcpy(&value, data, sizeof(value));
+      return value;
+    }
+
+    std::uint32_t hash4(std::uint32_t value) {
+      return (value * 2654435761u) >> (32 - hash_bits);
+    }
+
+    std::uint8_t* write_length(std::uint8_t* out, std::size_t length) {
+      while (length >= 255) {
+        *out++ = 255;
+        length -= 255;
+      }
+      *out++ = static_cast<std::uint8_t>(length);
+      return out;
+    }
+
+    bool read_length(const std::uint8_t*& in, const std::uint8_t* end, std::size_t& length) {
+      std::uint8_t byte;
+      do {
+        if (in == end)
+          return false;
+        byte = *in++;
+        length += byte;
+      } while (byte == 255);
+      return true;
+    }
+
+    // match_length 0 ends the block with literals only
+    std::uint8_t* write_sequence(
+      std::uint8_t* out, const std::uint8_t* literals, std::size_t num_literals, std::size_t offset, std::size_t match_length) {
+      auto* token = out++;
+      *token = static_cast<std::uint8_t>(std::min(num_literals, max_nibble) << 4);
+      if (num_literals >= max_nibble)
+        out = write_length(out, num_literals - max_nibble);
+      std::memcpy(out, literals, num_literals);
+      out += num_literals;
+      if (match_length == 0)
+        return out;
+      *out++ = offset & 0xff;
+      *out++ = (offset >> 8) & 0xff;
+      auto extra = match_length - lz_min_match;
+      *token |= static_cast<std::uint8_t>(std::min(extra, max_nibble));
+      if (extra >= max_nibble)
+        out = write_length(out, extra - max_nibble);
+      return out;
+    }
+  } // namespace
+
+  std::size_t lz_compress(const std::uint8_t* data, std::size_t size, std::uint8_t* out) {
+    // positions of the last 4 bytes seen with each hash, a stale or colliding entry just fails the compare
+    thread_local std::array<std::uint32_t, 1 << hash_bits> table;
+    table.fill(0);
+    auto* start = out;
+    std::size_t anchor = 0;
+    std::size_t pos = 0;
+    while (pos + lz_min_match <= size) {
+      auto sequence = read32(data + pos);
+      auto& entry = table[hash4(sequence)];
+      std::size_t candidate = entry;
+      entry = static_cast<std::uint32_t>(pos);
+      if (candidate >= pos || pos - candidate > lz_max_offset || read32(data + candidate) != sequence) {
+        // step faster through data that isn't matching
+        pos += 1 + ((pos - anchor) >> 6);
+        continue;
+      }
+      auto length = lz_min_match;
+      while (pos + length < size && data[candidate + length] == data[pos + length])
+        ++length;
+      out = write_sequence(out, data + anchor, pos - anchor, pos - candidate, length);
+      pos += length;
+      anchor = pos;
+    }
+    out = write_sequence(out, data + anchor, size - anchor, 0, 0);
+    return out - start;
+  }
+
+  bool lz_decompress(const std::uint8_t* data, std::size_t size, std::uint8_t* out, std::size_t out_size) {
+    auto* in = data;
+    auto* in_end = data + size;
+    auto* out_start = out;
+    auto* out_end = out + out_size;
+    while (in < in_end) {
+      auto token = *in++;
+      std::size_t num_literals = token >> 4;
+      if (num_literals == max_nibble && !read_length(in, in_end, num_literals))
+        return false;
+      if (num_literals > static_cast<std::size_t>(in_end - in) || num_literals > static_cast<std::size_t>(out_end - out))
+        return false;
+      std::memcpy(out, in, num_literals);
+      in += num_literals;
+      out += num_literals;
+      if (in == in_end)
+        break;
+
+      if (in_end - in < 2)
+        return false;
+      std::size_t offset = in[0] | (in[1] << 8);
+      in += 2;
+      if (offset == 0 || offset > static_cast<std::size_t>(out - out_start))
+        return false;
+      std::size_t length = token & max_nibble;
+      if (length == max_nibble && !read_length(in, in_end, length))
+        return false;
+      length += lz_min_match;
+      if (length > static_cast<std::size_t>(out_end - out))
+        return false;
+      auto* match = out - offset;
+      if (offset >= length) {
+        std::memcpy(out, match, length);
+      } else {
+        // a match overlapping what it copies repeats the last offset bytes, so it goes byte by byte
+        for (std::size_t i = 0; i < length; ++i)
+          out[i] = match[i];
+      }
+      out += length;
+    }
+    return out == out_end;
+  }
+
+  MessageBuffer compress_frame(const MessageBuffer& frame) {
+    auto body_size = frame.size() - frame_header_length;
+    if (body_size < compression_threshold || frame_header_length + compressed_length_size + lz_bound(body_size) > max_message_size)
+      return frame;
+    auto compressed = MessagePool::instance()->acquire(frame_header_length + compressed_length_size + lz_bound(body_size));
+    auto* length = compressed.data() + frame_header_length;
+    for (std::size_t i = 0; i < compressed_length_size; ++i)
+      length[i] = (body_size >> (8 * i)) & 0xff;
+    auto block_size = lz_compress(frame.data() + frame_header_length, body_size, length + compressed_length_size);
+    auto compressed_body_size = compressed_length_size + block_size;
+    if (compressed_body_size >= body_size)
+      return frame;
+    compressed.resize(frame_header_length + compressed_body_size);
+    encode_frame_header(compressed.data(), FrameHeader{static_cast<std::uint32_t>(compressed_body_size), frame_flag_compressed});
+    return compressed;
+  }
+
+  bool decompress_body(std::uint8_t flags, MessageBuffer& body) {
+    if (!(flags & frame_flag_compressed))
+      return true;
+    if (body.size() < compressed_length_size)
+      return false;
+    std::size_t size = 0;
+    for (std::size_t i = 0; i < compressed_length_size; ++i)
+      size |= static_cast<std::size_t>(body.data()[i]) << (8 * i);
+    if (size > max_message_size)
+      return false;
+    auto decompressed = MessagePool::instance()->acquire(size);
+    if (!lz_decompress(body.data() + compressed_length_size, body.size() - compressed_length_size, decompressed.data(), size))
+      return false;
+    body = std::move(decompressed);
+    return true;
+  }
+} // namespace common
@@ -0,0 +1,38 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include "message_buffer.h"
+
+namespace common {
+  // A small LZ77 codec in the LZ4 block layout: each sequence is a token with literal and match lengths in
+  // its nibbles, the literals, then a 2 byte match offset, lengths of 15 and over spill into extra bytes.
+  // The last sequence is literals only. Sections and chunk runs repeat a lot at short range, neighbouring
+  // elevations and mostly uniform landcover, which this finds without needing a dictionary or entropy stage
+  constexpr std::size_t lz_min_match = 4;
+  constexpr std::size_t lz_max_offset = 0xffff;
+
+  // worst case output size for size bytes in
+  constexpr std::size_t lz_bound(std::size_t size) {
+    return size + size / 255 + 16;
+  }
+  // out must hold lz_bound(size) bytes, returns how many were written
+  std::size_t lz_compress(const std::uint8_t* data, std::size_t size, std::uint8_t* out);
+  // false unless data decodes to exactly out_size bytes
+  bool lz_decompress(const std::uint8_t* data, std::size_t size, std::uint8_t* out, std::size_t out_size);
+
+  // Set in a frame's header flags when the body is compressed. The body is then the uncompressed length,
+  // 4 bytes little endian, followed by the lz block. Only sent once both ends agreed on it in the handshake
+  constexpr std::uint8_t frame_flag_compressed = 1;
+  // bodies smaller than this go as they are, the saving doesn't pay for the work
+  constexpr std::size_t compression_threshold = 256;
+
+  // frame is a whole frame, header included. Returns a compressed copy, or frame itself if it's under
+  // compression_threshold or didn't get smaller
+  MessageBuffer compress_frame(const MessageBuffer& frame);
+  // replaces body with its decompressed contents if flags say it's compressed, false if it's corrupt
+  bool decompress_body(std::uint8_t flags, MessageBuffer& body);
+} // namespace common
+
+#endif
@@ -0,0 +1,103 @@
+#include "latency_histogram.h"
+#include <algorithm>
+#include <bit>
+#include <sstream>
+
+namespace common {
+  LatencyHistogram::LatencyHistogram() {
+    reset();
+  }
+
+  int LatencyHistogram::bucket_of(std::uint64_t value) {
+    if (value < sub_buckets)
+      return static_cast<int>(value);
+    int exponent = std::bit_width(value) - 1;
+    int shift = exponent - sub_bucket_bits;
+    int sub_bucket = static_cast<int>((value >> shift) & (sub_buckets - 1));
+    return sub_buckets + shift * sub_buckets + sub_bucket;
+  }
+
+  std::uint64_t LatencyHistogram::bucket_upper_bound(int bucket) {
+    if (bucket < sub_buckets)
+      return bucket;
+    int shift = (bucket - sub_buckets) / sub_buckets;
+    std::uint64_t sub_bucket = (bucket - sub_buckets) % sub_buckets;
+    std::uint64_t lower = (sub_buckets + sub_bucket) << shift;
+    return lower + ((std::uint64_t(1) << shift) - 1);
+  }
+
+  void LatencyHistogram::record(std::uint64_t value) {
+    buckets_[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+    auto max = max_.load(std::memory_order_relaxed);
+    while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed))
+      ;
+  }
+
+  void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (int i = 0; i < num_buckets; ++i)
+      buckets_[i].fetch_add(other.buckets_[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    count_.fetch_add(other.get_count(), std::memory_order_relaxed);
+    sum_.fetch_add(other.sum_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    auto other_max = other.get_max();
+    auto max = max_.load(std::memory_order_relaxed);
+    while (other_max > max && !max_.compare_exchange_weak(max, other_max, std::memory_order_relaxed))
+      ;
+  }
+
+  void LatencyHistogram::reset() {
+    for (auto& bucket : buckets_)
+      bucket.store(0, std::memory_order_relaxed);
+    count_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+  }
+
+  std::uint64_t LatencyHistogram::get_count() const {
+    return count_.load(std::memory_order_relaxed);
+  }
+
+  std::uint64_t LatencyHistogram::get_max() const {
+    return max_.load(std::memory_order_relaxed);
+  }
+
+  std::uint64_t LatencyHistogram::get_sum() const {
+    return sum_.load(std::memory_order_relaxed);
+  }
+
+  double LatencyHistogram::get_mean() const {
+    auto count = get_count();
+    if (count == 0)
+      return 0;
+    return static_cast<double>(sum_.load(std::memory_order_relaxed)) / count;
+  }
+
+  std::uint64_t LatencyHistogram::get_percentile(double percentile) const {
+    auto count = get_count();
+    if (count == 0)
+      return 0;
+    auto rank = static_cast<std::uint64_t>(percentile / 100.0 * count);
+    if (rank >= count)
+      rank = count - 1;
+    std::uint64_t seen = 0;
+    for (int i = 0; i < num_buckets; ++i) {
+      seen += buckets_[i].load(std::memory_order_relaxed);
+      if (seen > rank)
+        return std::min(bucket_upper_bound(i), get_max());
+    }
+    return get_max();
+  }
+
+  std::string LatencyHistogram::summary(const std::string& unit) const {
+    std::stringstream stream;
+    stream << "n=" << get_count()
+           << " mean=" << static_cast<std::uint64_t>(get_mean()) << unit
+           << " p50=" << get_percentile(50) << unit
+           << " p90=" << get_percentile(90) << unit
+           << " p99=" << get_percentile(99) << unit
+           << " p999=" << get_percentile(99.9) << unit
+           << " max=" << get_max() << unit;
+    return stream.str();
+  }
+} // namespace common
@@ -0,0 +1,41 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace common {
+  // Log-linear histogram: every power of two is split into 16 sub-buckets, so reported
+  // percentiles are within ~6% of the true value. Recording is lock-free and can be done from any thread
+  class LatencyHistogram {
+  public:
+    LatencyHistogram();
+    void record(std::uint64_t value);
+    void merge(const LatencyHistogram& other);
+    void reset();
+    std::uint64_t get_count() const;
+    std::uint64_t get_max() const;
+    std::uint64_t get_sum() const;
+    double get_mean() const;
+    std::uint64_t get_percentile(double percentile) const;
+    // "n=.. mean=.. p50=.. p90=.. p99=.. p999=.. max=.." with the given unit suffix
+    std::string summary(const std::string& unit) const;
+
+  private:
+    static constexpr int sub_bucket_bits = 4;
+    static constexpr int sub_buckets = 1 << sub_bucket_bits;
+    static constexpr int num_buckets = sub_buckets + (64 - sub_bucket_bits) * sub_buckets;
+
+    static int bucket_of(std::uint64_t value);
+    static std::uint64_t bucket_upper_bound(int bucket);
+
+    std::array<std::atomic<std::uint64_t>, num_buckets> buckets_;
+    std::atomic<std::uint64_t> count_;
+    std::atomic<std::uint64_t> sum_;
+    std::atomic<std::uint64_t> max_;
+  };
+} // namespace common
+
+#endif
@@ -0,0 +1,132 @@
+#include "message_buffer.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+namespace common {
+  FrameHeader decode_frame_header(const std::uint8_t* header) {
+    std::uint32_t value = header[0] | (header[1] << 8) | (header[2] << 16) | (static_cast<std::uint32_t>(header[3]) << 24);
+    return FrameHeader{value & frame_length_mask, static_cast<std::uint8_t>((value & frame_flags_mask) >> frame_flags_shift)};
+  }
+
+  void encode_frame_header(std::uint8_t* header, FrameHeader frame_header) {
+    std::uint32_t value = (frame_header.length & frame_length_mask) | (static_cast<std::uint32_t>(frame_header.flags) << frame_flags_shift);
+    header[0] = value & 0xff;
+    header[1] = (value >> 8) & 0xff;
+    header[2] = (value >> 16) & 0xff;
+    header[3] = (value >> 24) & 0xff;
+  }
+
+  MessageBuffer::MessageBuffer(Block* block) : block_(block) {}
+
+  MessageBuffer::MessageBuffer(const MessageBuffer& other) : block_(other.block_) {
+    if (block_)
+      block_->refs.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  MessageBuffer::MessageBuffer(MessageBuffer&& other) noexcept : block_(other.block_) {
+    other.block_ = nullptr;
+  }
+
+  MessageBuffer& MessageBuffer::operator=(const MessageBuffer& other) {
+    if (this != &other) {
+      if (other.block_)
+        other.block_->refs.fetch_add(1, std::memory_order_relaxed);
+      release();
+      block_ = other.block_;
+    }
+    return *this;
+  }
+
+  MessageBuffer& MessageBuffer::operator=(MessageBuffer&& other) noexcept {
+    if (this != &other) {
+      release();
+      block_ = other.block_;
+      other.block_ = nullptr;
+    }
+    return *this;
+  }
+
+  MessageBuffer::~MessageBuffer() {
+    release();
+  }
+
+  void MessageBuffer::release() {
+    if (block_ && block_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      MessagePool::instance()->release(block_);
+    block_ = nullptr;
+  }
+
+  std::uint8_t* MessageBuffer::data() {
+    return block_ ? block_->data() : nullptr;
+  }
+
+  const std::uint8_t* MessageBuffer::data() const {
+    return block_ ? block_->data() : nullptr;
+  }
+
+  std::size_t MessageBuffer::size() const {
+    return block_ ? block_->size : 0;
+  }
+
+  std::size_t MessageBuffer::capacity() const {
+    return block_ ? block_->capacity : 0;
+  }
+
+  bool MessageBuffer::empty() const {
+    return size() == 0;
+  }
+
+  void MessageBuffer::resize(std::size_t size) {
+    if (size > capacity())
+      throw std::runtime_error("message buffer resized past its capacity");
+    block_->size = size;
+  }
+
+  MessageBuffer MessagePool::acquire(std::size_t size) {
+    if (size > max_message_size)
+      throw std::runtime_error("message of " + std::to_string(size) + " bytes exceeds max message size");
+
+    int size_class = std::max(0, static_cast<int>(std::bit_width(std::max<std::size_t>(size, 1) - 1)) - min_class_bits);
+    std::size_t capacity = std::size_t(1) << (size_class + min_class_bits);
+
+    MessageBuffer::Block* block = nullptr;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      auto& free = free_[size_class];
+      if (!free.empty()) {
+        block = free.back();
+        free.pop_back();
+      }
+    }
+    if (!block) {
+      void* p = ::operator new(sizeof(MessageBuffer::Block) + capacity);
+      block = new (p) MessageBuffer::Block{{0}, capacity, 0, size_class};
+    }
+    block->refs.store(1, std::memory_order_relaxed);
+    block->size = size;
+    return MessageBuffer(block);
+  }
+
+  MessageBuffer MessagePool::acquire(const void* data, std::size_t size) {
+    auto buffer = acquire(size);
+    std::memcpy(buffer.data(), data, size);
+    return buffer;
+  }
+
+  void MessagePool::release(MessageBuffer::Block* block) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      auto& free = free_[block->size_class];
+      if ((free.size() + 1) * block->capacity <= max_pooled_bytes_per_class) {
+        free.push_back(block);
+        return;
+      }
+    }
+    block->~Block();
+    ::operator delete(block);
+  }
+} // namespace common
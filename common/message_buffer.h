@@ -0,0 +1,98 @@
+#ifndef MESSAGE_BUFFER_H
+#define MESSAGE_BUFFER_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "common.h"
+
+namespace common {
+  // Wire framing: a 4 byte little endian header in front of every body. The low bits hold the body
+  // length, the high bits are reserved for per-message flags
+  constexpr std::size_t frame_header_length = 4;
+  constexpr std::uint32_t frame_length_mask = create_bitmask(0, 27);
+  constexpr std::uint32_t frame_flags_mask = ~frame_length_mask;
+  constexpr int frame_flags_shift = 28;
+  // anything bigger is treated as a corrupt stream
+  constexpr std::uint32_t max_message_size = 64 * 1024 * 1024;
+  static_assert(max_message_size <= frame_length_mask);
+
+  struct FrameHeader {
+    std::uint32_t length;
+    std::uint8_t flags;
+  };
+  FrameHeader decode_frame_header(const std::uint8_t* header);
+  void encode_frame_header(std::uint8_t* header, FrameHeader frame_header);
+
+  class MessagePool;
+
+  // Ref-counted handle to a pooled byte buffer. Copies share the bytes, the last handle to go away
+  // returns the storage to its pool. Safe to pass between threads, but not to write to concurrently
+  class MessageBuffer {
+  public:
+    MessageBuffer() = default;
+    MessageBuffer(const MessageBuffer& other);
+    MessageBuffer(MessageBuffer&& other) noexcept;
+    MessageBuffer& operator=(const MessageBuffer& other);
+    MessageBuffer& operator=(MessageBuffer&& other) noexcept;
+    ~MessageBuffer();
+
+    std::uint8_t* data();
+    const std::uint8_t* data() const;
+    std::size_t size() const;
+    std::size_t capacity() const;
+    bool empty() const;
+    // only shrinks, or grows back up to capacity
+    void resize(std::size_t size);
+
+  private:
+    friend class MessagePool;
+    struct Block {
+      std::atomic<int> refs;
+      std::size_t capacity;
+      std::size_t size;
+      int size_class;
+
+      std::uint8_t* data() { return reinterpret_cast<std::uint8_t*>(this + 1); }
+    };
+    explicit MessageBuffer(Block* block);
+    void release();
+
+    Block* block_ = nullptr;
+  };
+
+  // Free lists of message buffers bucketed by power of two capacity
+  class MessagePool {
+  public:
+    static MessagePool* instance() {
+      static MessagePool* instance = new MessagePool();
+      return instance;
+    }
+    MessagePool(const MessagePool& other) = delete;
+    MessagePool& operator=(const MessagePool& other) = delete;
+
+    // throws if size is larger than max_message_size
+    MessageBuffer acquire(std::size_t size);
+    // acquire and copy size bytes from data
+    MessageBuffer acquire(const void* data, std::size_t size);
+
+  private:
+    friend class MessageBuffer;
+    MessagePool() = default;
+    void release(MessageBuffer::Block* block);
+
+    static constexpr int min_class_bits = 10;
+    // up to 2^26, max_message_size
+    static constexpr int num_classes = 27 - min_class_bits;
+    // how many bytes of free buffers each size class keeps around
+    static constexpr std::size_t max_pooled_bytes_per_class = 8 * 1024 * 1024;
+
+    std::mutex mutex_;
+    std::array<std::vector<MessageBuffer::Block*>, num_classes> free_;
+  };
+} // namespace common
+
+#endif
@@ -0,0 +1,88 @@
+#include "section_batch.h"
+
+namespace common {
+  namespace {
+    // deltas wrap rather than overflow, anything int32_t holds round trips
+    std::int32_t delta(std::int32_t to, std::int32_t from) {
+      return static_cast<std::int32_t>(static_cast<std::uint32_t>(to) - static_cast<std::uint32_t>(from));
+    }
+
+    std::int32_t add(std::int32_t from, std::int32_t delta) {
+      return static_cast<std::int32_t>(static_cast<std::uint32_t>(from) + static_cast<std::uint32_t>(delta));
+    }
+
+    void put_varint(std::int32_t value, std::vector<std::uint8_t>& out) {
+      auto zigzag = (static_cast<std::uint32_t>(value) << 1) ^ static_cast<std::uint32_t>(value >> 31);
+      while (zigzag >= 0x80) {
+        out.push_back(static_cast<std::uint8_t>(zigzag | 0x80));
+        zigzag >>= 7;
+      }
+      out.push_back(static_cast<std::uint8_t>(zigzag));
+    }
+
+    bool get_varint(std::span<const std::uint8_t> in, std::size_t& pos, std::int32_t& value) {
+      std::uint32_t zigzag = 0;
+      for (int shift = 0; shift < 35; shift += 7) {
+        if (pos == in.size())
+          return false;
+        auto byte = in[pos++];
+        zigzag |= static_cast<std::uint32_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+          value = static_cast<std::int32_t>((zigzag >> 1) ^ (~(zigzag & 1) + 1));
+          return true;
+        }
+      }
+      return false;
+    }
+  } // namespace
+
+  void encode_section_coords(
+    std::span<const std::int32_t> xs, std::span<const std::int32_t> zs, std::int32_t origin_x, std::int32_t origin_z,
+    std::vector<std::uint8_t>& out) {
+    out.clear();
+    out.reserve(xs.size() * 2);
+    auto last_x = origin_x, last_z = origin_z;
+    for (std::size_t i = 0; i < xs.size(); ++i) {
+      put_varint(delta(xs[i], last_x), out);
+      put_varint(delta(zs[i], last_z), out);
+      last_x = xs[i];
+      last_z = zs[i];
+    }
+  }
+
+  bool decode_section_coords(
+    std::span<const std::uint8_t> coords, std::int32_t origin_x, std::int32_t origin_z, std::span<std::int32_t> xs,
+    std::span<std::int32_t> zs) {
+    std::size_t pos = 0;
+    auto last_x = origin_x, last_z = origin_z;
+    for (std::size_t i = 0; i < xs.size(); ++i) {
+      std::int32_t dx, dz;
+      if (!get_varint(coords, pos, dx) || !get_varint(coords, pos, dz))
+        return false;
+      last_x = add(last_x, dx);
+      last_z = add(last_z, dz);
+      xs[i] = last_x;
+      zs[i] = last_z;
+    }
+    return pos == coords.size();
+  }
+
+  void pack_landcover(std::span<const std::uint8_t> landcover, std::vector<std::uint8_t>& out) {
+    out.assign((landcover.size() + 1) / 2, 0);
+    for (std::size_t i = 0; i < landcover.size(); ++i)
+      out[i / 2] |= landcover[i] << (i % 2 * landcover_bits);
+  }
+
+  bool unpack_landcover(std::span<const std::uint8_t> packed, std::span<std::uint8_t> landcover) {
+    if (packed.size() != (landcover.size() + 1) / 2)
+      return false;
+    std::size_t pairs = landcover.size() / 2;
+    for (std::size_t i = 0; i < pairs; ++i) {
+      landcover[2 * i] = packed[i] & 0x0f;
+      landcover[2 * i + 1] = packed[i] >> landcover_bits;
+    }
+    if (landcover.size() % 2)
+      landcover.back() = packed.back() & 0x0f;
+    return true;
+  }
+} // namespace common
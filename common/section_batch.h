@@ -0,0 +1,30 @@
+#ifndef SECTION_BATCH_H
+#define SECTION_BATCH_H
+
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "common.h"
+
+namespace common {
+  // Columns of fbs_update::SectionBatch. Section i is at (xs[i], zs[i]), coordinates go on the wire as zigzag
+  // varint deltas from the previous section, the first from the batch origin. Sections a batch sends are
+  // mostly neighbours so nearly every delta is a byte. Landcover is landcover_tiles_per_sector tiles per
+  // section packed two to a byte, low nibble first
+  constexpr int landcover_bits = 4;
+
+  void encode_section_coords(
+    std::span<const std::int32_t> xs, std::span<const std::int32_t> zs, std::int32_t origin_x, std::int32_t origin_z,
+    std::vector<std::uint8_t>& out);
+  // false if coords doesn't hold exactly xs.size() sections
+  bool decode_section_coords(
+    std::span<const std::uint8_t> coords, std::int32_t origin_x, std::int32_t origin_z, std::span<std::int32_t> xs,
+    std::span<std::int32_t> zs);
+
+  // every value must be below 1 << landcover_bits
+  void pack_landcover(std::span<const std::uint8_t> landcover, std::vector<std::uint8_t>& out);
+  // false if packed is the wrong size for landcover
+  bool unpack_landcover(std::span<const std::uint8_t> packed, std::span<std::uint8_t> landcover);
+} // namespace common
+
+#endif
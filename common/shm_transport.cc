@@ -0,0 +1,388 @@
+#include "shm_transport.h"
+#include <algorithm>
+#include <bit>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string_view>
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include "compression.h"
+
+namespace common {
+  struct ShmChannel::Ring {
+    // bytes ever written and read, only the writer moves head and only the reader moves tail
+    alignas(64) std::atomic<std::uint64_t> head;
+    alignas(64) std::atomic<std::uint64_t> tail;
+    // bumped after head moves, the reader sleeps on it
+    alignas(64) std::atomic<std::uint32_t> data_seq;
+    std::atomic<std::uint32_t> reader_waiting;
+    // bumped after tail moves, the writer sleeps on it
+    alignas(64) std::atomic<std::uint32_t> space_seq;
+    std::atomic<std::uint32_t> writer_waiting;
+  };
+
+  struct ShmChannel::Segment {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint64_t ring_size;
+    std::atomic<std::uint32_t> closed;
+    // client to server, then server to client
+    Ring rings[2];
+  };
+
+  namespace {
+    constexpr std::uint32_t segment_magic = 0x43534d52;
+    constexpr std::uint32_t segment_version = 1;
+    constexpr std::size_t min_ring_size = 64 * 1024;
+    constexpr std::size_t max_ring_size = 256 * 1024 * 1024;
+    // ring data starts on its own cache line after the header
+    constexpr std::size_t data_offset = 1024;
+    // checks before sleeping, a reply usually lands within a few microseconds
+    constexpr int spin_iterations = 200;
+    // sleeps are bounded so a peer that died without closing is noticed by whoever owns the socket
+    constexpr long wait_timeout_ns = 100'000'000;
+
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+    static_assert(std::atomic<std::uint32_t>::is_always_lock_free);
+
+#ifdef __linux__
+    // not FUTEX_PRIVATE, the words are shared with the other process
+    void futex_wait(std::atomic<std::uint32_t>& word, std::uint32_t expected) {
+      timespec timeout{0, wait_timeout_ns};
+      syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+    }
+
+    void futex_wake(std::atomic<std::uint32_t>& word) {
+      syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+    }
+#else
+    void futex_wait(std::atomic<std::uint32_t>&, std::uint32_t) {}
+    void futex_wake(std::atomic<std::uint32_t>&) {}
+#endif
+
+    bool is_digits(std::string_view digits) {
+      return !digits.empty() && digits.size() <= 10 && std::all_of(digits.begin(), digits.end(), [](char c) { return c >= '0' && c <= '9'; });
+    }
+
+    // exactly what create makes, name_prefix then pid-id
+    bool is_channel_name(std::string_view name) {
+      if (!name.starts_with(ShmChannel::name_prefix))
+        return false;
+      name.remove_prefix(std::string_view(ShmChannel::name_prefix).size());
+      auto dash = name.find('-');
+      return dash != std::string_view::npos && is_digits(name.substr(0, dash)) && is_digits(name.substr(dash + 1));
+    }
+
+    void signal(std::atomic<std::uint32_t>& seq, std::atomic<std::uint32_t>& waiting) {
+      seq.fetch_add(1);
+      if (waiting.load())
+        futex_wake(seq);
+    }
+
+    // false if the segment closed first. waiting is raised before the last check so a signal in between
+    // either makes ready() true or changes seq and the futex returns straight away
+    template<typename Ready>
+    bool wait(
+      Ready ready, std::atomic<std::uint32_t>& seq, std::atomic<std::uint32_t>& waiting,
+      const std::atomic<std::uint32_t>& closed) {
+      for (int i = 0; i < spin_iterations; ++i) {
+        if (ready())
+          return true;
+      }
+      for (;;) {
+        if (ready())
+          return true;
+        if (closed.load())
+          return false;
+        auto seen = seq.load();
+        waiting.store(1);
+        if (ready() || closed.load()) {
+          waiting.store(0);
+          continue;
+        }
+        futex_wait(seq, seen);
+        waiting.store(0);
+      }
+    }
+  } // namespace
+
+  ShmChannel::ShmChannel(std::string name, void* mapping, std::size_t mapping_size, std::uint64_t ring_size, bool creator)
+      : name_(std::move(name)), mapping_(mapping), mapping_size_(mapping_size), creator_(creator), ring_size_(ring_size) {
+    static_assert(sizeof(Segment) <= data_offset);
+    segment_ = static_cast<Segment*>(mapping_);
+    auto* data = static_cast<std::uint8_t*>(mapping_) + data_offset;
+    in_ = &segment_->rings[creator_ ? 1 : 0];
+    out_ = &segment_->rings[creator_ ? 0 : 1];
+    in_data_ = data + (creator_ ? ring_size_ : 0);
+    out_data_ = data + (creator_ ? 0 : ring_size_);
+  }
+
+  ShmChannel::~ShmChannel() {
+#ifdef __linux__
+    munmap(mapping_, mapping_size_);
+    // normally already gone, the server unlinks it once mapped
+    if (creator_)
+      shm_unlink(name_.c_str());
+#endif
+  }
+
+  bool ShmChannel::is_supported() {
+#ifdef __linux__
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  std::unique_ptr<ShmChannel> ShmChannel::create(std::size_t ring_size) {
+#ifdef __linux__
+    static std::atomic<int> next_id{0};
+    ring_size = std::bit_ceil(std::clamp(ring_size, min_ring_size, max_ring_size));
+    auto name = std::string(name_prefix) + std::to_string(getpid()) + "-" + std::to_string(next_id++);
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+      std::cerr << "shm_open " << name << " failed: " << std::strerror(errno) << std::endl;
+      return nullptr;
+    }
+    std::size_t size = data_offset + 2 * ring_size;
+    void* mapping = MAP_FAILED;
+    if (ftruncate(fd, size) == 0)
+      mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+      std::cerr << "mapping " << name << " failed: " << std::strerror(errno) << std::endl;
+      shm_unlink(name.c_str());
+      return nullptr;
+    }
+    auto* segment = new (mapping) Segment();
+    segment->magic = segment_magic;
+    segment->version = segment_version;
+    segment->ring_size = ring_size;
+    return std::unique_ptr<ShmChannel>(new ShmChannel(std::move(name), mapping, size, ring_size, true));
+#else
+    return nullptr;
+#endif
+  }
+
+  std::unique_ptr<ShmChannel> ShmChannel::open(const std::string& name) {
+#ifdef __linux__
+    // only ever a segment a client made, never an arbitrary path
+    if (!is_channel_name(name))
+      return nullptr;
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0)
+      return nullptr;
+    struct stat st;
+    void* mapping = MAP_FAILED;
+    std::size_t size = 0;
+    // and one made by a process of the same user, a segment someone else left open to us isn't one
+    if (fstat(fd, &st) == 0 && st.st_uid == geteuid() && static_cast<std::size_t>(st.st_size) >= data_offset) {
+      size = st.st_size;
+      mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+      return nullptr;
+    shm_unlink(name.c_str());
+    auto* segment = static_cast<Segment*>(mapping);
+    auto ring_size = segment->ring_size;
+    if (segment->magic != segment_magic || segment->version != segment_version || !std::has_single_bit(ring_size) ||
+        ring_size < min_ring_size || ring_size > max_ring_size || size != data_offset + 2 * ring_size) {
+      munmap(mapping, size);
+      return nullptr;
+    }
+    return std::unique_ptr<ShmChannel>(new ShmChannel(name, mapping, size, ring_size, false));
+#else
+    return nullptr;
+#endif
+  }
+
+  const std::string& ShmChannel::get_name() const {
+    return name_;
+  }
+
+  bool ShmChannel::write(const MessageBuffer& message) {
+    return write_bytes(message.data(), message.size());
+  }
+
+  bool ShmChannel::read(MessageBuffer& body) {
+    std::uint8_t header_bytes[frame_header_length];
+    if (!read_bytes(header_bytes, frame_header_length))
+      return false;
+    auto header = decode_frame_header(header_bytes);
+    if (header.length > max_message_size) {
+      std::cerr << "closing shared memory connection, bad frame of " << header.length << " bytes" << std::endl;
+      close();
+      return false;
+    }
+    body = MessagePool::instance()->acquire(header.length);
+    if (!read_bytes(body.data(), body.size()))
+      return false;
+    // neither side compresses over shared memory, but the frames are the same as on a socket
+    if (!decompress_body(header.flags, body)) {
+      std::cerr << "closing shared memory connection, corrupt compressed frame" << std::endl;
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  void ShmChannel::close() {
+    segment_->closed.store(1);
+    for (auto& ring : segment_->rings) {
+      ring.data_seq.fetch_add(1);
+      futex_wake(ring.data_seq);
+      ring.space_seq.fetch_add(1);
+      futex_wake(ring.space_seq);
+    }
+  }
+
+  bool ShmChannel::is_closed() const {
+    return segment_->closed.load();
+  }
+
+  bool ShmChannel::read_bytes(std::uint8_t* data, std::size_t size) {
+    auto& ring = *in_;
+    while (size > 0) {
+      auto tail = ring.tail.load(std::memory_order_relaxed);
+      std::uint64_t available = 0;
+      auto ready = [&ring, tail, &available] {
+        available = ring.head.load() - tail;
+        return available > 0;
+      };
+      if (!wait(ready, ring.data_seq, ring.reader_waiting, segment_->closed))
+        return false;
+      // the other side is another process, don't trust it to keep head sane
+      if (available > ring_size_) {
+        close();
+        return false;
+      }
+      auto n = std::min<std::uint64_t>(available, size);
+      auto offset = tail & (ring_size_ - 1);
+      auto first = std::min<std::uint64_t>(n, ring_size_ - offset);
+      std::memcpy(data, in_data_ + offset, first);
+      std::memcpy(data + first, in_data_, n - first);
+      ring.tail.store(tail + n);
+      signal(ring.space_seq, ring.writer_waiting);
+      data += n;
+      size -= n;
+    }
+    return true;
+  }
+
+  bool ShmChannel::write_bytes(const std::uint8_t* data, std::size_t size) {
+    auto& ring = *out_;
+    while (size > 0) {
+      auto head = ring.head.load(std::memory_order_relaxed);
+      std::uint64_t space = 0;
+      auto ready = [this, &ring, head, &space] {
+        space = ring_size_ - (head - ring.tail.load());
+        return space > 0;
+      };
+      if (!wait(ready, ring.space_seq, ring.writer_waiting, segment_->closed))
+        return false;
+      if (space > ring_size_) {
+        close();
+        return false;
+      }
+      auto n = std::min<std::uint64_t>(space, size);
+      auto offset = head & (ring_size_ - 1);
+      auto first = std::min<std::uint64_t>(n, ring_size_ - offset);
+      std::memcpy(out_data_ + offset, data, first);
+      std::memcpy(out_data_, data + first, n - first);
+      ring.head.store(head + n);
+      signal(ring.data_seq, ring.reader_waiting);
+      data += n;
+      size -= n;
+    }
+    return true;
+  }
+
+  ShmConnection::ShmConnection(
+    std::unique_ptr<ShmChannel> channel, std::size_t hard_limit, ReadHandler on_read, CloseHandler on_close)
+      : channel_(std::move(channel)), hard_limit_(hard_limit), on_read_(std::move(on_read)),
+        on_close_(std::move(on_close)) {}
+
+  ShmConnection::~ShmConnection() {
+    close();
+    if (reader_.joinable())
+      reader_.join();
+    if (writer_.joinable())
+      writer_.join();
+  }
+
+  void ShmConnection::start() {
+    reader_ = std::thread(&ShmConnection::read_loop, this);
+    writer_ = std::thread(&ShmConnection::write_loop, this);
+  }
+
+  void ShmConnection::write(const MessageBuffer& message) {
+    bool over_limit = false;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (closed_)
+        return;
+      pending_.push_back(message);
+      queued_bytes_ += message.size();
+      if (queued_bytes_ > hard_limit_) {
+        std::cerr << "closing shared memory connection, " << queued_bytes_ << " bytes queued" << std::endl;
+        over_limit = true;
+      }
+    }
+    if (over_limit)
+      close();
+    else
+      cv_.notify_one();
+  }
+
+  void ShmConnection::close() {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      closed_ = true;
+      pending_.clear();
+      queued_bytes_ = 0;
+    }
+    cv_.notify_all();
+    channel_->close();
+  }
+
+  void ShmConnection::read_loop() {
+    MessageBuffer body;
+    while (channel_->read(body))
+      on_read_(std::move(body));
+    finish();
+  }
+
+  void ShmConnection::write_loop() {
+    for (;;) {
+      MessageBuffer message;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return closed_ || !pending_.empty(); });
+        if (closed_)
+          break;
+        message = std::move(pending_.front());
+        pending_.pop_front();
+        queued_bytes_ -= message.size();
+      }
+      if (!channel_->write(message))
+        break;
+    }
+    finish();
+  }
+
+  void ShmConnection::finish() {
+    if (finished_.exchange(true))
+      return;
+    close();
+    on_close_();
+  }
+} // namespace common
@@ -0,0 +1,107 @@
+#ifndef SHM_TRANSPORT_H
+#define SHM_TRANSPORT_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "message_buffer.h"
+
+namespace common {
+  // Two single producer single consumer byte rings in one shared memory segment, one each way, carrying the
+  // same frames as the sockets. The client creates the segment and names it in its Hello, the server maps it
+  // and unlinks the name. A side blocked on an empty or full ring sleeps on a futex in the segment, and is
+  // only woken if it said it was waiting, so a busy connection makes no syscalls at all. Linux only,
+  // create and open return nullptr elsewhere
+  class ShmChannel {
+  public:
+    ~ShmChannel();
+    ShmChannel(const ShmChannel& other) = delete;
+    ShmChannel& operator=(const ShmChannel& other) = delete;
+
+    static bool is_supported();
+    // the client side, ring_size is rounded up to a power of two
+    static std::unique_ptr<ShmChannel> create(std::size_t ring_size);
+    // the server side, name must be one create made
+    static std::unique_ptr<ShmChannel> open(const std::string& name);
+
+    const std::string& get_name() const;
+    // a whole frame, header included. Blocks while the ring is full, false once closed
+    bool write(const MessageBuffer& message);
+    // the next body, blocks until one is in. False once closed or if the peer wrote garbage
+    bool read(MessageBuffer& body);
+    // wakes both sides of both rings, every later read and write fails
+    void close();
+    bool is_closed() const;
+
+    static constexpr std::size_t default_ring_size = 4 * 1024 * 1024;
+    static constexpr const char* name_prefix = "/csworld-";
+
+  private:
+    struct Ring;
+    struct Segment;
+
+    ShmChannel(std::string name, void* mapping, std::size_t mapping_size, std::uint64_t ring_size, bool creator);
+    bool read_bytes(std::uint8_t* data, std::size_t size);
+    bool write_bytes(const std::uint8_t* data, std::size_t size);
+
+    std::string name_;
+    void* mapping_;
+    std::size_t mapping_size_;
+    bool creator_;
+    // kept here, the peer can scribble over the segment's copy
+    std::uint64_t ring_size_;
+    Segment* segment_;
+    Ring* in_;
+    Ring* out_;
+    std::uint8_t* in_data_;
+    std::uint8_t* out_data_;
+  };
+
+  // A ShmChannel with a thread reading it and a thread writing queued messages to it, so writers never block
+  // on a full ring. Behind TCPConnection and TCPClient once a connection has switched to shared memory
+  class ShmConnection {
+  public:
+    using ReadHandler = std::function<void(MessageBuffer body)>;
+    // called once, from one of the connection's threads
+    using CloseHandler = std::function<void()>;
+
+    ShmConnection(std::unique_ptr<ShmChannel> channel, std::size_t hard_limit, ReadHandler on_read, CloseHandler on_close);
+    ~ShmConnection();
+    ShmConnection(const ShmConnection& other) = delete;
+    ShmConnection& operator=(const ShmConnection& other) = delete;
+
+    void start();
+    // safe to call from any thread, dropped once closed. Past hard_limit queued bytes the connection is closed
+    void write(const MessageBuffer& message);
+    void close();
+
+  private:
+    void read_loop();
+    void write_loop();
+    void finish();
+
+    std::unique_ptr<ShmChannel> channel_;
+    std::size_t hard_limit_;
+    ReadHandler on_read_;
+    CloseHandler on_close_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<MessageBuffer> pending_;
+    std::size_t queued_bytes_ = 0;
+    bool closed_ = false;
+    std::atomic<bool> finished_{false};
+
+    std::thread reader_;
+    std::thread writer_;
+  };
+} // namespace common
+
+#endif
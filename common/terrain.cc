@@ -0,0 +1,210 @@
+#include "terrain.h"
+#include <cy/cyPoint.h>
+#include <cy/cySampleElim.h>
+#include "open-simplex-noise.h"
+
+namespace common {
+  namespace {
+    constexpr int noise_octaves = 4;
+    constexpr double noise_persistence = 0.75;
+    constexpr double noise_scale = 0.4;
+    // flowers are drawn from the same noise further along
+    constexpr double noise_shift = 4096;
+
+    constexpr int mod(int n, int m) {
+      return ((n % m) + m) % m;
+    }
+  } // namespace
+
+  LandCover get_landcover(const LandCover* landcover, int x, int z) {
+    int col = x * landcover_cols_per_sector / chunk_sz_x;
+    int row = z * landcover_rows_per_sector / chunk_sz_z;
+    return landcover[col + row * landcover_cols_per_sector];
+  }
+
+  Voxel get_ground_voxel(LandCover landcover) {
+    if (landcover == LandCover::bare)
+      return Voxel::stone;
+    if (landcover == LandCover::water)
+      return Voxel::water_full;
+    return Voxel::dirt;
+  }
+
+  void compute_subsection_elevations(const std::array<int, 9>& elevations, std::vector<int>& out) {
+    int elevation = elevations[4];
+    int e1 = elevations[6];
+    int e2 = elevations[7];
+    int e3 = elevations[8];
+    int e4 = elevations[5];
+    int e5 = elevations[2];
+    int e6 = elevations[1];
+    int e7 = elevations[0];
+    int e8 = elevations[3];
+
+    // e1 | e2 | e3
+    // e8 | e  | e4
+    // e7 | e6 | e5
+
+    float a1 = (e8 + e1 + e2 + elevation) / 4.0;
+    float a2 = (e2 + e3 + e4 + elevation) / 4.0;
+    float a3 = (e4 + e5 + e6 + elevation) / 4.0;
+    float a4 = (e6 + e7 + e8 + elevation) / 4.0;
+
+    float vAAu = ((e2 + elevation) - (e1 + e8));
+    float vAAv = ((e1 + e2) - (e8 + elevation));
+    float vABu = ((e3 + e4) - (e2 + elevation));
+    float vABv = ((e2 + e3) - (elevation + e4));
+    float vBAu = ((elevation + e6) - (e8 + e7));
+    float vBAv = ((e8 + elevation) - (e7 + e6));
+    float vBBu = ((e4 + e5) - (elevation + e6));
+    float vBBv = ((elevation + e4) - (e6 + e5));
+
+    out.clear();
+    out.reserve(chunk_sz_x * chunk_sz_z);
+    for (float z = 0; z < chunk_sz_z; ++z) {
+      for (float x = 0; x < chunk_sz_x; ++x) {
+        float u = (x + 0.5) / chunk_sz_x;
+        float v = (z + 0.5) / chunk_sz_z;
+        float u_fade = u * u * (3 - 2 * u);
+        float v_fade = v * v * (3 - 2 * v);
+
+        u /= 2;
+        v /= 2;
+        float iu = u - 0.5;
+        float iv = v - 0.5;
+
+        float n_x0 = (1 - u_fade) * (a4 + vBAu * u + vBAv * v) + u_fade * (a3 + vBBu * iu + vBBv * v);
+        float n_x1 = (1 - u_fade) * (a1 + vAAu * u + vAAv * iv) + u_fade * (a2 + vABu * iu + vABv * iv);
+
+        int n_xy = (1 - v_fade) * n_x0 + v_fade * n_x1;
+        out.push_back(n_xy);
+      }
+    }
+  }
+
+  void build_tree(int x, int y, int z, std::vector<FeatureVoxel>& out) {
+    auto seed = HashPosition(x, y, z);
+    int tree_height = RangeRandInt(5, 8, seed);
+    int height_without_leaves;
+    if (tree_height >= 7) {
+      height_without_leaves = RangeRandInt(3, 4, seed + 1);
+    } else {
+      height_without_leaves = RangeRandInt(2, 3, seed + 1);
+    }
+
+    constexpr std::array<int, 3> arr_1 = {-1, 0, 1};
+    constexpr std::array<int, 2> arr_2 = {-2, 2};
+    for (int count = height_without_leaves; count < tree_height; ++count) {
+      for (auto dx : arr_1) {
+        for (auto dz : arr_1) {
+          out.push_back(FeatureVoxel{x + dx, y + count, z + dz, Voxel::leaves});
+        }
+      }
+      for (auto dz : arr_1) {
+        for (auto dx : arr_2) {
+          out.push_back(FeatureVoxel{x + dx, y + count, z + dz, Voxel::leaves});
+        }
+      }
+      for (auto dx : arr_1) {
+        for (auto dz : arr_2) {
+          out.push_back(FeatureVoxel{x + dx, y + count, z + dz, Voxel::leaves});
+        }
+      }
+    }
+
+    // cross on top
+    constexpr std::array<int, 2> arr_3 = {-1, 1};
+    for (auto dx : arr_3) {
+      out.push_back(FeatureVoxel{x + dx, y + tree_height, z, Voxel::leaves});
+    }
+    for (auto dz : arr_3) {
+      out.push_back(FeatureVoxel{x, y + tree_height, z + dz, Voxel::leaves});
+    }
+    out.push_back(FeatureVoxel{x, y + tree_height, z, Voxel::leaves});
+    out.push_back(FeatureVoxel{x, y + tree_height + 1, z, Voxel::leaves});
+
+    // trunk
+    for (int count = 0; count < tree_height; ++count) {
+      out.push_back(FeatureVoxel{x, y + count, z, Voxel::tree_trunk});
+    }
+  }
+
+  FeatureGenerator::FeatureGenerator() {
+    open_simplex_noise(7, &grass_noise_);
+
+    tree_roots_.resize(tree_root_grid_sz_x * tree_root_grid_sz_z, false);
+    cy::WeightedSampleElimination<cy::Point2d, double, 2> wse;
+    wse.SetParamBeta(0.0);
+    wse.SetBoundsMin(cy::Point2d{0, 0});
+    wse.SetBoundsMax(cy::Point2d{tree_root_grid_sz_x - 1, tree_root_grid_sz_z - 1});
+    wse.SetTiling(true);
+    std::vector<cy::Point2d> input_points;
+    for (double z = 0; z < tree_root_grid_sz_z; ++z) {
+      for (double x = 0; x < tree_root_grid_sz_x; ++x) {
+        input_points.push_back(cy::Point2d{x, z});
+      }
+    }
+    int sparsity = 50;
+    std::vector<cy::Point2d> output_points(input_points.size() / sparsity);
+    wse.Eliminate(
+      input_points.data(), input_points.size(),
+      output_points.data(), output_points.size(), true);
+    for (auto& p : output_points) {
+      int x = static_cast<int>(p.x);
+      int z = static_cast<int>(p.y);
+      tree_roots_[x + tree_root_grid_sz_x * z] = true;
+    }
+  }
+
+  FeatureGenerator::~FeatureGenerator() {
+    open_simplex_noise_free(grass_noise_);
+  }
+
+  double FeatureGenerator::noise(double x, double y, double shift) const {
+    x += shift;
+    y += shift;
+    double max_amp = 0;
+    double amp = 1;
+    double freq = noise_scale;
+    double value = 0;
+    for (int i = 0; i < noise_octaves; ++i) {
+      value += open_simplex_noise2(grass_noise_, x * freq, y * freq) * amp;
+      max_amp += amp;
+      amp *= noise_persistence;
+      freq *= 2;
+    }
+    // from [-1, 1] to [0, 1]
+    return (value / max_amp + 1) / 2;
+  }
+
+  void FeatureGenerator::generate(
+    int section_x, int section_z, const LandCover* landcover, const std::vector<int>& subsection_elevations,
+    std::vector<FeatureVoxel>& out) const {
+    int sec_x_offset = mod(section_x, (tree_root_grid_sz_x / chunk_sz_x)) * chunk_sz_x;
+    int sec_z_offset = mod(section_z, (tree_root_grid_sz_z / chunk_sz_z)) * chunk_sz_z;
+    for (int z = 0; z < chunk_sz_z; ++z) {
+      for (int x = 0; x < chunk_sz_x; ++x) {
+        auto column_landcover = get_landcover(landcover, x, z);
+        int subsection_elevation = subsection_elevations[x + chunk_sz_x * z];
+        int x_global = section_x * chunk_sz_x + x;
+        int z_global = section_z * chunk_sz_z + z;
+        if (column_landcover == LandCover::trees) {
+          if (tree_roots_[(x + sec_x_offset) + tree_root_grid_sz_x * (z + sec_z_offset)]) {
+            build_tree(x_global, subsection_elevation + 1, z_global, out);
+          } else {
+            // the noise is sampled in section coordinates, so every section has the same pattern
+            if (noise(x, z) > 0.6)
+              out.push_back(FeatureVoxel{x_global, subsection_elevation + 1, z_global, Voxel::grass});
+            else if (noise(x, z, noise_shift) > 0.7)
+              out.push_back(FeatureVoxel{x_global, subsection_elevation + 1, z_global, Voxel::sunflower});
+            else if (noise(x, z, 2 * noise_shift) > 0.7)
+              out.push_back(FeatureVoxel{x_global, subsection_elevation + 1, z_global, Voxel::roses});
+          }
+        } else if (column_landcover == LandCover::grass || column_landcover == LandCover::shrubs) {
+          if (noise(x, z) > 0.65)
+            out.push_back(FeatureVoxel{x_global, subsection_elevation + 1, z_global, Voxel::grass});
+        }
+      }
+    }
+  }
+} // namespace common
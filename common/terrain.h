@@ -0,0 +1,56 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <array>
+#include <vector>
+#include "common.h"
+#include "voxel.h"
+
+struct osn_context;
+
+// Chunk generation from sections, shared by the client's WorldGenerator and the server's ChunkGenerator
+// so both make the same voxels. Sections are chunk_sz_x by chunk_sz_z columns, x fastest
+namespace common {
+  // a voxel of a feature, in global coordinates
+  struct FeatureVoxel {
+    int x;
+    int y;
+    int z;
+    Voxel voxel;
+  };
+
+  // landcover holds landcover_tiles_per_sector tiles, x and z are a column in the section
+  LandCover get_landcover(const LandCover* landcover, int x, int z);
+  // what the ground under a column of this landcover is made of
+  Voxel get_ground_voxel(LandCover landcover);
+  // the height of each of a section's columns, blended from its elevation and its neighbours'.
+  // elevations[(dx + 1) + 3 * (dz + 1)] is the section dx, dz away
+  void compute_subsection_elevations(const std::array<int, 9>& elevations, std::vector<int>& out);
+  // the tree rooted at x, y, z, seeded by its position so every chunk it reaches into builds the same one
+  void build_tree(int x, int y, int z, std::vector<FeatureVoxel>& out);
+
+  // Trees, flowers and grass on top of the ground. generate is safe to call from any number of threads
+  class FeatureGenerator {
+  public:
+    FeatureGenerator();
+    ~FeatureGenerator();
+    FeatureGenerator(const FeatureGenerator& other) = delete;
+    FeatureGenerator& operator=(const FeatureGenerator& other) = delete;
+
+    // appends the features of the section at section_x, section_z. They can reach into neighbouring chunks
+    void generate(
+      int section_x, int section_z, const LandCover* landcover, const std::vector<int>& subsection_elevations,
+      std::vector<FeatureVoxel>& out) const;
+
+  private:
+    double noise(double x, double y, double shift = 0) const;
+
+    osn_context* grass_noise_;
+    // where trees can take root, tiled over the world
+    std::vector<bool> tree_roots_;
+    static constexpr int tree_root_grid_sz_x = 128;
+    static constexpr int tree_root_grid_sz_z = 128;
+  };
+} // namespace common
+
+#endif
@@ -36,6 +36,12 @@ enum class Voxel {
   voxel_enum_size
 };
 
+// one voxel of a chunk set to a new value, index as in Chunk::get_index
+struct VoxelEdit {
+  std::uint16_t index;
+  Voxel voxel;
+};
+
 namespace vops {
   bool is_empty(Voxel v);
   bool is_water(Voxel v);
@@ -0,0 +1,82 @@
+#include "write_queue.h"
+
+namespace common {
+  WriteQueue::WriteQueue(std::size_t soft_limit, std::size_t hard_limit)
+      : soft_limit_(soft_limit), hard_limit_(hard_limit) {
+    in_flight_.reserve(max_batch_messages);
+  }
+
+  bool WriteQueue::push(MessageBuffer message) {
+    queued_bytes_ += message.size();
+    pending_.push_back(std::move(message));
+    return !is_writing();
+  }
+
+  const std::vector<MessageBuffer>& WriteQueue::start_batch() {
+    std::size_t batch_bytes = 0;
+    while (!pending_.empty() && in_flight_.size() < max_batch_messages) {
+      auto size = pending_.front().size();
+      // always take at least one, a single message may be bigger than a batch
+      if (!in_flight_.empty() && batch_bytes + size > max_batch_bytes)
+        break;
+      batch_bytes += size;
+      in_flight_.push_back(std::move(pending_.front()));
+      pending_.pop_front();
+    }
+    in_flight_bytes_ = batch_bytes;
+    return in_flight_;
+  }
+
+  bool WriteQueue::finish_batch() {
+    ++batches_written_;
+    messages_written_ += in_flight_.size();
+    bytes_written_ += in_flight_bytes_;
+    queued_bytes_ -= in_flight_bytes_;
+    in_flight_bytes_ = 0;
+    in_flight_.clear();
+    return !pending_.empty();
+  }
+
+  void WriteQueue::clear() {
+    pending_.clear();
+    in_flight_.clear();
+    queued_bytes_ = 0;
+    in_flight_bytes_ = 0;
+  }
+
+  bool WriteQueue::is_writing() const {
+    return !in_flight_.empty();
+  }
+
+  bool WriteQueue::over_soft_limit() const {
+    return queued_bytes_ > soft_limit_;
+  }
+
+  bool WriteQueue::over_hard_limit() const {
+    return queued_bytes_ > hard_limit_;
+  }
+
+  bool WriteQueue::drained() const {
+    return queued_bytes_ <= soft_limit_ / 2;
+  }
+
+  std::size_t WriteQueue::get_queued_bytes() const {
+    return queued_bytes_;
+  }
+
+  std::size_t WriteQueue::get_queued_messages() const {
+    return pending_.size() + in_flight_.size();
+  }
+
+  std::uint64_t WriteQueue::get_batches_written() const {
+    return batches_written_;
+  }
+
+  std::uint64_t WriteQueue::get_messages_written() const {
+    return messages_written_;
+  }
+
+  std::uint64_t WriteQueue::get_bytes_written() const {
+    return bytes_written_;
+  }
+} // namespace common
@@ -0,0 +1,56 @@
+#ifndef WRITE_QUEUE_H
+#define WRITE_QUEUE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include "message_buffer.h"
+
+namespace common {
+  // Outbound messages of one socket. Owns every queued buffer until its write completes and hands out
+  // at most one batch at a time, so there is never more than one write in flight. Not thread safe,
+  // writes are meant to be posted to the socket's io thread and the queue only touched from there
+  class WriteQueue {
+  public:
+    // past the soft limit the owner should stop producing (e.g. stop reading requests),
+    // past the hard limit the peer is considered too slow and the connection dropped
+    WriteQueue(std::size_t soft_limit, std::size_t hard_limit);
+
+    // returns true if nothing is in flight and the caller should start_batch() and write it
+    bool push(MessageBuffer message);
+    // moves the oldest queued messages into the in flight batch, bounded by max_batch_messages and max_batch_bytes
+    const std::vector<MessageBuffer>& start_batch();
+    // releases the in flight batch, returns true if more messages are waiting
+    bool finish_batch();
+    void clear();
+
+    bool is_writing() const;
+    bool over_soft_limit() const;
+    bool over_hard_limit() const;
+    // below half the soft limit, to resume producing with some hysteresis
+    bool drained() const;
+    std::size_t get_queued_bytes() const;
+    std::size_t get_queued_messages() const;
+    std::uint64_t get_batches_written() const;
+    std::uint64_t get_messages_written() const;
+    std::uint64_t get_bytes_written() const;
+
+    static constexpr std::size_t max_batch_messages = 64;
+    static constexpr std::size_t max_batch_bytes = 1024 * 1024;
+
+  private:
+    std::deque<MessageBuffer> pending_;
+    std::vector<MessageBuffer> in_flight_;
+    std::size_t soft_limit_;
+    std::size_t hard_limit_;
+    // pending and in flight
+    std::size_t queued_bytes_ = 0;
+    std::size_t in_flight_bytes_ = 0;
+    std::uint64_t batches_written_ = 0;
+    std::uint64_t messages_written_ = 0;
+    std::uint64_t bytes_written_ = 0;
+  };
+} // namespace common
+
+#endif
@@ -0,0 +1,470 @@
+#ifdef _WIN32
+#include <SDKDDKVer.h>
+#endif
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <asio.hpp>
+#include "common.h"
+#include "common_generated.h"
+#include "handshake_generated.h"
+#include "message_buffer.h"
+#include "request_generated.h"
+#include "update_generated.h"
+#include "write_queue.h"
+
+// Spreads the world over several server processes on one machine. Every client connection gets its own
+// connection to each backend, so epochs, interest and edit replication work per backend as they would on a
+// single server. Requests are split by which backend owns each section and the replies merged back: batches
+// are passed on as they arrive and only the last backend to finish a request has its final batch go out
+// with more unset. Each request a backend gets carries a tag of the gateway's, which the backend echoes in
+// every batch of its reply, since backends can finish requests out of order. Backends own square blocks of sections so the tiles each one caches stay on it
+//   gateway port host:port...
+// e.g. with backends started as server - - 7332 and server - - 7333
+//   gateway 7331 127.0.0.1:7332 127.0.0.1:7333
+// Pointing loadgen at the gateway with 1, 2 and 4 backends sharing a tile_dir shows how sections/s scales
+
+using asio::ip::tcp;
+using Message = common::MessageBuffer;
+
+namespace {
+  // blocks of 8x8 sections, a client's window spans a handful of them
+  constexpr int shard_block_bits = 3;
+  constexpr std::size_t write_queue_soft_limit = 8 * 1024 * 1024;
+  constexpr std::size_t write_queue_hard_limit = 2 * common::max_message_size;
+  constexpr std::size_t client_link = 0;
+
+  std::size_t get_shard(int x, int z, std::size_t num_backends) {
+    // shifts floor, so blocks line up across zero
+    auto block_x = static_cast<std::uint32_t>(x >> shard_block_bits);
+    auto block_z = static_cast<std::uint32_t>(z >> shard_block_bits);
+    return common::Hash(block_x * 73856093u ^ block_z * 19349663u) % num_backends;
+  }
+
+  // what one backend gets of a request
+  struct Split {
+    std::vector<fbs_common::Location2D> sections;
+    std::vector<std::uint16_t> priorities;
+    std::vector<fbs_common::Location> chunks;
+    std::vector<const fbs_common::ChunkEdits*> edits;
+    std::vector<fbs_common::Location2D> released_sections;
+    std::vector<fbs_common::Location> released_chunks;
+    std::vector<fbs_common::Location2D> held_sections;
+
+    bool has_other() const {
+      return !chunks.empty() || !edits.empty() || !released_sections.empty() || !released_chunks.empty() ||
+             !held_sections.empty();
+    }
+  };
+
+  // a socket and what's queued on it, only touched on its session's strand
+  struct Link {
+    explicit Link(tcp::socket&& socket)
+        : socket(std::move(socket)), write_queue(write_queue_soft_limit, write_queue_hard_limit) {}
+
+    tcp::socket socket;
+    common::WriteQueue write_queue;
+    std::vector<asio::const_buffer> write_buffers;
+    std::array<std::uint8_t, common::frame_header_length> header_buffer;
+    // header and body, so replies can be passed on untouched
+    Message frame;
+  };
+
+  Message finish(flatbuffers::FlatBufferBuilder& builder) {
+    return common::MessagePool::instance()->acquire(builder.GetBufferPointer(), builder.GetSize());
+  }
+
+  // One client and its connections to the backends. Every socket shares the client's strand
+  class Session : public std::enable_shared_from_this<Session> {
+  public:
+    Session(tcp::socket&& socket, const std::vector<tcp::resolver::results_type>& backends)
+        : backends_(backends) {
+      auto executor = socket.get_executor();
+      links_.push_back(std::make_unique<Link>(std::move(socket)));
+      for (std::size_t i = 0; i < backends_.size(); ++i)
+        links_.push_back(std::make_unique<Link>(tcp::socket(executor)));
+    }
+
+    // the client is only read once every backend is connected
+    void start() {
+      asio::error_code ignored_error;
+      links_[client_link]->socket.set_option(tcp::no_delay(true), ignored_error);
+      for (std::size_t backend = 0; backend < backends_.size(); ++backend) {
+        asio::async_connect(
+          links_[backend + 1]->socket, backends_[backend],
+          [self = shared_from_this(), backend](const asio::error_code& error, const tcp::endpoint&) {
+            if (error) {
+              std::cerr << "couldn't reach backend " << backend << ": " << error.message() << std::endl;
+              self->close();
+              return;
+            }
+            asio::error_code ignored_error;
+            self->links_[backend + 1]->socket.set_option(tcp::no_delay(true), ignored_error);
+            self->read_header(backend + 1);
+            if (++self->num_connected_ == self->backends_.size())
+              self->read_header(client_link);
+          });
+      }
+    }
+
+  private:
+    struct PendingReply {
+      // backends that haven't sent their final batch
+      std::size_t remaining;
+      // what the client tagged the request with, put back on the batches before they're passed on
+      std::uint64_t client_tag;
+    };
+
+    void read_header(std::size_t index) {
+      auto& link = *links_[index];
+      asio::async_read(
+        link.socket, asio::buffer(link.header_buffer),
+        [self = shared_from_this(), index](const asio::error_code& error, std::size_t) {
+          if (error) {
+            self->close();
+            return;
+          }
+          self->read_body(index);
+        });
+    }
+
+    void read_body(std::size_t index) {
+      if (closed_)
+        return;
+      auto& link = *links_[index];
+      auto header = common::decode_frame_header(link.header_buffer.data());
+      if (header.length > common::max_message_size) {
+        std::cerr << "closing session, bad frame of " << header.length << " bytes" << std::endl;
+        close();
+        return;
+      }
+      link.frame = common::MessagePool::instance()->acquire(common::frame_header_length + header.length);
+      std::copy(link.header_buffer.begin(), link.header_buffer.end(), link.frame.data());
+      asio::async_read(
+        link.socket, asio::buffer(link.frame.data() + common::frame_header_length, header.length),
+        [self = shared_from_this(), index](const asio::error_code& error, std::size_t) {
+          if (error) {
+            self->close();
+            return;
+          }
+          auto frame = std::move(self->links_[index]->frame);
+          if (index == client_link)
+            self->handle_request(frame);
+          else
+            self->handle_reply(index - 1, frame);
+          if (!self->closed_)
+            self->read_header(index);
+        });
+    }
+
+    void send(std::size_t index, const Message& frame) {
+      if (closed_)
+        return;
+      auto& link = *links_[index];
+      bool idle = link.write_queue.push(frame);
+      if (link.write_queue.over_hard_limit()) {
+        std::cerr << "closing session, " << link.write_queue.get_queued_bytes() << " bytes queued" << std::endl;
+        close();
+        return;
+      }
+      if (idle)
+        start_write(index);
+    }
+
+    void start_write(std::size_t index) {
+      auto& link = *links_[index];
+      auto& batch = link.write_queue.start_batch();
+      link.write_buffers.clear();
+      for (auto& message : batch)
+        link.write_buffers.push_back(asio::buffer(message.data(), message.size()));
+      asio::async_write(
+        link.socket, link.write_buffers,
+        [self = shared_from_this(), index](const asio::error_code& error, std::size_t) {
+          if (error) {
+            self->close();
+            return;
+          }
+          if (self->links_[index]->write_queue.finish_batch() && !self->closed_)
+            self->start_write(index);
+        });
+    }
+
+    void close() {
+      if (closed_)
+        return;
+      closed_ = true;
+      asio::error_code ignored_error;
+      for (auto& link : links_)
+        link->socket.close(ignored_error);
+    }
+
+    void handle_request(const Message& frame) {
+      auto* body = frame.data() + common::frame_header_length;
+      auto size = frame.size() - common::frame_header_length;
+      bool first = !handshake_done_;
+      handshake_done_ = true;
+      // clients on this machine offer shared memory, the gateway only talks TCP
+      if (first && size >= 8 && fbs_handshake::HandshakeBufferHasIdentifier(body)) {
+        flatbuffers::FlatBufferBuilder builder(64);
+        auto welcome = fbs_handshake::CreateWelcome(builder, false);
+        auto handshake = fbs_handshake::CreateHandshake(builder, fbs_handshake::HandshakeKind_Welcome, welcome.Union());
+        fbs_handshake::FinishSizePrefixedHandshakeBuffer(builder, handshake);
+        send(client_link, finish(builder));
+        return;
+      }
+
+      flatbuffers::Verifier verifier(body, size);
+      if (!fbs_request::VerifyRequestBuffer(verifier)) {
+        std::cerr << "dropping malformed request" << std::endl;
+        return;
+      }
+      auto* request = fbs_request::GetRequest(body);
+      auto num_backends = backends_.size();
+      std::vector<Split> splits(num_backends);
+
+      auto* sections = request->sections();
+      auto* priorities = request->priorities();
+      std::size_t num_sections = sections ? sections->size() : 0;
+      bool prioritised = priorities && priorities->size() == num_sections;
+      for (std::size_t i = 0; i < num_sections; ++i) {
+        auto* loc = sections->Get(i);
+        auto& split = splits[get_shard(loc->x(), loc->y(), num_backends)];
+        split.sections.push_back(*loc);
+        if (prioritised)
+          split.priorities.push_back(priorities->Get(i));
+      }
+      if (auto* chunks = request->chunks()) {
+        for (std::size_t i = 0; i < chunks->size(); ++i) {
+          auto* loc = chunks->Get(i);
+          splits[get_shard(loc->x(), loc->z(), num_backends)].chunks.push_back(*loc);
+        }
+      }
+      if (auto* edits = request->edits()) {
+        for (std::size_t i = 0; i < edits->size(); ++i) {
+          auto* chunk = edits->Get(i);
+          if (auto* loc = chunk->location())
+            splits[get_shard(loc->x(), loc->z(), num_backends)].edits.push_back(chunk);
+        }
+      }
+      if (auto* released = request->released_sections()) {
+        for (std::size_t i = 0; i < released->size(); ++i) {
+          auto* loc = released->Get(i);
+          splits[get_shard(loc->x(), loc->y(), num_backends)].released_sections.push_back(*loc);
+        }
+      }
+      if (auto* released = request->released_chunks()) {
+        for (std::size_t i = 0; i < released->size(); ++i) {
+          auto* loc = released->Get(i);
+          splits[get_shard(loc->x(), loc->z(), num_backends)].released_chunks.push_back(*loc);
+        }
+      }
+      if (auto* held = request->held_sections()) {
+        for (std::size_t i = 0; i < held->size(); ++i) {
+          auto* loc = held->Get(i);
+          splits[get_shard(loc->x(), loc->y(), num_backends)].held_sections.push_back(*loc);
+        }
+      }
+
+      // same rule as SimServer::handle_request
+      bool has_chunks = request->chunks() && request->chunks()->size() > 0;
+      bool replication_only =
+        request->edits() || request->released_sections() || request->released_chunks() || request->held_sections();
+      bool wants_sections = num_sections > 0 || (!has_chunks && !replication_only);
+      std::uint64_t tag = wants_sections ? next_tag_++ : 0;
+
+      for (std::size_t backend = 0; backend < num_backends; ++backend) {
+        auto& split = splits[backend];
+        // replication and chunks go first and on their own, so a backend with none of the sections still
+        // gets a request that answers with its final batch and cancels its older work under the new epoch
+        if (split.has_other())
+          send(backend + 1, build_other(split));
+        if (wants_sections)
+          send(backend + 1, build_sections(split, prioritised, request->epoch(), tag));
+      }
+      if (wants_sections)
+        pending_[tag] = PendingReply{num_backends, request->tag()};
+    }
+
+    Message build_other(const Split& split) {
+      flatbuffers::FlatBufferBuilder builder(common::max_msg_buffer_size);
+      // vectors are only written when there's something in them, their presence means something to the server
+      flatbuffers::Offset<flatbuffers::Vector<const fbs_common::Location*>> chunks, released_chunks;
+      flatbuffers::Offset<flatbuffers::Vector<const fbs_common::Location2D*>> released_sections, held_sections;
+      flatbuffers::Offset<flatbuffers::Vector<flatbuffers::Offset<fbs_common::ChunkEdits>>> edits;
+      if (!split.chunks.empty())
+        chunks = builder.CreateVectorOfStructs(split.chunks);
+      if (!split.released_chunks.empty())
+        released_chunks = builder.CreateVectorOfStructs(split.released_chunks);
+      if (!split.released_sections.empty())
+        released_sections = builder.CreateVectorOfStructs(split.released_sections);
+      if (!split.held_sections.empty())
+        held_sections = builder.CreateVectorOfStructs(split.held_sections);
+      if (!split.edits.empty()) {
+        std::vector<flatbuffers::Offset<fbs_common::ChunkEdits>> chunk_edits;
+        std::vector<fbs_common::VoxelEdit> voxels;
+        chunk_edits.reserve(split.edits.size());
+        for (auto* chunk : split.edits) {
+          voxels.clear();
+          if (auto* voxel_edits = chunk->edits()) {
+            for (std::size_t i = 0; i < voxel_edits->size(); ++i)
+              voxels.push_back(*voxel_edits->Get(i));
+          }
+          auto voxels_vector = builder.CreateVectorOfStructs(voxels);
+          chunk_edits.push_back(fbs_common::CreateChunkEdits(builder, chunk->location(), voxels_vector));
+        }
+        edits = builder.CreateVector(chunk_edits);
+      }
+      auto request = fbs_request::CreateRequest(
+        builder, 0, chunks, edits, released_sections, released_chunks, 0, 0, held_sections);
+      fbs_request::FinishSizePrefixedRequestBuffer(builder, request);
+      return finish(builder);
+    }
+
+    Message build_sections(const Split& split, bool prioritised, std::uint64_t epoch, std::uint64_t tag) {
+      flatbuffers::FlatBufferBuilder builder(common::max_msg_buffer_size);
+      auto sections = builder.CreateVectorOfStructs(split.sections);
+      flatbuffers::Offset<flatbuffers::Vector<std::uint16_t>> priorities;
+      if (prioritised)
+        priorities = builder.CreateVector(split.priorities);
+      auto request = fbs_request::CreateRequest(builder, sections, 0, 0, 0, 0, priorities, epoch, 0, tag);
+      fbs_request::FinishSizePrefixedRequestBuffer(builder, request);
+      return finish(builder);
+    }
+
+    void handle_reply(std::size_t backend, Message& frame) {
+      auto* body = frame.data() + common::frame_header_length;
+      auto size = frame.size() - common::frame_header_length;
+      flatbuffers::Verifier verifier(body, size);
+      if (!fbs_update::VerifyUpdateBuffer(verifier)) {
+        std::cerr << "dropping malformed reply from backend " << backend << std::endl;
+        return;
+      }
+      auto* update = fbs_update::GetMutableUpdate(body);
+      // chunks and edits go straight through
+      if (update->kind_type() != fbs_update::UpdateKind_Sections) {
+        send(client_link, frame);
+        return;
+      }
+      auto* batch = static_cast<fbs_update::SectionBatch*>(update->mutable_kind());
+      auto it = pending_.find(batch->tag());
+      if (it == pending_.end()) {
+        std::cerr << "dropping batch for unknown request " << batch->tag() << " from backend " << backend << std::endl;
+        return;
+      }
+      // the gateway's tags are never 0, so the field is always there to be written over in place
+      batch->mutate_tag(it->second.client_tag);
+      if (batch->more()) {
+        send(client_link, frame);
+        return;
+      }
+
+      bool last = --it->second.remaining == 0;
+      if (last) {
+        pending_.erase(it);
+        send(client_link, frame);
+      } else if (batch->count() > 0 || (batch->failed() && batch->failed()->size() > 0)) {
+        send(client_link, build_batch(*batch, true));
+      }
+    }
+
+    Message build_batch(const fbs_update::SectionBatch& batch, bool more) {
+      flatbuffers::FlatBufferBuilder builder(common::max_msg_buffer_size);
+      auto origin = batch.origin() ? *batch.origin() : fbs_common::Location2D(0, 0);
+      flatbuffers::Offset<flatbuffers::Vector<std::uint8_t>> coords, landcover;
+      flatbuffers::Offset<flatbuffers::Vector<std::int16_t>> elevations;
+      if (batch.coords())
+        coords = builder.CreateVector(batch.coords()->data(), batch.coords()->size());
+      if (batch.elevations())
+        elevations = builder.CreateVector(batch.elevations()->data(), batch.elevations()->size());
+      if (batch.landcover())
+        landcover = builder.CreateVector(batch.landcover()->data(), batch.landcover()->size());
+      flatbuffers::Offset<flatbuffers::Vector<const fbs_common::Location2D*>> failed;
+      if (batch.failed()) {
+        std::vector<fbs_common::Location2D> failed_sections;
+        for (std::size_t i = 0; i < batch.failed()->size(); ++i)
+          failed_sections.push_back(*batch.failed()->Get(i));
+        failed = builder.CreateVectorOfStructs(failed_sections);
+      }
+      auto section_batch = fbs_update::CreateSectionBatch(
+        builder, &origin, batch.count(), coords, elevations, landcover, more, batch.tag(), failed);
+      auto update = fbs_update::CreateUpdate(builder, fbs_update::UpdateKind_Sections, section_batch.Union());
+      fbs_update::FinishSizePrefixedUpdateBuffer(builder, update);
+      return finish(builder);
+    }
+
+    const std::vector<tcp::resolver::results_type>& backends_;
+    // the client, then one per backend
+    std::vector<std::unique_ptr<Link>> links_;
+    std::size_t num_connected_ = 0;
+    bool handshake_done_ = false;
+    bool closed_ = false;
+    // section requests still being answered, by the tag they were sent to the backends with
+    std::unordered_map<std::uint64_t, PendingReply> pending_;
+    std::uint64_t next_tag_ = 1;
+  };
+
+  class Gateway {
+  public:
+    Gateway(asio::io_context& io_context, unsigned short port, std::vector<tcp::resolver::results_type> backends)
+        : io_context_(io_context), acceptor_(io_context, tcp::endpoint(tcp::v4(), port)), backends_(std::move(backends)) {
+      start_accept();
+    }
+
+  private:
+    void start_accept() {
+      acceptor_.async_accept(asio::make_strand(io_context_), [this](const asio::error_code& error, tcp::socket socket) {
+        if (!error)
+          std::make_shared<Session>(std::move(socket), backends_)->start();
+        start_accept();
+      });
+    }
+
+    asio::io_context& io_context_;
+    tcp::acceptor acceptor_;
+    std::vector<tcp::resolver::results_type> backends_;
+  };
+} // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc < 3) {
+    std::cerr << "usage: gateway port host:port..." << std::endl;
+    return 1;
+  }
+  auto port = static_cast<unsigned short>(std::atoi(argv[1]));
+
+  asio::io_context io_context;
+  tcp::resolver resolver(io_context);
+  std::vector<tcp::resolver::results_type> backends;
+  for (int i = 2; i < argc; ++i) {
+    std::string address = argv[i];
+    auto colon = address.rfind(':');
+    if (colon == std::string::npos) {
+      std::cerr << "expected host:port, got " << address << std::endl;
+      return 1;
+    }
+    try {
+      backends.push_back(resolver.resolve(address.substr(0, colon), address.substr(colon + 1)));
+    } catch (const std::exception& e) {
+      std::cerr << "couldn't resolve " << address << ": " << e.what() << std::endl;
+      return 1;
+    }
+  }
+
+  Gateway gateway(io_context, port, std::move(backends));
+  std::cout << "Routing port " << port << " to " << argc - 2 << " backends" << std::endl;
+
+  unsigned int num_threads = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<std::thread> threads;
+  for (unsigned int i = 0; i < num_threads; ++i)
+    threads.emplace_back([&io_context] { io_context.run(); });
+  for (auto& thread : threads)
+    thread.join();
+  return 0;
+}
@@ -0,0 +1,663 @@
+#ifdef _WIN32
+#include <SDKDDKVer.h>
+#endif
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include <asio.hpp>
+#include "common.h"
+#include "common_generated.h"
+#include "compression.h"
+#include "handshake_generated.h"
+#include "latency_histogram.h"
+#include "message_buffer.h"
+#include "section_batch.h"
+#include "request_generated.h"
+#include "shm_transport.h"
+#include "update_generated.h"
+
+// Opens many connections to a section server and replays what a moving client would request.
+// Each connection keeps one request in flight, like Sim::request_sections does when the player crosses a chunk.
+// Sections come back in batches, a request is done once the last batch is in
+//   loadgen [clients] [seconds] [spiral|line|teleport|mixed] [host] [port] [interval_ms] [tcp|shm] [none|lz] [x] [z] [range]
+// interval_ms is the think time between requests, 0 sends the next one as soon as the reply arrives.
+// shm asks the server to move each connection to shared memory like the client does, it needs the same host.
+// lz asks for compressed frames, bytes on the wire are then reported against the time spent decompressing
+// Clients start, teleport and wander within range sections of x,z. The defaults cover the whole generated world,
+// against a tile directory pick the area its tiles cover. Sections the server reports as failed are counted apart
+// from the ones that never arrived and don't fail the run
+// Every run also checks ordering. Each batch must carry the tag of the request in flight and arrive before that
+// request's final batch, and each section must be one that was asked for and not already sent
+
+using asio::ip::tcp;
+using Clock = std::chrono::steady_clock;
+using Location2D = std::array<int, 2>;
+
+namespace {
+  // mirror the client's streaming window, see Sim::section_distance
+  constexpr int section_distance = 7;
+  constexpr int default_range = 100000;
+  constexpr std::size_t max_known_sections = 20000;
+
+  enum class Pattern {
+    spiral,
+    line,
+    teleport,
+  };
+
+  const char* get_pattern_name(Pattern pattern) {
+    switch (pattern) {
+    case Pattern::spiral:
+      return "spiral";
+    case Pattern::line:
+      return "line";
+    case Pattern::teleport:
+      return "teleport";
+    default:
+      return "unknown";
+    }
+  }
+
+  struct Location2DHash {
+    std::size_t operator()(const Location2D& l) const noexcept {
+      return std::hash<std::uint64_t>{}((static_cast<std::uint64_t>(static_cast<std::uint32_t>(l[0])) << 32) | static_cast<std::uint32_t>(l[1]));
+    }
+  };
+
+  struct Stats {
+    common::LatencyHistogram latency_us;
+    // time to the first batch, when the nearest sections arrive
+    common::LatencyHistogram first_batch_us;
+    std::atomic<std::uint64_t> requests{0};
+    std::atomic<std::uint64_t> sections{0};
+    std::atomic<std::uint64_t> bytes_sent{0};
+    std::atomic<std::uint64_t> bytes_received{0};
+    // replies as the client sees them, after decompression
+    std::atomic<std::uint64_t> bytes_decompressed{0};
+    std::atomic<std::uint64_t> compressed_replies{0};
+    std::atomic<std::uint64_t> decompress_ns{0};
+    std::atomic<std::uint64_t> connect_errors{0};
+    std::atomic<std::uint64_t> io_errors{0};
+    std::atomic<std::uint64_t> malformed_replies{0};
+    // sections the server couldn't load or generate and said so
+    std::atomic<std::uint64_t> failed_sections{0};
+    // sections neither sent nor reported failed
+    std::atomic<std::uint64_t> missing_sections{0};
+    // batches tagged for a request other than the one in flight, or arriving after its final batch
+    std::atomic<std::uint64_t> misordered_batches{0};
+    // sections that weren't asked for, or were sent twice
+    std::atomic<std::uint64_t> unexpected_sections{0};
+    // connections the server kept on TCP after being offered shared memory
+    std::atomic<std::uint64_t> shm_declined{0};
+    // connections the server wouldn't compress for after being asked to
+    std::atomic<std::uint64_t> compression_declined{0};
+    std::atomic<int> active_clients{0};
+  };
+
+  class LoadClient : public std::enable_shared_from_this<LoadClient> {
+  public:
+    LoadClient(asio::io_context& io_context, Pattern pattern, std::uint32_t seed, Stats& stats,
+               Clock::time_point deadline, std::chrono::milliseconds interval, bool shared_memory, bool compression,
+               Location2D center, int range)
+        : socket_(asio::make_strand(io_context)), timer_(socket_.get_executor()), pattern_(pattern),
+          rng_(seed), stats_(stats), deadline_(deadline), interval_(interval), shared_memory_(shared_memory),
+          compression_(compression), center_(center), range_(range) {
+      restart();
+    }
+
+    void start(const tcp::resolver::results_type& endpoints) {
+      ++stats_.active_clients;
+      asio::async_connect(socket_, endpoints, [self = shared_from_this()](const asio::error_code& error, const tcp::endpoint&) {
+        if (error) {
+          ++self->stats_.connect_errors;
+          self->finish();
+          return;
+        }
+        asio::error_code ignored_error;
+        self->socket_.set_option(tcp::no_delay(true), ignored_error);
+        if (self->shared_memory_ || self->compression_)
+          self->send_hello();
+        else
+          self->send_next();
+      });
+    }
+
+  private:
+    // same handshake as TCPClient::handshake, the Welcome comes back through handle_reply
+    void send_hello() {
+      if (shared_memory_) {
+        channel_ = common::ShmChannel::create(common::ShmChannel::default_ring_size);
+        if (!channel_)
+          ++stats_.shm_declined;
+      }
+      if (!channel_ && !compression_) {
+        send_next();
+        return;
+      }
+      flatbuffers::FlatBufferBuilder builder(256);
+      flatbuffers::Offset<flatbuffers::String> shm_name;
+      if (channel_)
+        shm_name = builder.CreateString(channel_->get_name());
+      auto codec = compression_ ? fbs_handshake::Codec_Lz : fbs_handshake::Codec_None;
+      auto hello = fbs_handshake::CreateHello(builder, shm_name, codec);
+      auto handshake = fbs_handshake::CreateHandshake(builder, fbs_handshake::HandshakeKind_Hello, hello.Union());
+      fbs_handshake::FinishSizePrefixedHandshakeBuffer(builder, handshake);
+      request_ = common::MessagePool::instance()->acquire(builder.GetBufferPointer(), builder.GetSize());
+      handshaking_ = true;
+      asio::async_write(socket_, asio::buffer(request_.data(), request_.size()),
+                        [self = shared_from_this()](const asio::error_code& error, std::size_t) {
+                          if (error) {
+                            ++self->stats_.io_errors;
+                            self->finish();
+                            return;
+                          }
+                          self->read_header();
+                        });
+    }
+
+    void handle_welcome() {
+      handshaking_ = false;
+      flatbuffers::Verifier verifier(reply_.data(), reply_.size());
+      const fbs_handshake::Welcome* welcome = nullptr;
+      if (fbs_handshake::VerifyHandshakeBuffer(verifier))
+        welcome = fbs_handshake::GetHandshake(reply_.data())->kind_as_Welcome();
+      compress_ = welcome && welcome->codec() == fbs_handshake::Codec_Lz;
+      if (compression_ && !compress_ && !(welcome && welcome->shm()))
+        ++stats_.compression_declined;
+      if (!channel_) {
+        send_next();
+        return;
+      }
+      if (!welcome || !welcome->shm()) {
+        ++stats_.shm_declined;
+        channel_.reset();
+        send_next();
+        return;
+      }
+      // replies are handed back to the strand, the threads never keep the client alive
+      std::weak_ptr<LoadClient> weak = shared_from_this();
+      auto executor = socket_.get_executor();
+      shm_ = std::make_unique<common::ShmConnection>(
+        std::move(channel_),
+        2 * common::max_message_size,
+        [weak, executor](common::MessageBuffer body) {
+          asio::post(executor, [weak, body = std::move(body)]() mutable {
+            if (auto self = weak.lock()) {
+              // the channel already decompressed it
+              self->reply_ = std::move(body);
+              self->reply_flags_ = 0;
+              self->handle_reply();
+            }
+          });
+        },
+        [weak, executor] {
+          asio::post(executor, [weak] {
+            if (auto self = weak.lock(); self && !self->finished_) {
+              ++self->stats_.io_errors;
+              self->finish();
+            }
+          });
+        });
+      shm_->start();
+      send_next();
+    }
+
+    // over shared memory replies arrive by themselves
+    void next_reply() {
+      if (!shm_)
+        read_header();
+    }
+
+    // a random spot in the area, with a fresh heading and spiral
+    void restart() {
+      std::uniform_int_distribution<int> offset(-range_, range_);
+      position_ = {center_[0] + offset(rng_), center_[1] + offset(rng_)};
+      std::uniform_real_distribution<double> angle(0, 2 * 3.14159265358979);
+      heading_ = angle(rng_);
+      line_x_ = position_[0];
+      line_z_ = position_[1];
+      spiral_leg_ = 1;
+      spiral_steps_ = 0;
+      spiral_direction_ = 0;
+    }
+
+    void move() {
+      switch (pattern_) {
+      case Pattern::spiral: {
+        // square spiral around the start, one chunk per step
+        static constexpr std::array<std::array<int, 2>, 4> directions = {{{1, 0}, {0, 1}, {-1, 0}, {0, -1}}};
+        position_[0] += directions[spiral_direction_][0];
+        position_[1] += directions[spiral_direction_][1];
+        if (++spiral_steps_ == spiral_leg_) {
+          spiral_steps_ = 0;
+          spiral_direction_ = (spiral_direction_ + 1) % 4;
+          if (spiral_direction_ % 2 == 0)
+            ++spiral_leg_;
+        }
+      } break;
+      case Pattern::line: {
+        line_x_ += std::cos(heading_);
+        line_z_ += std::sin(heading_);
+        position_ = {static_cast<int>(std::floor(line_x_)), static_cast<int>(std::floor(line_z_))};
+      } break;
+      case Pattern::teleport: {
+        restart();
+        known_.clear();
+      } break;
+      }
+      // walking off the area starts over somewhere inside it
+      if (std::abs(position_[0] - center_[0]) > range_ || std::abs(position_[1] - center_[1]) > range_) {
+        restart();
+        known_.clear();
+      }
+      if (known_.size() > max_known_sections) {
+        std::erase_if(known_, [this](const Location2D& loc) {
+          return std::abs(loc[0] - position_[0]) > 2 * section_distance || std::abs(loc[1] - position_[1]) > 2 * section_distance;
+        });
+      }
+    }
+
+    // same window Sim::step requests when the player changes chunk
+    std::vector<Location2D> get_missing_sections() {
+      std::vector<Location2D> locs;
+      for (int x = -section_distance; x < section_distance; ++x) {
+        for (int z = -section_distance; z < section_distance; ++z) {
+          auto location = Location2D{position_[0] + x, position_[1] + z};
+          if (known_.insert(location).second)
+            locs.push_back(location);
+        }
+      }
+      return locs;
+    }
+
+    void send_next() {
+      if (Clock::now() >= deadline_) {
+        finish();
+        return;
+      }
+      std::vector<Location2D> locs;
+      while (locs.empty()) {
+        move();
+        locs = get_missing_sections();
+      }
+      requested_ = locs.size();
+      received_ = 0;
+      failed_ = 0;
+      first_batch_ = true;
+      pending_.clear();
+      pending_.insert(locs.begin(), locs.end());
+
+      // nearest first, like the client
+      std::sort(locs.begin(), locs.end(), [this](const Location2D& a, const Location2D& b) {
+        return distance_squared(a) < distance_squared(b);
+      });
+      flatbuffers::FlatBufferBuilder builder(common::max_msg_buffer_size);
+      std::vector<fbs_common::Location2D> locations;
+      std::vector<std::uint16_t> priorities;
+      locations.reserve(locs.size());
+      priorities.reserve(locs.size());
+      for (auto& loc : locs) {
+        locations.emplace_back(loc[0], loc[1]);
+        priorities.push_back(static_cast<std::uint16_t>(std::sqrt(distance_squared(loc)) * 16));
+      }
+      auto sections = builder.CreateVectorOfStructs(locations);
+      auto priorities_vector = builder.CreateVector(priorities);
+      // the epoch is new for every request, so it doubles as the tag
+      ++epoch_;
+      in_flight_tag_ = epoch_;
+      auto request = fbs_request::CreateRequest(builder, sections, 0, 0, 0, 0, priorities_vector, epoch_, 0, epoch_);
+      fbs_request::FinishSizePrefixedRequestBuffer(builder, request);
+      request_ = common::MessagePool::instance()->acquire(builder.GetBufferPointer(), builder.GetSize());
+      if (compress_)
+        request_ = common::compress_frame(request_);
+
+      sent_at_ = Clock::now();
+      if (shm_) {
+        stats_.bytes_sent += request_.size();
+        shm_->write(request_);
+        return;
+      }
+      asio::async_write(socket_, asio::buffer(request_.data(), request_.size()),
+                        [self = shared_from_this()](const asio::error_code& error, std::size_t bytes) {
+                          if (error) {
+                            ++self->stats_.io_errors;
+                            self->finish();
+                            return;
+                          }
+                          self->stats_.bytes_sent += bytes;
+                          self->read_header();
+                        });
+    }
+
+    void read_header() {
+      asio::async_read(socket_, asio::buffer(header_buffer_), [self = shared_from_this()](const asio::error_code& error, std::size_t) {
+        if (error) {
+          ++self->stats_.io_errors;
+          self->finish();
+          return;
+        }
+        auto header = common::decode_frame_header(self->header_buffer_.data());
+        if (header.length > common::max_message_size) {
+          ++self->stats_.malformed_replies;
+          self->finish();
+          return;
+        }
+        self->reply_ = common::MessagePool::instance()->acquire(header.length);
+        self->reply_flags_ = header.flags;
+        self->read_body();
+      });
+    }
+
+    void read_body() {
+      asio::async_read(socket_, asio::buffer(reply_.data(), reply_.size()), [self = shared_from_this()](const asio::error_code& error, std::size_t) {
+        if (error) {
+          ++self->stats_.io_errors;
+          self->finish();
+          return;
+        }
+        self->handle_reply();
+      });
+    }
+
+    void handle_reply() {
+      if (finished_)
+        return;
+      if (handshaking_) {
+        handle_welcome();
+        return;
+      }
+      auto latency = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - sent_at_).count();
+      stats_.bytes_received += common::frame_header_length + reply_.size();
+      if (reply_flags_ & common::frame_flag_compressed) {
+        auto start = Clock::now();
+        bool decompressed = common::decompress_body(reply_flags_, reply_);
+        stats_.decompress_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+        ++stats_.compressed_replies;
+        if (!decompressed) {
+          ++stats_.malformed_replies;
+          finish();
+          return;
+        }
+      }
+      stats_.bytes_decompressed += common::frame_header_length + reply_.size();
+
+      flatbuffers::Verifier verifier(reply_.data(), reply_.size());
+      if (!fbs_update::VerifyUpdateBuffer(verifier)) {
+        ++stats_.malformed_replies;
+        finish();
+        return;
+      }
+      auto* update = fbs_update::GetUpdate(reply_.data());
+      std::size_t received = 0;
+      bool more = false;
+      if (auto* batch = update->kind_as_Sections()) {
+        if (batch->tag() != in_flight_tag_) {
+          ++stats_.misordered_batches;
+          next_reply();
+          return;
+        }
+        received = batch->count();
+        more = batch->more();
+        if (!check_sections(*batch)) {
+          ++stats_.malformed_replies;
+          finish();
+          return;
+        }
+      } else if (auto* region = update->kind_as_Region()) {
+        received = region->sections() ? region->sections()->size() : 0;
+        more = region->more();
+      } else {
+        // edits other clients make in view aren't part of the request
+        next_reply();
+        return;
+      }
+      received_ += received;
+      stats_.sections += received;
+      if (first_batch_) {
+        stats_.first_batch_us.record(latency);
+        first_batch_ = false;
+      }
+      if (more) {
+        next_reply();
+        return;
+      }
+      stats_.failed_sections += failed_;
+      if (received_ + failed_ < requested_)
+        stats_.missing_sections += requested_ - received_ - failed_;
+      // anything still tagged for this request is now out of order
+      in_flight_tag_ = 0;
+
+      stats_.latency_us.record(latency);
+      ++stats_.requests;
+
+      if (interval_.count() == 0) {
+        send_next();
+        return;
+      }
+      timer_.expires_after(interval_);
+      timer_.async_wait([self = shared_from_this()](const asio::error_code& error) {
+        if (error)
+          self->finish();
+        else
+          self->send_next();
+      });
+    }
+
+    // takes the batch's sections and failures off pending_, false if its coordinates don't decode
+    bool check_sections(const fbs_update::SectionBatch& batch) {
+      auto count = batch.count();
+      if (count > 0) {
+        auto* origin = batch.origin();
+        auto* coords = batch.coords();
+        if (!origin || !coords)
+          return false;
+        xs_.resize(count);
+        zs_.resize(count);
+        if (!common::decode_section_coords({coords->data(), coords->size()}, origin->x(), origin->y(), xs_, zs_))
+          return false;
+        for (std::uint32_t i = 0; i < count; ++i) {
+          if (pending_.erase(Location2D{xs_[i], zs_[i]}) == 0)
+            ++stats_.unexpected_sections;
+        }
+      }
+      if (auto* failed = batch.failed()) {
+        for (std::uint32_t i = 0; i < failed->size(); ++i) {
+          auto* loc = failed->Get(i);
+          if (pending_.erase(Location2D{loc->x(), loc->y()}) == 0)
+            ++stats_.unexpected_sections;
+          else
+            ++failed_;
+        }
+      }
+      return true;
+    }
+
+    int distance_squared(const Location2D& loc) const {
+      int dx = loc[0] - position_[0];
+      int dz = loc[1] - position_[1];
+      return dx * dx + dz * dz;
+    }
+
+    void finish() {
+      if (finished_)
+        return;
+      finished_ = true;
+      if (shm_)
+        shm_->close();
+      asio::error_code ignored_error;
+      socket_.close(ignored_error);
+      --stats_.active_clients;
+    }
+
+    tcp::socket socket_;
+    asio::steady_timer timer_;
+    Pattern pattern_;
+    std::mt19937 rng_;
+    Stats& stats_;
+    Clock::time_point deadline_;
+    std::chrono::milliseconds interval_;
+    bool shared_memory_;
+    bool compression_;
+    // clients stay within range_ sections of center_
+    Location2D center_;
+    int range_;
+    // the server agreed to compression
+    bool compress_ = false;
+    bool handshaking_ = false;
+    std::unique_ptr<common::ShmChannel> channel_;
+    std::unique_ptr<common::ShmConnection> shm_;
+
+    Location2D position_;
+    std::unordered_set<Location2D, Location2DHash> known_;
+    int spiral_direction_ = 0;
+    int spiral_leg_ = 1;
+    int spiral_steps_ = 0;
+    double heading_;
+    double line_x_;
+    double line_z_;
+
+    std::array<std::uint8_t, common::frame_header_length> header_buffer_;
+    common::MessageBuffer request_;
+    common::MessageBuffer reply_;
+    std::uint8_t reply_flags_ = 0;
+    std::size_t requested_ = 0;
+    std::size_t received_ = 0;
+    std::size_t failed_ = 0;
+    bool first_batch_ = false;
+    std::uint64_t epoch_ = 0;
+    // 0 once the request's final batch is in
+    std::uint64_t in_flight_tag_ = 0;
+    // sections of the request in flight that haven't come back yet
+    std::unordered_set<Location2D, Location2DHash> pending_;
+    std::vector<std::int32_t> xs_;
+    std::vector<std::int32_t> zs_;
+    Clock::time_point sent_at_;
+    bool finished_ = false;
+  };
+
+  double per_second(std::uint64_t value, double seconds) {
+    return seconds > 0 ? value / seconds : 0;
+  }
+} // namespace
+
+int main(int argc, char* argv[]) {
+  int num_clients = argc > 1 ? std::max(1, std::atoi(argv[1])) : 100;
+  int seconds = argc > 2 ? std::max(1, std::atoi(argv[2])) : 30;
+  std::string pattern_name = argc > 3 ? argv[3] : "mixed";
+  std::string host = argc > 4 ? argv[4] : "127.0.0.1";
+  std::string port = argc > 5 ? argv[5] : "7331";
+  int interval_ms = argc > 6 ? std::max(0, std::atoi(argv[6])) : 0;
+  std::string transport = argc > 7 ? argv[7] : "tcp";
+  if (transport != "tcp" && transport != "shm") {
+    std::cerr << "unknown transport " << transport << ", expected tcp or shm" << std::endl;
+    return 1;
+  }
+  std::string codec = argc > 8 ? argv[8] : "none";
+  if (codec != "none" && codec != "lz") {
+    std::cerr << "unknown codec " << codec << ", expected none or lz" << std::endl;
+    return 1;
+  }
+  Location2D center = {argc > 9 ? std::atoi(argv[9]) : 0, argc > 10 ? std::atoi(argv[10]) : 0};
+  int range = argc > 11 ? std::max(0, std::atoi(argv[11])) : default_range;
+
+  std::vector<Pattern> patterns;
+  if (pattern_name == "spiral")
+    patterns = {Pattern::spiral};
+  else if (pattern_name == "line")
+    patterns = {Pattern::line};
+  else if (pattern_name == "teleport")
+    patterns = {Pattern::teleport};
+  else if (pattern_name == "mixed")
+    patterns = {Pattern::spiral, Pattern::line, Pattern::teleport};
+  else {
+    std::cerr << "unknown pattern " << pattern_name << ", expected spiral, line, teleport or mixed" << std::endl;
+    return 1;
+  }
+
+  std::cout << "loadgen: " << num_clients << " clients, " << seconds << "s, pattern " << pattern_name
+            << ", " << host << ":" << port << ", interval " << interval_ms << "ms, " << transport << ", " << codec << std::endl;
+
+  asio::io_context io_context;
+  tcp::resolver resolver(io_context);
+  auto endpoints = resolver.resolve(host, port);
+
+  Stats stats;
+  auto start = Clock::now();
+  auto cpu_start = std::clock();
+  auto deadline = start + std::chrono::seconds(seconds);
+  for (int i = 0; i < num_clients; ++i) {
+    auto pattern = patterns[i % patterns.size()];
+    auto client = std::make_shared<LoadClient>(
+      io_context, pattern, 1337 + i, stats, deadline, std::chrono::milliseconds(interval_ms), transport == "shm", codec == "lz",
+      center, range);
+    client->start(endpoints);
+  }
+
+  unsigned int num_threads = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<std::thread> threads;
+  for (unsigned int i = 0; i < num_threads; ++i)
+    threads.emplace_back([&io_context] { io_context.run(); });
+
+  // per second progress until every client is done
+  std::uint64_t last_sections = 0, last_bytes = 0;
+  auto last = start;
+  while (stats.active_clients > 0) {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    auto now = Clock::now();
+    double elapsed = std::chrono::duration<double>(now - last).count();
+    auto sections = stats.sections.load();
+    auto bytes = stats.bytes_received.load();
+    std::cout << std::fixed << std::setprecision(0)
+              << "  clients=" << stats.active_clients
+              << " sections/s=" << per_second(sections - last_sections, elapsed)
+              << " MB/s=" << std::setprecision(2) << per_second(bytes - last_bytes, elapsed) / (1024 * 1024)
+              << std::endl;
+    last_sections = sections;
+    last_bytes = bytes;
+    last = now;
+  }
+  for (auto& thread : threads)
+    thread.join();
+
+  double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  double cpu_seconds = static_cast<double>(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+  std::cout << std::fixed << std::setprecision(1);
+  std::cout << "requests " << stats.requests << " in " << elapsed << "s (" << per_second(stats.requests, elapsed) << "/s)" << std::endl;
+  std::cout << "latency " << stats.latency_us.summary("us") << std::endl;
+  std::cout << "first batch " << stats.first_batch_us.summary("us") << std::endl;
+  std::cout << "sections/s " << per_second(stats.sections, elapsed) << std::endl;
+  if (stats.sections > 0)
+    std::cout << "bytes/section " << static_cast<double>(stats.bytes_received) / stats.sections << ", cpu us/section "
+              << cpu_seconds * 1e6 / stats.sections << std::endl;
+  std::cout << "received " << per_second(stats.bytes_received, elapsed) / (1024 * 1024) << " MB/s, sent "
+            << per_second(stats.bytes_sent, elapsed) / (1024 * 1024) << " MB/s" << std::endl;
+  if (stats.compressed_replies > 0) {
+    std::cout << "compression " << static_cast<double>(stats.bytes_decompressed) / stats.bytes_received << "x, "
+              << stats.compressed_replies << " replies compressed, " << stats.bytes_decompressed / (1024.0 * 1024)
+              << "MB decompressed in " << stats.decompress_ns / 1000000 << "ms";
+    if (stats.sections > 0)
+      std::cout << ", decompress us/section " << stats.decompress_ns / 1e3 / stats.sections;
+    std::cout << std::endl;
+  }
+  std::cout << "errors connect=" << stats.connect_errors << " io=" << stats.io_errors
+            << " malformed=" << stats.malformed_replies << " missing_sections=" << stats.missing_sections
+            << " failed_sections=" << stats.failed_sections
+            << " misordered_batches=" << stats.misordered_batches << " unexpected_sections=" << stats.unexpected_sections
+            << " shm_declined=" << stats.shm_declined << " compression_declined=" << stats.compression_declined << std::endl;
+
+  bool failed = stats.connect_errors + stats.io_errors + stats.malformed_replies + stats.missing_sections +
+                  stats.misordered_batches + stats.unexpected_sections > 0;
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,126 @@
+#include "admin_server.h"
+#include <iostream>
+#include <istream>
+#include <memory>
+
+namespace {
+  struct Quantile {
+    const char* label;
+    double percentile;
+  };
+  constexpr Quantile quantiles[] = {{"0.5", 50}, {"0.9", 90}, {"0.99", 99}, {"0.999", 99.9}};
+} // namespace
+
+void MetricsPage::gauge(const std::string& name, std::uint64_t value, const std::string& labels) {
+  start(name, "gauge");
+  sample(name, labels);
+  stream_ << value << "\n";
+}
+
+void MetricsPage::gauge(const std::string& name, double value, const std::string& labels) {
+  start(name, "gauge");
+  sample(name, labels);
+  stream_ << value << "\n";
+}
+
+void MetricsPage::counter(const std::string& name, std::uint64_t value, const std::string& labels) {
+  start(name, "counter");
+  sample(name, labels);
+  stream_ << value << "\n";
+}
+
+void MetricsPage::summary(const std::string& name, const common::LatencyHistogram& histogram, const std::string& labels) {
+  start(name, "summary");
+  auto separator = labels.empty() ? "" : ",";
+  for (auto& quantile : quantiles) {
+    sample(name, labels + separator + "quantile=\"" + quantile.label + "\"");
+    stream_ << histogram.get_percentile(quantile.percentile) << "\n";
+  }
+  sample(name, labels + separator + "quantile=\"1\"");
+  stream_ << histogram.get_max() << "\n";
+  sample(name + "_sum", labels);
+  stream_ << histogram.get_sum() << "\n";
+  sample(name + "_count", labels);
+  stream_ << histogram.get_count() << "\n";
+}
+
+std::string MetricsPage::str() const {
+  return stream_.str();
+}
+
+void MetricsPage::start(const std::string& name, const char* type) {
+  if (name == last_name_)
+    return;
+  last_name_ = name;
+  stream_ << "# TYPE csworld_" << name << " " << type << "\n";
+}
+
+void MetricsPage::sample(const std::string& name, const std::string& labels) {
+  stream_ << "csworld_" << name;
+  if (!labels.empty())
+    stream_ << "{" << labels << "}";
+  stream_ << " ";
+}
+
+// One request and its reply, the socket closes once the last handler holding the session has run
+class AdminServer::Session : public std::enable_shared_from_this<Session> {
+public:
+  Session(asio::ip::tcp::socket socket, Renderer render)
+      : socket_(std::move(socket)), request_(max_request_size), render_(std::move(render)) {}
+
+  void start() {
+    asio::async_read_until(
+      socket_,
+      request_,
+      "\r\n\r\n",
+      [self = shared_from_this()](const asio::error_code& error, std::size_t) { self->handle_request(error); });
+  }
+
+private:
+  void handle_request(const asio::error_code& error) {
+    if (error)
+      return;
+    std::istream stream(&request_);
+    std::string method, target;
+    stream >> method >> target;
+    target = target.substr(0, target.find('?'));
+
+    std::string status = "200 OK";
+    std::string body;
+    if (method != "GET")
+      status = "405 Method Not Allowed";
+    else if (target == "/metrics" || target == "/")
+      body = render_();
+    else
+      status = "404 Not Found";
+
+    reply_ = "HTTP/1.1 " + status + "\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+             std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+    asio::async_write(socket_, asio::buffer(reply_), [self = shared_from_this()](const asio::error_code&, std::size_t) {
+      asio::error_code ignored_error;
+      self->socket_.shutdown(asio::ip::tcp::socket::shutdown_both, ignored_error);
+    });
+  }
+
+  asio::ip::tcp::socket socket_;
+  asio::streambuf request_;
+  std::string reply_;
+  Renderer render_;
+};
+
+AdminServer::AdminServer(asio::io_context& io_context, unsigned short port, Renderer render)
+    : io_context_(io_context),
+      acceptor_(io_context, asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(), port)),
+      render_(std::move(render)) {
+  start_accept();
+  std::cout << "Serving metrics on 127.0.0.1:" << port << "/metrics" << std::endl;
+}
+
+void AdminServer::start_accept() {
+  // a session's handlers run one after the other, so it needs no strand of its own
+  acceptor_.async_accept(io_context_, [this](const asio::error_code& error, asio::ip::tcp::socket socket) {
+    if (!error)
+      std::make_shared<Session>(std::move(socket), render_)->start();
+    start_accept();
+  });
+}
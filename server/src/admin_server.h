@@ -0,0 +1,56 @@
+#ifndef ADMIN_SERVER_H
+#define ADMIN_SERVER_H
+#ifdef _WIN32
+#include <SDKDDKVer.h>
+#endif
+#include <cstdint>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <asio.hpp>
+#include "latency_histogram.h"
+
+// A metrics page in the Prometheus text format, every name is prefixed with csworld_.
+// Labels are passed preformatted, like stage="decode"
+class MetricsPage {
+public:
+  void gauge(const std::string& name, std::uint64_t value, const std::string& labels = "");
+  void gauge(const std::string& name, double value, const std::string& labels = "");
+  void counter(const std::string& name, std::uint64_t value, const std::string& labels = "");
+  // p50, p90, p99, p999 and max as quantiles, plus _sum and _count
+  void summary(const std::string& name, const common::LatencyHistogram& histogram, const std::string& labels = "");
+  std::string str() const;
+
+private:
+  // the TYPE line goes out once, before the first sample of a name
+  void start(const std::string& name, const char* type);
+  void sample(const std::string& name, const std::string& labels);
+
+  std::stringstream stream_;
+  std::string last_name_;
+};
+
+// Plain HTTP on a loopback port for scraping. GET /metrics (or /) is answered with what render returns,
+// anything else with a 404, and the connection is closed after every reply. Runs on the server's
+// io_context, so render is called from an io thread
+class AdminServer {
+public:
+  using Renderer = std::function<std::string()>;
+
+  AdminServer(asio::io_context& io_context, unsigned short port, Renderer render);
+
+  // the admin port is the game port plus this unless given, so servers behind a gateway don't collide
+  static constexpr unsigned short port_offset = 1000;
+
+private:
+  class Session;
+
+  void start_accept();
+
+  asio::io_context& io_context_;
+  asio::ip::tcp::acceptor acceptor_;
+  Renderer render_;
+  static constexpr std::size_t max_request_size = 8 * 1024;
+};
+
+#endif
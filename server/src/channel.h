@@ -0,0 +1,59 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// Unbounded multi-producer multi-consumer queue, consumers block in pop until an item arrives
+template <typename T>
+class Channel {
+public:
+  void push(T&& item) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      items_.push_back(std::move(item));
+    }
+    cv_.notify_one();
+  }
+
+  void pop(T& item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return !items_.empty(); });
+    item = std::move(items_.front());
+    items_.pop_front();
+  }
+
+  // false if nothing arrived before deadline
+  template <typename Clock, typename Duration>
+  bool pop_until(T& item, const std::chrono::time_point<Clock, Duration>& deadline) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!cv_.wait_until(lock, deadline, [this] { return !items_.empty(); }))
+      return false;
+    item = std::move(items_.front());
+    items_.pop_front();
+    return true;
+  }
+
+  bool try_pop(T& item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (items_.empty())
+      return false;
+    item = std::move(items_.front());
+    items_.pop_front();
+    return true;
+  }
+
+  std::size_t size() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return items_.size();
+  }
+
+private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<T> items_;
+};
+
+#endif
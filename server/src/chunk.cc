@@ -2,23 +2,45 @@
 #include <iostream>
 
 Chunk::Chunk(int x, int y, int z)
-    : location_{x, y, z} /*,voxels_(sz, Voxel::empty)*/ {
+    : location_{x, y, z}, voxels_(sz, Voxel::empty) {
 }
 
 const Location& Chunk::get_location() const {
   return location_;
 }
-/*
-Voxel::VoxelType Chunk::get_voxel(int x, int y, int z) const {
+
+Voxel Chunk::get_voxel(int x, int y, int z) const {
   return voxels_[x + sz_x * (y + sz_y * z)];
 }
 
-void Chunk::set_voxel(int x, int y, int z, Voxel::VoxelType value) {
+void Chunk::set_voxel(int x, int y, int z, Voxel value) {
   std::size_t i = x + sz_x * (y + sz_y * z);
   voxels_[i] = value;
 }
 
-Voxel::VoxelType Chunk::get_voxel(int i) const {
+Voxel Chunk::get_voxel(int i) const {
   return voxels_[i];
 }
- */
\ No newline at end of file
+
+void Chunk::set_voxel(int i, Voxel value) {
+  voxels_[i] = value;
+}
+
+const std::vector<Voxel>& Chunk::get_voxels() const {
+  return voxels_;
+}
+
+int Chunk::get_index(int x, int y, int z) {
+  return x + sz_x * (y + sz_y * z);
+}
+
+int Chunk::get_index(const Int3D& coord) {
+  return coord[0] + sz_x * (coord[1] + sz_y * coord[2]);
+}
+
+Int3D Chunk::to_local(Int3D coord) {
+  int x = ((coord[0] % sz_x) + sz_x) % sz_x;
+  int y = ((coord[1] % sz_y) + sz_y) % sz_y;
+  int z = ((coord[2] % sz_z) + sz_z) % sz_z;
+  return Int3D{x, y, z};
+}
@@ -6,15 +6,22 @@
 #include <vector>
 #include "common.h"
 #include "types.h"
+#include "voxel.h"
 
 class Chunk {
 public:
   Chunk(int x, int y, int z);
   const Location& get_location() const;
-  /*  Voxel::VoxelType get_voxel(int x, int y, int z) const;
-   Voxel::VoxelType get_voxel(int i) const;
+  Voxel get_voxel(int x, int y, int z) const;
+  Voxel get_voxel(int i) const;
+  const std::vector<Voxel>& get_voxels() const;
 
-   void set_voxel(int x, int y, int z, Voxel::VoxelType value); */
+  void set_voxel(int x, int y, int z, Voxel value);
+  void set_voxel(int i, Voxel value);
+
+  static int get_index(int x, int y, int z);
+  static int get_index(const Int3D& coord);
+  static Int3D to_local(Int3D coord);
 
   static constexpr int sz_x = common::chunk_sz_x;
   static constexpr int sz_y = common::chunk_sz_y;
@@ -22,9 +29,9 @@ public:
   static constexpr int sz = common::chunk_sz;
 
 private:
-  //  std::vector<Voxel::VoxelType> voxels_;
+  std::vector<Voxel> voxels_;
 
   Location location_;
 };
 
-#endif
\ No newline at end of file
+#endif
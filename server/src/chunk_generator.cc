@@ -0,0 +1,90 @@
+#include "chunk_generator.h"
+#include <array>
+#include <cmath>
+
+namespace {
+  // features from neighbouring sections are laid over the chunk in this order
+  const std::array<std::array<int, 2>, 9> section_order =
+    {{{-1, -1},
+      {0, -1},
+      {1, -1},
+      {-1, 0},
+      {0, 0},
+      {1, 0},
+      {-1, 1},
+      {0, 1},
+      {1, 1}}};
+
+  // a chunk needs its neighbours' features, which need their neighbours' elevations
+  constexpr int section_radius = 2;
+
+  Location location_from_global_coord(int x, int y, int z) {
+    return Location{
+      static_cast<int>(std::floor(static_cast<double>(x) / Chunk::sz_x)),
+      static_cast<int>(std::floor(static_cast<double>(y) / Chunk::sz_y)),
+      static_cast<int>(std::floor(static_cast<double>(z) / Chunk::sz_z)),
+    };
+  }
+} // namespace
+
+void ChunkGenerator::add_required_sections(Location2D column, std::vector<Location2D>& locs) {
+  for (int z = -section_radius; z <= section_radius; ++z)
+    for (int x = -section_radius; x <= section_radius; ++x)
+      locs.push_back(Location2D{column[0] + x, column[1] + z});
+}
+
+void ChunkGenerator::load_features(const Section& section, SectionTerrain& terrain) const {
+  auto& loc = section.location;
+  std::vector<common::FeatureVoxel> features;
+  feature_generator_.generate(loc[0], loc[1], section.landcover.data(), terrain.subsection_elevations, features);
+  for (auto [x, y, z, voxel] : features) {
+    auto location = location_from_global_coord(x, y, z);
+    int idx = Chunk::get_index(Chunk::to_local(Int3D{x, y, z}));
+    terrain.features[location].emplace_back(idx, voxel);
+  }
+}
+
+void ChunkGenerator::fill_column(Location2D column, const std::unordered_map<Location2D, Section, Location2DHash>& sections, std::span<Chunk> chunks) const {
+  // terrain of the column's section and its neighbours, worked out once for every chunk in the column
+  std::unordered_map<Location2D, SectionTerrain, Location2DHash> terrains;
+  for (auto [x, z] : section_order) {
+    auto section_loc = Location2D{column[0] + x, column[1] + z};
+    auto& terrain = terrains[section_loc];
+    std::array<int, 9> elevations;
+    for (int dz = -1; dz <= 1; ++dz)
+      for (int dx = -1; dx <= 1; ++dx)
+        elevations[(dx + 1) + 3 * (dz + 1)] = sections.at(Location2D{section_loc[0] + dx, section_loc[1] + dz}).elevation;
+    common::compute_subsection_elevations(elevations, terrain.subsection_elevations);
+    load_features(sections.at(section_loc), terrain);
+  }
+  auto& section = sections.at(column);
+  auto& terrain = terrains.at(column);
+
+  for (auto& chunk : chunks) {
+    auto& location = chunk.get_location();
+    int y_global = location[1] * Chunk::sz_y;
+    for (int z = 0; z < Chunk::sz_z; ++z) {
+      for (int x = 0; x < Chunk::sz_x; ++x) {
+        int height = terrain.get_subsection_elevation(x, z);
+        if (height < y_global)
+          continue;
+
+        auto voxel = common::get_ground_voxel(common::get_landcover(section.landcover.data(), x, z));
+
+        int y = y_global;
+        for (; y < (y_global + Chunk::sz_y) && y <= height; ++y) {
+          chunk.set_voxel(x, y - y_global, z, voxel);
+        }
+      }
+    }
+
+    for (auto [x, z] : section_order) {
+      auto& features = terrains.at(Location2D{column[0] + x, column[1] + z}).features;
+      auto it = features.find(location);
+      if (it == features.end())
+        continue;
+      for (auto [idx, voxel] : it->second)
+        chunk.set_voxel(idx, voxel);
+    }
+  }
+}
@@ -0,0 +1,36 @@
+#ifndef CHUNK_GENERATOR_H
+#define CHUNK_GENERATOR_H
+
+#include <span>
+#include <unordered_map>
+#include <vector>
+#include "chunk.h"
+#include "terrain.h"
+#include "types.h"
+#include "voxel.h"
+
+// Server side of the client's WorldGenerator::fill_chunk, for clients that have the server generate
+// their chunks. Both build on common/terrain.h, so they produce the same voxels.
+// fill_column is safe to call from any number of threads
+class ChunkGenerator {
+public:
+  // sections a column's chunks are generated from
+  static void add_required_sections(Location2D column, std::vector<Location2D>& locs);
+  // every chunk must be in column, sections must hold everything add_required_sections asked for
+  void fill_column(Location2D column, const std::unordered_map<Location2D, Section, Location2DHash>& sections, std::span<Chunk> chunks) const;
+
+private:
+  // what the client keeps on its Section once it has generated from it
+  struct SectionTerrain {
+    std::vector<int> subsection_elevations;
+    std::unordered_map<Location, std::vector<std::pair<int, Voxel>>, LocationHash> features;
+
+    int get_subsection_elevation(int x, int z) const { return subsection_elevations[x + Chunk::sz_x * z]; }
+  };
+
+  void load_features(const Section& section, SectionTerrain& terrain) const;
+
+  common::FeatureGenerator feature_generator_;
+};
+
+#endif
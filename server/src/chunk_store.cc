@@ -0,0 +1,163 @@
+#include "chunk_store.h"
+#include <iostream>
+#include <map>
+#include <sstream>
+#include "chunk_runs.h"
+
+std::size_t EncodedChunk::get_memory_usage() const {
+  return sizeof(EncodedChunk) + runs.capacity() * sizeof(std::uint32_t);
+}
+
+ChunkStore::ChunkStore(WorldGenerator& world_generator, WorkerPool& worker_pool, std::size_t cache_budget)
+    : world_generator_(world_generator), worker_pool_(worker_pool), cache_budget_(cache_budget) {}
+
+void ChunkStore::when_ready(const std::vector<Location>& locs, Callback callback) {
+  struct Pending {
+    std::vector<std::shared_ptr<const EncodedChunk>> chunks;
+    std::atomic<std::size_t> remaining;
+    Callback callback;
+  };
+  auto pending = std::make_shared<Pending>();
+  pending->chunks.resize(locs.size());
+  // one extra so the callback can't run before every chunk has been asked for
+  pending->remaining = locs.size() + 1;
+  pending->callback = std::move(callback);
+  auto finish = [pending] {
+    if (pending->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      pending->callback(std::move(pending->chunks));
+  };
+
+  // new chunks grouped by column, ordered so neighbouring columns are generated together
+  std::map<Location2D, std::vector<int>> to_generate;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (std::size_t i = 0; i < locs.size(); ++i) {
+      auto& loc = locs[i];
+      auto [it, inserted] = chunks_.try_emplace(loc);
+      auto& entry = it->second;
+      if (!entry.loading) {
+        ++hits_;
+        lru_.splice(lru_.begin(), lru_, entry.lru_it);
+        pending->chunks[i] = entry.chunk;
+        pending->remaining.fetch_sub(1, std::memory_order_relaxed);
+        continue;
+      }
+      entry.waiters.push_back([pending, i, finish](const std::shared_ptr<const EncodedChunk>& chunk) {
+        pending->chunks[i] = chunk;
+        finish();
+      });
+      if (inserted) {
+        ++misses_;
+        to_generate[Location2D{loc[0], loc[2]}].push_back(loc[1]);
+      } else {
+        ++deduplicated_;
+      }
+    }
+  }
+
+  for (auto& [column, ys] : to_generate) {
+    std::vector<Location2D> section_locs;
+    ChunkGenerator::add_required_sections(column, section_locs);
+    // park the column until its sections' tiles are in so workers never block on a fetch
+    world_generator_.when_ready(section_locs, [this, column, ys] {
+      worker_pool_.submit([this, column, ys] { generate_column(column, ys); });
+    });
+  }
+  finish();
+}
+
+void ChunkStore::generate_column(Location2D column, std::vector<int> ys) {
+  std::vector<std::shared_ptr<const EncodedChunk>> encoded(ys.size());
+  try {
+    std::vector<Location2D> section_locs;
+    ChunkGenerator::add_required_sections(column, section_locs);
+    std::vector<Section> sections(section_locs.size());
+    world_generator_.get_sections(section_locs, sections);
+    std::unordered_map<Location2D, Section, Location2DHash> sections_by_location;
+    for (std::size_t i = 0; i < section_locs.size(); ++i)
+      sections_by_location.emplace(section_locs[i], sections[i]);
+
+    std::vector<Chunk> chunks;
+    chunks.reserve(ys.size());
+    for (auto y : ys)
+      chunks.emplace_back(column[0], y, column[1]);
+    chunk_generator_.fill_column(column, sections_by_location, chunks);
+
+    for (std::size_t i = 0; i < chunks.size(); ++i) {
+      auto chunk = std::make_shared<EncodedChunk>();
+      chunk->location = chunks[i].get_location();
+      common::encode_chunk_runs(chunks[i].get_voxels(), chunk->runs);
+      chunk->runs.shrink_to_fit();
+      encoded[i] = std::move(chunk);
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "failed to generate column " << column[0] << "," << column[1] << ": " << e.what() << std::endl;
+  }
+
+  std::vector<std::pair<std::vector<Waiter>, std::shared_ptr<const EncodedChunk>>> to_notify;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (std::size_t i = 0; i < ys.size(); ++i) {
+      auto it = chunks_.find(Location{column[0], ys[i], column[1]});
+      to_notify.emplace_back(std::move(it->second.waiters), encoded[i]);
+      if (!encoded[i]) {
+        // forget failures so the next request tries again
+        chunks_.erase(it);
+        continue;
+      }
+      auto& entry = it->second;
+      entry.loading = false;
+      entry.waiters.clear();
+      entry.chunk = encoded[i];
+      lru_.push_front(entry.chunk->location);
+      entry.lru_it = lru_.begin();
+      cache_bytes_ += entry.chunk->get_memory_usage();
+    }
+    evict();
+  }
+  for (auto& [waiters, chunk] : to_notify)
+    for (auto& waiter : waiters)
+      waiter(chunk);
+}
+
+void ChunkStore::evict() {
+  while (cache_bytes_ > cache_budget_ && !lru_.empty()) {
+    auto loc = lru_.back();
+    lru_.pop_back();
+    auto it = chunks_.find(loc);
+    cache_bytes_ -= it->second.chunk->get_memory_usage();
+    chunks_.erase(it);
+    ++evictions_;
+  }
+}
+
+std::uint64_t ChunkStore::get_hits() const {
+  return hits_;
+}
+
+std::uint64_t ChunkStore::get_misses() const {
+  return misses_;
+}
+
+std::uint64_t ChunkStore::get_deduplicated() const {
+  return deduplicated_;
+}
+
+std::uint64_t ChunkStore::get_evictions() const {
+  return evictions_;
+}
+
+std::string ChunkStore::report() {
+  std::size_t num_chunks;
+  std::size_t bytes;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    num_chunks = lru_.size();
+    bytes = cache_bytes_;
+  }
+  std::stringstream stream;
+  stream << "chunk cache: " << num_chunks << " chunks, " << bytes / 1024 << "/" << cache_budget_ / 1024 << "KB"
+         << ", hits " << hits_ << ", misses " << misses_ << ", deduplicated " << deduplicated_
+         << ", evictions " << evictions_;
+  return stream.str();
+}
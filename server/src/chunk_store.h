@@ -0,0 +1,76 @@
+#ifndef CHUNK_STORE_H
+#define CHUNK_STORE_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "chunk_generator.h"
+#include "types.h"
+#include "worker_pool.h"
+#include "world_generator.h"
+
+// A generated chunk as it goes on the wire, shared by every client that asks for it
+struct EncodedChunk {
+  Location location;
+  std::vector<std::uint32_t> runs;
+
+  std::size_t get_memory_usage() const;
+};
+
+// Generates chunks for clients that don't generate their own. Chunks are generated a column at a time
+// on the worker pool once the column's sections are ready, and a chunk is only ever generated once at a
+// time however many clients ask for it. Generated chunks are kept in an LRU bounded by cache_budget bytes
+class ChunkStore {
+public:
+  // chunks in the order they were asked for, nullptr for any that failed
+  using Callback = std::function<void(std::vector<std::shared_ptr<const EncodedChunk>>)>;
+
+  ChunkStore(WorldGenerator& world_generator, WorkerPool& worker_pool, std::size_t cache_budget);
+  ChunkStore(const ChunkStore& other) = delete;
+  ChunkStore& operator=(const ChunkStore& other) = delete;
+
+  // callback runs inline if every chunk is cached, otherwise on a worker
+  void when_ready(const std::vector<Location>& locs, Callback callback);
+
+  std::uint64_t get_hits() const;
+  std::uint64_t get_misses() const;
+  std::uint64_t get_deduplicated() const;
+  std::uint64_t get_evictions() const;
+  std::string report();
+
+private:
+  using Waiter = std::function<void(const std::shared_ptr<const EncodedChunk>&)>;
+  struct Entry {
+    bool loading = true;
+    std::shared_ptr<const EncodedChunk> chunk;
+    std::vector<Waiter> waiters;
+    // position in lru_ once generated
+    std::list<Location>::iterator lru_it;
+  };
+
+  void generate_column(Location2D column, std::vector<int> ys);
+  // must hold mutex_
+  void evict();
+
+  WorldGenerator& world_generator_;
+  WorkerPool& worker_pool_;
+  ChunkGenerator chunk_generator_;
+  std::mutex mutex_;
+  std::unordered_map<Location, Entry, LocationHash> chunks_;
+  // generated chunks, most recently used at the front
+  std::list<Location> lru_;
+  std::size_t cache_bytes_ = 0;
+  std::size_t cache_budget_;
+  std::atomic<std::uint64_t> hits_{0};
+  std::atomic<std::uint64_t> misses_{0};
+  std::atomic<std::uint64_t> deduplicated_{0};
+  std::atomic<std::uint64_t> evictions_{0};
+};
+
+#endif
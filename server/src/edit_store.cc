@@ -0,0 +1,167 @@
+#include "edit_store.h"
+#include <iostream>
+#include <stdexcept>
+#include "chunk.h"
+#include "chunk_runs.h"
+
+EditStore::EditStore(const std::string& path) {
+  if (sqlite3_open(path.c_str(), &db_)) {
+    std::cerr << "Failed to open edit database: " << sqlite3_errmsg(db_) << std::endl;
+    sqlite3_close(db_);
+    throw std::runtime_error("Failed to initialize EditStore");
+  }
+  // servers behind a gateway share the file, each writes only the chunks it owns
+  sqlite3_busy_timeout(db_, 5000);
+  std::string sql =
+    "pragma journal_mode=wal;"
+    "create table if not exists Edit("
+    "	x integer not null,"
+    "	y integer not null,"
+    "	z integer not null,"
+    "	voxel_index integer not null,"
+    "	voxel integer not null,"
+    "	primary key (x,y,z,voxel_index)"
+    ") without rowid;";
+  char* err_msg;
+  if (sqlite3_exec(db_, sql.c_str(), NULL, 0, &err_msg)) {
+    std::cerr << "Failed to create table: " << err_msg << std::endl;
+    sqlite3_free(err_msg);
+    sqlite3_close(db_);
+    throw std::runtime_error("Failed to initialize EditStore");
+  }
+  sqlite3_prepare_v2(db_, "insert or replace into Edit(x,y,z,voxel_index,voxel) values(?,?,?,?,?);", -1, &save_stmt_, nullptr);
+  load();
+}
+
+EditStore::~EditStore() {
+  save();
+  sqlite3_finalize(save_stmt_);
+  sqlite3_close(db_);
+}
+
+void EditStore::load() {
+  sqlite3_stmt* stmt;
+  sqlite3_prepare_v2(db_, "select x, y, z, voxel_index, voxel from Edit;", -1, &stmt, nullptr);
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    auto loc = Location{sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1), sqlite3_column_int(stmt, 2)};
+    int index = sqlite3_column_int(stmt, 3);
+    int voxel = sqlite3_column_int(stmt, 4);
+    if (index < 0 || index >= Chunk::sz || voxel < 0 || voxel >= static_cast<int>(Voxel::voxel_enum_size))
+      continue;
+    insert(loc, static_cast<std::uint16_t>(index), static_cast<Voxel>(voxel));
+  }
+  sqlite3_finalize(stmt);
+  std::cout << "Loaded " << num_edits_ << " edited voxels in " << chunks_.size() << " chunks" << std::endl;
+}
+
+void EditStore::insert(const Location& loc, std::uint16_t index, Voxel voxel) {
+  auto [it, inserted] = chunks_[loc].insert_or_assign(index, voxel);
+  if (inserted) {
+    ++num_edits_;
+    columns_[Location2D{loc[0], loc[2]}].insert(loc[1]);
+  }
+}
+
+void EditStore::apply(const Location& loc, std::span<const VoxelEdit> edits) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (auto& edit : edits) {
+    insert(loc, edit.index, edit.voxel);
+    unsaved_.emplace_back(loc, edit);
+  }
+}
+
+bool EditStore::has_edits(const Location& loc) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return chunks_.contains(loc);
+}
+
+std::vector<VoxelEdit> EditStore::get_edits(const Location& loc) {
+  std::vector<VoxelEdit> edits;
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto it = chunks_.find(loc);
+  if (it == chunks_.end())
+    return edits;
+  edits.reserve(it->second.size());
+  for (auto& [index, voxel] : it->second)
+    edits.push_back(VoxelEdit{index, voxel});
+  return edits;
+}
+
+void EditStore::get_column_edits(const Location2D& column, std::vector<ChunkEdits>& out) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto it = columns_.find(column);
+  if (it == columns_.end())
+    return;
+  for (int y : it->second) {
+    auto& chunk = chunks_.at(Location{column[0], y, column[1]});
+    auto& chunk_edits = out.emplace_back(ChunkEdits{Location{column[0], y, column[1]}, {}});
+    chunk_edits.edits.reserve(chunk.size());
+    for (auto& [index, voxel] : chunk)
+      chunk_edits.edits.push_back(VoxelEdit{index, voxel});
+  }
+}
+
+void EditStore::overlay(const Location& loc, std::vector<std::uint32_t>& runs) {
+  auto edits = get_edits(loc);
+  if (edits.empty())
+    return;
+  std::vector<Voxel> voxels(Chunk::sz, Voxel::empty);
+  if (!common::decode_chunk_runs(runs, voxels))
+    return;
+  for (auto& edit : edits)
+    voxels[edit.index] = edit.voxel;
+  runs.clear();
+  common::encode_chunk_runs(voxels, runs);
+}
+
+std::size_t EditStore::get_num_chunks() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return chunks_.size();
+}
+
+std::size_t EditStore::get_num_edits() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return num_edits_;
+}
+
+bool EditStore::has_unsaved() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return !unsaved_.empty();
+}
+
+void EditStore::save() {
+  std::unique_lock<std::mutex> db_lock(db_mutex_);
+  std::vector<std::pair<Location, VoxelEdit>> unsaved;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    unsaved.swap(unsaved_);
+  }
+  if (unsaved.empty())
+    return;
+  // immediate takes the write lock up front, so a busy db waits out the timeout here rather than failing the commit
+  bool saved = sqlite3_exec(db_, "begin immediate;", NULL, 0, NULL) == SQLITE_OK;
+  if (saved) {
+    for (auto& [loc, edit] : unsaved) {
+      sqlite3_bind_int(save_stmt_, 1, loc[0]);
+      sqlite3_bind_int(save_stmt_, 2, loc[1]);
+      sqlite3_bind_int(save_stmt_, 3, loc[2]);
+      sqlite3_bind_int(save_stmt_, 4, edit.index);
+      sqlite3_bind_int(save_stmt_, 5, static_cast<int>(edit.voxel));
+      saved = sqlite3_step(save_stmt_) == SQLITE_DONE;
+      sqlite3_reset(save_stmt_);
+      if (!saved)
+        break;
+    }
+    if (saved)
+      saved = sqlite3_exec(db_, "commit;", NULL, 0, NULL) == SQLITE_OK;
+  }
+  if (saved)
+    return;
+  std::cerr << "Failed to save " << unsaved.size() << " edits, retrying next save: " << sqlite3_errmsg(db_) << std::endl;
+  if (!sqlite3_get_autocommit(db_))
+    sqlite3_exec(db_, "rollback;", NULL, 0, NULL);
+  // ahead of anything applied since, so a voxel's later edit still lands last
+  std::unique_lock<std::mutex> lock(mutex_);
+  unsaved_.insert(unsaved_.begin(), unsaved.begin(), unsaved.end());
+}
@@ -0,0 +1,70 @@
+#ifndef EDIT_STORE_H
+#define EDIT_STORE_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <sqlite3.h>
+#include "types.h"
+#include "voxel.h"
+
+struct ChunkEdits {
+  Location location;
+  std::vector<VoxelEdit> edits;
+};
+
+// The authoritative record of every voxel clients have changed, on top of what the generator makes.
+// Sparse, only chunks that were edited have an entry and only the voxels that changed are kept.
+// Kept in memory and written through to an sqlite db, which is read back in full on startup.
+// Safe to call from any thread
+class EditStore {
+public:
+  // throws if the db can't be opened
+  EditStore(const std::string& path);
+  ~EditStore();
+  EditStore(const EditStore& other) = delete;
+  EditStore& operator=(const EditStore& other) = delete;
+
+  // later edits to a voxel replace earlier ones
+  void apply(const Location& loc, std::span<const VoxelEdit> edits);
+  bool has_edits(const Location& loc);
+  // sorted by index, empty if the chunk was never edited
+  std::vector<VoxelEdit> get_edits(const Location& loc);
+  // every edited chunk in the column
+  void get_column_edits(const Location2D& column, std::vector<ChunkEdits>& out);
+  // rewrites runs with the chunk's edits applied, does nothing to unedited chunks
+  void overlay(const Location& loc, std::vector<std::uint32_t>& runs);
+
+  std::size_t get_num_chunks();
+  std::size_t get_num_edits();
+
+  bool has_unsaved();
+  // writes everything applied since the last save in one transaction. Saves can run on any thread,
+  // they're written one at a time and in the order the edits were applied. Edits a failed save couldn't
+  // write are kept for the next one
+  void save();
+
+private:
+  void load();
+  // mutex_ must be held
+  void insert(const Location& loc, std::uint16_t index, Voxel voxel);
+
+  std::mutex mutex_;
+  std::unordered_map<Location, std::map<std::uint16_t, Voxel>, LocationHash> chunks_;
+  // edited chunk ys by column, for handing a newly interested client everything in a column
+  std::unordered_map<Location2D, std::set<int>, Location2DHash> columns_;
+  std::size_t num_edits_ = 0;
+  std::vector<std::pair<Location, VoxelEdit>> unsaved_;
+  // held for the whole of a save, taken before mutex_
+  std::mutex db_mutex_;
+  sqlite3* db_ = nullptr;
+  sqlite3_stmt* save_stmt_ = nullptr;
+};
+
+#endif
@@ -1,7 +1,10 @@
 #include "http_client.h"
+#include <mutex>
 
 HTTPClient::HTTPClient() {
-  curl_global_init(CURL_GLOBAL_DEFAULT);
+  // not thread safe, and global cleanup is left to process exit since clients live per thread
+  static std::once_flag curl_init;
+  std::call_once(curl_init, [] { curl_global_init(CURL_GLOBAL_DEFAULT); });
   curl_ = curl_easy_init();
 
   if (!curl_) {
@@ -20,7 +23,6 @@ size_t HTTPClient::WriteCallback(void* contents, size_t size, size_t nmemb, std:
 
 HTTPClient::~HTTPClient() {
   curl_easy_cleanup(curl_);
-  curl_global_cleanup();
 }
 
 std::string HTTPClient::make_request(const std::string& url) {
@@ -1,32 +1,71 @@
 #ifdef _WIN32
 #include <SDKDDKVer.h>
 #endif
+#include <algorithm>
 #include <array>
+#include <cstdlib>
 #include <ctime>
 #include <filesystem>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 #include <asio.hpp>
 #include <boost/bind/bind.hpp>
-#include "readerwriterqueue.h"
+#include "admin_server.h"
 #include "chunk.h"
+#include "section_database.h"
 #include "sim_server.h"
+#include "tile_provider.h"
 #include "tcp_server.h"
 #include "world_generator.h"
 
-int main() {
+// server [tile_dir] [section_db] [port] [admin_port]
+// With a tile_dir tiles are only read from there and never downloaded, "-" downloads as usual.
+// section_db is a file made by bake, sections in it are never generated, "-" for none.
+// A port other than the default is for running several behind a gateway.
+// Metrics are served on 127.0.0.1:admin_port/metrics, by default port + AdminServer::port_offset
+// Voxel edits are kept in edits.sqlite in the data dir and survive restarts
+int main(int argc, char* argv[]) {
   std::filesystem::create_directory(common::get_data_dir() + std::string("/images/"));
   std::filesystem::create_directory(common::get_data_dir() + std::string("/images/landcover/"));
   std::filesystem::create_directory(common::get_data_dir() + std::string("/images/elevation/"));
 
-  asio::io_context io_context;
-  TCPServer tcp_server(io_context);
-  asio::thread t(boost::bind(&asio::io_context::run, &io_context));
-  SimServer sim_server(tcp_server);
-  while (true) {
-    sim_server.step();
+  std::unique_ptr<TileProvider> tile_provider;
+  if (argc > 1 && std::string(argv[1]) != "-")
+    tile_provider = std::make_unique<LocalTileProvider>(argv[1]);
+  else
+    tile_provider = std::make_unique<HTTPTileProvider>(common::get_data_dir() + std::string("/images"));
+
+  std::unique_ptr<SectionDatabase> section_database;
+  if (argc > 2 && std::string(argv[2]) != "-") {
+    try {
+      section_database = std::make_unique<SectionDatabase>(argv[2]);
+    } catch (const std::exception& e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
   }
 
+  auto port = TCPServer::default_port;
+  if (argc > 3)
+    port = static_cast<unsigned short>(std::atoi(argv[3]));
+  auto admin_port = static_cast<unsigned short>(port + AdminServer::port_offset);
+  if (argc > 4)
+    admin_port = static_cast<unsigned short>(std::atoi(argv[4]));
+
+  asio::io_context io_context;
+  TCPServer tcp_server(io_context, port);
+  // the other half of the cores go to the section workers
+  unsigned int num_threads = std::max(2u, std::thread::hardware_concurrency());
+  unsigned int num_io_threads = num_threads / 2;
+  std::vector<std::thread> io_threads;
+  for (unsigned int i = 0; i < num_io_threads; ++i)
+    io_threads.emplace_back([&io_context] { io_context.run(); });
+  SimServer sim_server(tcp_server, std::move(tile_provider), std::move(section_database), num_threads - num_io_threads);
+  AdminServer admin_server(io_context, admin_port, [&sim_server] { return sim_server.render_metrics(); });
+  sim_server.run();
+
   return 0;
 }
\ No newline at end of file
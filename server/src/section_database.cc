@@ -0,0 +1,172 @@
+#include "section_database.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace section_database;
+
+SectionDatabase::SectionDatabase(const std::string& path) {
+#ifdef _WIN32
+  file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file_ == INVALID_HANDLE_VALUE)
+    throw std::runtime_error("can't open section database " + path);
+  LARGE_INTEGER file_size;
+  GetFileSizeEx(file_, &file_size);
+  size_ = static_cast<std::size_t>(file_size.QuadPart);
+  if (size_ >= sizeof(Header)) {
+    mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_)
+      data_ = static_cast<const std::uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+  }
+  if (!data_) {
+    if (mapping_)
+      CloseHandle(mapping_);
+    CloseHandle(file_);
+    throw std::runtime_error("can't map section database " + path);
+  }
+#else
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("can't open section database " + path);
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(Header))) {
+    size_ = st.st_size;
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    if (data != MAP_FAILED)
+      data_ = static_cast<const std::uint8_t*>(data);
+  }
+  // the mapping keeps the file alive
+  close(fd);
+  if (!data_)
+    throw std::runtime_error("can't map section database " + path);
+#endif
+
+  Header header;
+  std::memcpy(&header, data_, sizeof(header));
+  std::size_t index_end = sizeof(Header) + static_cast<std::size_t>(header.num_blocks) * sizeof(BlockEntry);
+  std::string error;
+  if (header.magic != magic)
+    error = "not a section database";
+  else if (header.version != version || header.block_size != block_size ||
+           header.landcover_per_section != common::landcover_tiles_per_sector)
+    error = "section database was baked with a different layout";
+  else if (index_end > size_)
+    error = "section database is truncated";
+  if (error.empty()) {
+    entries_ = reinterpret_cast<const BlockEntry*>(data_ + sizeof(Header));
+    num_blocks_ = header.num_blocks;
+    for (std::size_t i = 0; i < num_blocks_; ++i) {
+      if (entries_[i].offset < index_end || entries_[i].offset % alignof(Block) != 0 || entries_[i].offset + sizeof(Block) > size_) {
+        error = "section database is truncated";
+        break;
+      }
+    }
+  }
+  if (!error.empty()) {
+    unmap();
+    throw std::runtime_error(error + ": " + path);
+  }
+}
+
+SectionDatabase::~SectionDatabase() {
+  unmap();
+}
+
+void SectionDatabase::unmap() {
+  if (!data_)
+    return;
+#ifdef _WIN32
+  UnmapViewOfFile(data_);
+  CloseHandle(mapping_);
+  CloseHandle(file_);
+#else
+  munmap(const_cast<std::uint8_t*>(data_), size_);
+#endif
+  data_ = nullptr;
+}
+
+const Block* SectionDatabase::find_block(Location2D block) const {
+  auto* end = entries_ + num_blocks_;
+  auto* it = std::lower_bound(entries_, end, block, [](const BlockEntry& entry, const Location2D& block) {
+    return std::make_pair(entry.x, entry.y) < std::make_pair(block[0], block[1]);
+  });
+  if (it == end || it->x != block[0] || it->y != block[1])
+    return nullptr;
+  return reinterpret_cast<const Block*>(data_ + it->offset);
+}
+
+bool SectionDatabase::find(Location2D loc, Section& section) const {
+  auto [block_loc, index] = locate(loc);
+  auto* block = find_block(block_loc);
+  if (!block || !(block->presence[index / 64] & (std::uint64_t(1) << (index % 64))))
+    return false;
+  auto& packed = block->sections[index];
+  section.location = loc;
+  section.elevation = packed.elevation;
+  for (int i = 0; i < common::landcover_tiles_per_sector; ++i)
+    section.landcover[i] = static_cast<common::LandCover>(packed.landcover[i]);
+  return true;
+}
+
+std::size_t SectionDatabase::get_num_blocks() const {
+  return num_blocks_;
+}
+
+std::size_t SectionDatabase::get_size() const {
+  return size_;
+}
+
+void SectionDatabaseWriter::add(Location2D loc, const Section& section) {
+  auto [block_loc, index] = locate(loc);
+  auto& block = blocks_[std::make_pair(block_loc[0], block_loc[1])];
+  if (!block)
+    block = std::make_unique<Block>();
+  auto& presence = block->presence[index / 64];
+  auto bit = std::uint64_t(1) << (index % 64);
+  if (!(presence & bit))
+    ++num_sections_;
+  presence |= bit;
+  auto& packed = block->sections[index];
+  packed.elevation = static_cast<std::int16_t>(std::clamp(section.elevation, -32768, 32767));
+  for (int i = 0; i < common::landcover_tiles_per_sector; ++i)
+    packed.landcover[i] = static_cast<std::uint8_t>(section.landcover[i]);
+}
+
+std::size_t SectionDatabaseWriter::get_num_sections() const {
+  return num_sections_;
+}
+
+void SectionDatabaseWriter::write(const std::string& path) const {
+  // write next to the destination and rename so a server never maps a half written file
+  auto tmp_path = path + ".tmp";
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!file)
+      throw std::runtime_error("can't write section database " + tmp_path);
+
+    Header header{magic, version, block_size, common::landcover_tiles_per_sector, static_cast<std::uint32_t>(blocks_.size())};
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    std::uint64_t offset = sizeof(Header) + blocks_.size() * sizeof(BlockEntry);
+    // std::map is already in (x, y) order
+    for (auto& [block_loc, block] : blocks_) {
+      BlockEntry entry{block_loc.first, block_loc.second, offset};
+      file.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+      offset += sizeof(Block);
+    }
+    for (auto& [block_loc, block] : blocks_)
+      file.write(reinterpret_cast<const char*>(block.get()), sizeof(Block));
+    if (!file)
+      throw std::runtime_error("can't write section database " + tmp_path);
+  }
+  std::filesystem::rename(tmp_path, path);
+}
@@ -0,0 +1,107 @@
+#ifndef SECTION_DATABASE_H
+#define SECTION_DATABASE_H
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "common.h"
+#include "types.h"
+
+// On-disk layout of a baked section database, everything little endian:
+//   SectionDatabaseHeader
+//   SectionBlockEntry[num_blocks], sorted by (x, y)
+//   blocks, each a presence bitmap followed by a PackedSection per section in the block, row major by y
+// Only blocks with at least one baked section are stored.
+namespace section_database {
+  constexpr std::array<char, 8> magic = {'C', 'S', 'W', 'S', 'D', 'B', '0', '1'};
+  constexpr std::uint32_t version = 1;
+  // sections per block side
+  constexpr int block_size = 64;
+  constexpr int sections_per_block = block_size * block_size;
+  constexpr int presence_words = sections_per_block / 64;
+
+  struct Header {
+    std::array<char, 8> magic;
+    std::uint32_t version;
+    std::uint32_t block_size;
+    std::uint32_t landcover_per_section;
+    std::uint32_t num_blocks;
+  };
+
+  struct BlockEntry {
+    std::int32_t x;
+    std::int32_t y;
+    std::uint64_t offset;
+  };
+
+  struct PackedSection {
+    std::int16_t elevation;
+    std::array<std::uint8_t, common::landcover_tiles_per_sector> landcover;
+  };
+
+  struct Block {
+    std::array<std::uint64_t, presence_words> presence;
+    std::array<PackedSection, sections_per_block> sections;
+  };
+
+  static_assert(sizeof(Header) == 24);
+  static_assert(sizeof(BlockEntry) == 16);
+  static_assert(sizeof(Block) % alignof(std::uint64_t) == 0);
+
+  // block of a section and its index inside that block, rounding towards negative infinity
+  inline std::pair<Location2D, int> locate(Location2D loc) {
+    auto floor_div = [](int a) { return a >= 0 ? a / block_size : -((-a + block_size - 1) / block_size); };
+    Location2D block{floor_div(loc[0]), floor_div(loc[1])};
+    int x = loc[0] - block[0] * block_size;
+    int y = loc[1] - block[1] * block_size;
+    return {block, y * block_size + x};
+  }
+} // namespace section_database
+
+// Read-only view of a baked section database. The file is mapped rather than read, so
+// opening is instant whatever its size and servers on one machine share the pages
+class SectionDatabase {
+public:
+  // throws if the file can't be mapped or isn't a section database
+  SectionDatabase(const std::string& path);
+  ~SectionDatabase();
+  SectionDatabase(const SectionDatabase& other) = delete;
+  SectionDatabase& operator=(const SectionDatabase& other) = delete;
+
+  // false if the section wasn't baked
+  bool find(Location2D loc, Section& section) const;
+  std::size_t get_num_blocks() const;
+  std::size_t get_size() const;
+
+private:
+  void unmap();
+  const section_database::Block* find_block(Location2D block) const;
+
+  const std::uint8_t* data_ = nullptr;
+  std::size_t size_ = 0;
+  const section_database::BlockEntry* entries_ = nullptr;
+  std::size_t num_blocks_ = 0;
+#ifdef _WIN32
+  void* file_ = nullptr;
+  void* mapping_ = nullptr;
+#endif
+};
+
+// Collects sections in memory and writes them out in the layout SectionDatabase maps
+class SectionDatabaseWriter {
+public:
+  void add(Location2D loc, const Section& section);
+  std::size_t get_num_sections() const;
+  // throws if the file can't be written
+  void write(const std::string& path) const;
+
+private:
+  std::map<std::pair<int, int>, std::unique_ptr<section_database::Block>> blocks_;
+  std::size_t num_sections_ = 0;
+};
+
+#endif
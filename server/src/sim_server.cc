@@ -2,49 +2,493 @@
 #include <SDKDDKVer.h>
 #endif
 #include "sim_server.h"
+#include <algorithm>
+#include "admin_server.h"
+#include "chunk.h"
 #include "common_generated.h"
 #include "request_generated.h"
+#include "section_batch.h"
 #include "update_generated.h"
 
-SimServer::SimServer(TCPServer& tcp_server) : tcp_server_(tcp_server) {}
+namespace {
+  std::uint64_t micros_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+  }
+} // namespace
+
+SimServer::SimServer(TCPServer& tcp_server, std::unique_ptr<TileProvider> tile_provider, std::unique_ptr<SectionDatabase> section_database,
+                     unsigned int num_workers)
+    : tcp_server_(tcp_server),
+      world_generator_(std::move(tile_provider), std::move(section_database)),
+      chunk_store_(world_generator_, worker_pool_, chunk_cache_budget),
+      edit_store_(common::get_data_dir() + std::string("/edits.sqlite")),
+      worker_pool_(num_workers) {
+  std::cout << "Generating sections on " << worker_pool_.get_num_threads() << " threads" << std::endl;
+}
 
-void SimServer::step() {
-  
+void SimServer::run() {
   MessageWithId msg_with_id;
   auto& q = tcp_server_.get_queue();
-  bool success = q.try_dequeue(msg_with_id);
-  while (success) {
-    auto id = msg_with_id.id;
-    auto& message = msg_with_id.message;
+  std::uint64_t num_requests = 0;
+  auto next_tick = std::chrono::steady_clock::now() + edit_tick;
+  auto last_rate_sample = std::chrono::steady_clock::now();
+  std::uint64_t last_sections = 0;
+  while (true) {
+    // the tick only runs while there are edits to send or save, or a rate to bring down to zero,
+    // an idle server sleeps until the next request
+    bool ticking = !pending_edits_.empty() || columns_to_catch_up_ || edit_store_.has_unsaved() ||
+                   sections_per_second_ > 0 || sections_generated_ != last_sections;
+    bool popped = true;
+    if (ticking)
+      popped = q.pop_until(msg_with_id, next_tick);
+    else
+      q.pop(msg_with_id);
+    if (popped) {
+      handle_request(msg_with_id);
+      if (++num_requests % tile_report_interval == 0) {
+        std::cout << world_generator_.get_tile_fetcher().report() << std::endl;
+        std::cout << chunk_store_.report() << std::endl;
+        std::cout << "sections: " << sections_generated_ << " generated, " << sections_cancelled_ << " cancelled" << std::endl;
+        std::cout << "edits: " << edit_store_.get_num_edits() << " voxels in " << edit_store_.get_num_chunks() << " chunks"
+                  << std::endl;
+      }
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (now >= next_tick) {
+      flush_edits();
+      next_tick = now + edit_tick;
+    }
+    if (now - last_rate_sample >= rate_interval) {
+      std::uint64_t sections = sections_generated_;
+      sections_per_second_ = (sections - last_sections) / std::chrono::duration<double>(now - last_rate_sample).count();
+      last_sections = sections;
+      last_rate_sample = now;
+    }
+  }
+}
+
+void SimServer::handle_request(MessageWithId& msg_with_id) {
+  auto id = msg_with_id.id;
+  auto& message = msg_with_id.message;
+  if (message.empty()) {
+    interests_.erase(id);
+    {
+      std::unique_lock<std::mutex> lock(jobs_mutex_);
+      epochs_.erase(id);
+    }
+    std::unique_lock<std::mutex> lock(order_mutex_);
+    connection_orders_.erase(id);
+    return;
+  }
 
-    auto* request = fbs_request::GetRequest(message.data());
+  flatbuffers::Verifier verifier(message.data(), message.size());
+  if (!fbs_request::VerifyRequestBuffer(verifier)) {
+    std::cerr << "dropping malformed request from " << id << std::endl;
+    return;
+  }
+  auto* request = fbs_request::GetRequest(message.data());
+  auto* sections = request->sections();
+  auto* chunks = request->chunks();
+  handle_edits(id, request->edits());
+  update_interest(id, *request);
+
+  bool has_sections = sections && sections->size() > 0;
+  bool has_chunks = chunks && chunks->size() > 0;
+  // a request for chunks alone gets no section reply, and neither does one that only carries edits
+  bool replication_only =
+    request->edits() || request->released_sections() || request->released_chunks() || request->held_sections();
+  if (has_sections || (!has_chunks && !replication_only))
+    handle_sections(id, *request);
+  if (has_chunks)
+    handle_chunks(id, chunks);
+}
+
+void SimServer::handle_sections(int id, const fbs_request::Request& request) {
+  auto* sections = request.sections();
+  auto* priorities = request.priorities();
+  std::size_t num_sections = sections ? sections->size() : 0;
+  bool prioritised = priorities && priorities->size() == num_sections;
+
+  auto pending = std::make_shared<PendingRequest>();
+  pending->connection_id = id;
+  pending->epoch = request.epoch();
+  pending->tag = request.tag();
+  if (pending->epoch != 0) {
+    std::unique_lock<std::mutex> lock(jobs_mutex_);
+    auto& epoch = epochs_[id];
+    epoch = std::max(epoch, pending->epoch);
+  }
+
+  std::vector<std::size_t> order(num_sections);
+  for (std::size_t i = 0; i < num_sections; ++i)
+    order[i] = i;
+  if (prioritised)
+    std::stable_sort(order.begin(), order.end(), [priorities](std::size_t a, std::size_t b) { return priorities->Get(a) < priorities->Get(b); });
+  pending->locations.reserve(num_sections);
+  pending->priorities.reserve(num_sections);
+  for (auto i : order) {
+    auto* loc = sections->Get(i);
+    pending->locations.push_back(Location2D{loc->x(), loc->y()});
+    pending->priorities.push_back(prioritised ? priorities->Get(i) : unprioritised);
+  }
+  pending->sections.resize(num_sections);
+
+  std::size_t num_jobs = (num_sections + sections_per_job - 1) / sections_per_job;
+  pending->remaining_jobs = static_cast<int>(num_jobs);
+  // nothing to generate, the reply is a single empty batch
+  if (num_jobs == 0) {
+    pending->remaining_jobs = 1;
+    finish_section_job(*pending, 0, 0, JobOutcome::generated);
+    return;
+  }
+  // most urgent first, so their tiles are fetched first too
+  auto asked = std::chrono::steady_clock::now();
+  for (std::size_t job = 0; job < num_jobs; ++job) {
+    auto begin = job * sections_per_job;
+    auto end = std::min(num_sections, begin + sections_per_job);
+    // park the job until its tiles are in so workers never block on a fetch
+    std::vector<Location2D> locs(pending->locations.begin() + begin, pending->locations.begin() + end);
+    world_generator_.when_ready(locs, [this, pending, begin, end, asked] {
+      tile_latency_.record(micros_since(asked));
+      queue_section_job(SectionJob{pending, begin, end, pending->priorities[begin], 0, {}});
+    });
+  }
+}
 
-    auto* sections = request->sections();
+void SimServer::handle_chunks(int id, const flatbuffers::Vector<const fbs_common::Location*>* chunks) {
+  std::uint64_t sequence;
+  {
+    std::unique_lock<std::mutex> lock(order_mutex_);
+    sequence = connection_orders_[id].next_sequence++;
+  }
+  std::vector<Location> locs;
+  locs.reserve(chunks->size());
+  for (std::size_t i = 0; i < chunks->size(); ++i) {
+    auto* loc = chunks->Get(i);
+    locs.push_back(Location{loc->x(), loc->y(), loc->z()});
+  }
+  chunk_store_.when_ready(locs, [this, id, sequence, locs](std::vector<std::shared_ptr<const EncodedChunk>> chunks) {
+    send_in_order(id, sequence, build_chunk_update(locs, chunks));
+  });
+}
 
-    // construct new update
-    flatbuffers::FlatBufferBuilder builder(common::max_msg_buffer_size);
-    std::vector<flatbuffers::Offset<fbs_update::Section>> returning_sections;
+void SimServer::handle_edits(int id, const flatbuffers::Vector<flatbuffers::Offset<fbs_common::ChunkEdits>>* edits) {
+  if (!edits)
+    return;
+  std::vector<VoxelEdit> valid;
+  for (std::size_t i = 0; i < edits->size(); ++i) {
+    auto* chunk_edits = edits->Get(i);
+    auto* loc = chunk_edits->location();
+    auto* voxel_edits = chunk_edits->edits();
+    if (!loc || !voxel_edits)
+      continue;
+    auto location = Location{loc->x(), loc->y(), loc->z()};
+    valid.clear();
+    for (std::size_t j = 0; j < voxel_edits->size(); ++j) {
+      auto* edit = voxel_edits->Get(j);
+      if (edit->index() >= Chunk::sz || edit->voxel() >= static_cast<std::uint8_t>(Voxel::voxel_enum_size))
+        continue;
+      valid.push_back(VoxelEdit{edit->index(), static_cast<Voxel>(edit->voxel())});
+    }
+    if (valid.empty())
+      continue;
+    edit_store_.apply(location, valid);
+    auto& pending = pending_edits_[location];
+    for (auto& edit : valid)
+      pending.insert_or_assign(edit.index, PendingEdit{edit.voxel, id});
+  }
+}
 
-    for (int i = 0; i < sections->size(); ++i) {
+void SimServer::update_interest(int id, const fbs_request::Request& request) {
+  auto& interest = interests_[id];
+  auto add_sections = [this, &interest](const flatbuffers::Vector<const fbs_common::Location2D*>* sections) {
+    if (!sections)
+      return;
+    for (std::size_t i = 0; i < sections->size(); ++i) {
       auto* loc = sections->Get(i);
-      auto x = loc->x(), y = loc->y();
-      auto sec = world_generator_.get_section(Location2D{x, y});
-      auto landcover = builder.CreateVector(reinterpret_cast<uint8_t*>(sec.landcover.data()), sec.landcover.size());
-      auto section = fbs_update::CreateSection(builder, loc, sec.elevation, landcover);
-      returning_sections.push_back(std::move(section));
+      auto location = Location2D{loc->x(), loc->y()};
+      if (interest.sections.insert(location).second) {
+        interest.new_sections.push_back(location);
+        columns_to_catch_up_ = true;
+      }
+    }
+  };
+  add_sections(request.sections());
+  add_sections(request.held_sections());
+  // chunks go out with their edits applied, so there's nothing to catch up on
+  if (auto* chunks = request.chunks()) {
+    for (std::size_t i = 0; i < chunks->size(); ++i) {
+      auto* loc = chunks->Get(i);
+      interest.chunks.insert(Location{loc->x(), loc->y(), loc->z()});
+    }
+  }
+  if (auto* released = request.released_sections()) {
+    for (std::size_t i = 0; i < released->size(); ++i) {
+      auto* loc = released->Get(i);
+      interest.sections.erase(Location2D{loc->x(), loc->y()});
     }
+  }
+  if (auto* released = request.released_chunks()) {
+    for (std::size_t i = 0; i < released->size(); ++i) {
+      auto* loc = released->Get(i);
+      interest.chunks.erase(Location{loc->x(), loc->y(), loc->z()});
+    }
+  }
+}
+
+bool SimServer::Interest::covers(const Location& loc) const {
+  return sections.contains(Location2D{loc[0], loc[2]}) || chunks.contains(loc);
+}
 
-    auto returned_region = fbs_update::CreateRegionUpdate(builder, builder.CreateVector(returning_sections));
-    auto update_kind = fbs_update::UpdateKind_Region;
-    auto returned_update = fbs_update::CreateUpdate(builder, fbs_update::UpdateKind_Region, returned_region.Union());
-    FinishSizePrefixedUpdateBuffer(builder, returned_update);
+void SimServer::flush_edits() {
+  for (auto& [id, interest] : interests_) {
+    std::vector<ChunkEdits> chunks;
+    // a column caught up on here already has this tick's edits
+    std::unordered_set<Location2D, Location2DHash> caught_up;
+    for (auto& column : interest.new_sections) {
+      if (interest.sections.contains(column) && caught_up.insert(column).second)
+        edit_store_.get_column_edits(column, chunks);
+    }
+    interest.new_sections.clear();
 
-    const auto* buffer_pointer = builder.GetBufferPointer();
-    const auto buffer_size = builder.GetSize();
+    for (auto& [loc, edits] : pending_edits_) {
+      if (!interest.covers(loc) || caught_up.contains(Location2D{loc[0], loc[2]}))
+        continue;
+      ChunkEdits chunk_edits{loc, {}};
+      for (auto& [index, edit] : edits) {
+        if (edit.origin != id)
+          chunk_edits.edits.push_back(VoxelEdit{index, edit.voxel});
+      }
+      if (!chunk_edits.edits.empty())
+        chunks.push_back(std::move(chunk_edits));
+    }
+
+    if (!chunks.empty())
+      tcp_server_.write(MessageWithId{build_edit_update(chunks), id});
+  }
+  pending_edits_.clear();
+  columns_to_catch_up_ = false;
+  // a tick's edits go to disk in one transaction, off the sim thread
+  if (edit_store_.has_unsaved())
+    worker_pool_.submit([this] { edit_store_.save(); });
+}
+
+bool SimServer::SectionJob::operator<(const SectionJob& other) const {
+  if (priority != other.priority)
+    return priority > other.priority;
+  return order > other.order;
+}
+
+void SimServer::queue_section_job(SectionJob job) {
+  {
+    std::unique_lock<std::mutex> lock(jobs_mutex_);
+    job.order = next_job_order_++;
+    job.queued_at = std::chrono::steady_clock::now();
+    section_jobs_.push(std::move(job));
+  }
+  worker_pool_.submit([this] { run_section_job(); });
+}
+
+void SimServer::run_section_job() {
+  SectionJob job;
+  bool cancelled;
+  {
+    std::unique_lock<std::mutex> lock(jobs_mutex_);
+    job = section_jobs_.top();
+    section_jobs_.pop();
+    auto it = epochs_.find(job.request->connection_id);
+    cancelled = job.request->epoch != 0 && it != epochs_.end() && job.request->epoch < it->second;
+  }
+  queue_latency_.record(micros_since(job.queued_at));
+  auto& request = *job.request;
+  auto num_sections = job.end - job.begin;
+  if (cancelled) {
+    sections_cancelled_ += num_sections;
+    finish_section_job(request, job.begin, job.end, JobOutcome::cancelled);
+    return;
+  }
+
+  auto outcome = JobOutcome::generated;
+  try {
+    auto start = std::chrono::steady_clock::now();
+    world_generator_.get_sections(
+      std::span(request.locations).subspan(job.begin, num_sections), std::span(request.sections).subspan(job.begin, num_sections));
+    rasterize_latency_.record(micros_since(start));
+    sections_generated_ += num_sections;
+  } catch (const std::exception& e) {
+    std::cerr << "failed to generate sections for " << request.connection_id << ": " << e.what() << std::endl;
+    outcome = JobOutcome::failed;
+  }
+  finish_section_job(request, job.begin, job.end, outcome);
+}
+
+void SimServer::finish_section_job(PendingRequest& request, std::size_t begin, std::size_t end, JobOutcome outcome) {
+  std::unique_lock<std::mutex> lock(request.reply_mutex);
+  bool last = --request.remaining_jobs == 0;
+  if (outcome == JobOutcome::cancelled && !last)
+    return;
+  if (outcome == JobOutcome::cancelled)
+    end = begin;
+  auto start = std::chrono::steady_clock::now();
+  auto update = build_update(request, begin, end, !last, outcome == JobOutcome::failed);
+  serialize_latency_.record(micros_since(start));
+  tcp_server_.write(MessageWithId{std::move(update), request.connection_id});
+}
+
+std::string SimServer::render_metrics() {
+  MetricsPage page;
+  page.gauge("connections", tcp_server_.get_num_connections());
+  page.gauge("request_queue_depth", tcp_server_.get_queue().size());
+  {
+    std::unique_lock<std::mutex> lock(jobs_mutex_);
+    page.gauge("section_jobs_queued", section_jobs_.size());
+  }
+  page.counter("sections_generated_total", sections_generated_);
+  page.counter("sections_cancelled_total", sections_cancelled_);
+  page.gauge("sections_per_second", sections_per_second_.load());
+
+  auto& tile_fetcher = world_generator_.get_tile_fetcher();
+  page.summary("stage_latency_us", tile_latency_, "stage=\"tile_lookup\"");
+  page.summary("stage_latency_us", tile_fetcher.get_decode_latency(), "stage=\"decode\"");
+  page.summary("stage_latency_us", queue_latency_, "stage=\"queue\"");
+  page.summary("stage_latency_us", rasterize_latency_, "stage=\"rasterize\"");
+  page.summary("stage_latency_us", serialize_latency_, "stage=\"serialize\"");
+  page.summary("stage_latency_us", tcp_server_.get_latencies().compress, "stage=\"compress\"");
+  page.summary("stage_latency_us", tcp_server_.get_latencies().write, "stage=\"write\"");
+
+  std::uint64_t hits = tile_fetcher.get_hits();
+  std::uint64_t misses = tile_fetcher.get_misses();
+  page.counter("tile_cache_hits_total", hits);
+  page.counter("tile_cache_misses_total", misses);
+  page.gauge("tile_cache_hit_ratio", hits + misses > 0 ? static_cast<double>(hits) / (hits + misses) : 0.0);
+  page.gauge("tile_cache_bytes", tile_fetcher.get_cache_bytes());
+  page.gauge("tile_cache_budget_bytes", tile_fetcher.get_cache_budget());
+  page.counter("tile_cache_evictions_total", tile_fetcher.get_evictions());
+  page.counter("tile_fetch_failures_total", tile_fetcher.get_failures());
+
+  auto connections = tcp_server_.get_connection_stats();
+  auto labels_of = [](const TCPServer::ConnectionStats& connection) {
+    return "connection=\"" + std::to_string(connection.id) + "\",transport=\"" + (connection.shm ? "shm" : "tcp") + "\"";
+  };
+  for (auto& connection : connections)
+    page.counter("connection_bytes_in_total", connection.bytes_in, labels_of(connection));
+  for (auto& connection : connections)
+    page.counter("connection_bytes_out_total", connection.bytes_out, labels_of(connection));
+  return page.str();
+}
+
+Message SimServer::build_update(const PendingRequest& request, std::size_t begin, std::size_t end, bool more, bool failed) {
+  flatbuffers::FlatBufferBuilder builder(common::max_msg_buffer_size);
+  flatbuffers::Offset<flatbuffers::Vector<const fbs_common::Location2D*>> failed_vector;
+  if (failed) {
+    std::vector<fbs_common::Location2D> failed_locations;
+    failed_locations.reserve(end - begin);
+    for (std::size_t i = begin; i < end; ++i)
+      failed_locations.push_back(fbs_common::Location2D(request.locations[i][0], request.locations[i][1]));
+    failed_vector = builder.CreateVectorOfStructs(failed_locations);
+    end = begin;
+  }
+  auto count = end - begin;
+  std::vector<std::int32_t> xs, zs;
+  std::vector<std::int16_t> elevations;
+  std::vector<std::uint8_t> landcover;
+  xs.reserve(count);
+  zs.reserve(count);
+  elevations.reserve(count);
+  landcover.reserve(count * common::landcover_tiles_per_sector);
+
+  for (std::size_t i = begin; i < end; ++i) {
+    auto& sec = request.sections[i];
+    auto& loc = request.locations[i];
+    xs.push_back(loc[0]);
+    zs.push_back(loc[1]);
+    elevations.push_back(static_cast<std::int16_t>(std::clamp(sec.elevation, -32768, 32767)));
+    for (auto tile : sec.landcover)
+      landcover.push_back(static_cast<std::uint8_t>(tile));
+  }
+
+  fbs_common::Location2D origin(xs.empty() ? 0 : xs[0], zs.empty() ? 0 : zs[0]);
+  std::vector<std::uint8_t> coords, packed_landcover;
+  common::encode_section_coords(xs, zs, origin.x(), origin.y(), coords);
+  common::pack_landcover(landcover, packed_landcover);
+  auto coords_vector = builder.CreateVector(coords);
+  auto elevations_vector = builder.CreateVector(elevations);
+  auto landcover_vector = builder.CreateVector(packed_landcover);
+  auto batch = fbs_update::CreateSectionBatch(
+    builder, &origin, static_cast<std::uint32_t>(count), coords_vector, elevations_vector, landcover_vector, more, request.tag, failed_vector);
+  auto returned_update = fbs_update::CreateUpdate(builder, fbs_update::UpdateKind_Sections, batch.Union());
+  FinishSizePrefixedUpdateBuffer(builder, returned_update);
+
+  return common::MessagePool::instance()->acquire(builder.GetBufferPointer(), builder.GetSize());
+}
+
+Message SimServer::build_chunk_update(const std::vector<Location>& locs, const std::vector<std::shared_ptr<const EncodedChunk>>& chunks) {
+  flatbuffers::FlatBufferBuilder builder(common::max_msg_buffer_size);
+  std::vector<flatbuffers::Offset<fbs_update::Chunk>> returning_chunks;
+  returning_chunks.reserve(chunks.size());
+
+  for (std::size_t i = 0; i < chunks.size(); ++i) {
+    auto& chunk = chunks[i];
+    auto& loc = locs[i];
+    fbs_common::Location location(loc[0], loc[1], loc[2]);
+    // a failed chunk goes back without runs, so the client stops waiting on it and asks again
+    if (!chunk) {
+      returning_chunks.push_back(fbs_update::CreateChunk(builder, &location));
+      continue;
+    }
+    flatbuffers::Offset<flatbuffers::Vector<std::uint32_t>> runs;
+    // the cache holds chunks as generated, edits go on top as they're sent
+    if (edit_store_.has_edits(loc)) {
+      auto edited_runs = chunk->runs;
+      edit_store_.overlay(loc, edited_runs);
+      runs = builder.CreateVector(edited_runs);
+    } else {
+      runs = builder.CreateVector(chunk->runs);
+    }
+    returning_chunks.push_back(fbs_update::CreateChunk(builder, &location, runs));
+  }
+
+  auto returned_chunks = fbs_update::CreateChunkUpdate(builder, builder.CreateVector(returning_chunks));
+  auto returned_update = fbs_update::CreateUpdate(builder, fbs_update::UpdateKind_Chunks, returned_chunks.Union());
+  FinishSizePrefixedUpdateBuffer(builder, returned_update);
+
+  return common::MessagePool::instance()->acquire(builder.GetBufferPointer(), builder.GetSize());
+}
+
+Message SimServer::build_edit_update(const std::vector<ChunkEdits>& chunks) {
+  flatbuffers::FlatBufferBuilder builder(common::max_msg_buffer_size);
+  std::vector<flatbuffers::Offset<fbs_common::ChunkEdits>> returning_chunks;
+  returning_chunks.reserve(chunks.size());
+
+  std::vector<fbs_common::VoxelEdit> voxel_edits;
+  for (auto& chunk : chunks) {
+    voxel_edits.clear();
+    for (auto& edit : chunk.edits)
+      voxel_edits.push_back(fbs_common::VoxelEdit(edit.index, static_cast<std::uint8_t>(edit.voxel)));
+    fbs_common::Location location(chunk.location[0], chunk.location[1], chunk.location[2]);
+    auto edits = builder.CreateVectorOfStructs(voxel_edits);
+    returning_chunks.push_back(fbs_common::CreateChunkEdits(builder, &location, edits));
+  }
+
+  auto returned_edits = fbs_update::CreateEditUpdate(builder, builder.CreateVector(returning_chunks));
+  auto returned_update = fbs_update::CreateUpdate(builder, fbs_update::UpdateKind_Edits, returned_edits.Union());
+  FinishSizePrefixedUpdateBuffer(builder, returned_update);
+
+  return common::MessagePool::instance()->acquire(builder.GetBufferPointer(), builder.GetSize());
+}
 
-    Message returned_message(buffer_size);
-    std::memcpy(returned_message.data(), buffer_pointer, buffer_size);
-    tcp_server_.write(MessageWithId{returned_message, id});
-    success = q.try_dequeue(msg_with_id);
+void SimServer::send_in_order(int connection_id, std::uint64_t sequence, Message message) {
+  std::unique_lock<std::mutex> lock(order_mutex_);
+  // the connection closed while its chunks were generating
+  auto it = connection_orders_.find(connection_id);
+  if (it == connection_orders_.end())
+    return;
+  auto& order = it->second;
+  order.ready.emplace(sequence, std::move(message));
+  while (!order.ready.empty() && order.ready.begin()->first == order.next_to_send) {
+    auto node = order.ready.extract(order.ready.begin());
+    if (!node.mapped().empty())
+      tcp_server_.write(MessageWithId{std::move(node.mapped()), connection_id});
+    ++order.next_to_send;
   }
 }
@@ -1,16 +1,147 @@
 #ifndef SIM_SERVER_H
 #define SIM_SERVER_H
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+#include "chunk_store.h"
+#include "common_generated.h"
+#include "edit_store.h"
+#include "latency_histogram.h"
+#include "request_generated.h"
 #include "tcp_server.h"
 #include "types.h"
+#include "worker_pool.h"
 #include "world_generator.h"
 
 class SimServer {
 public:
-  SimServer(TCPServer& tcp_server);
-  void step();
+  // section_database is optional, sections missing from it are generated from tiles.
+  // num_workers sizes the section worker pool, 0 uses one thread per hardware thread
+  SimServer(TCPServer& tcp_server, std::unique_ptr<TileProvider> tile_provider, std::unique_ptr<SectionDatabase> section_database,
+            unsigned int num_workers = 0);
+  // sleeps until requests arrive or the next edit tick, never returns
+  void run();
+  // the admin port's page, safe to call from any thread
+  std::string render_metrics();
 
 private:
+  struct PendingRequest {
+    int connection_id;
+    std::uint64_t epoch;
+    std::uint64_t tag;
+    // most urgent first
+    std::vector<Location2D> locations;
+    std::vector<std::uint16_t> priorities;
+    std::vector<Section> sections;
+    // held while a batch is sent so the last one always goes out last
+    std::mutex reply_mutex;
+    int remaining_jobs;
+  };
+  enum class JobOutcome {
+    generated,
+    // a later request from the same connection superseded it
+    cancelled,
+    failed,
+  };
+  // a slice of a request, queued once its tiles are in
+  struct SectionJob {
+    std::shared_ptr<PendingRequest> request;
+    std::size_t begin;
+    std::size_t end;
+    std::uint16_t priority;
+    // first come first served between equal priorities
+    std::uint64_t order;
+    std::chrono::steady_clock::time_point queued_at;
+
+    // the most urgent job is the greatest
+    bool operator<(const SectionJob& other) const;
+  };
+  // chunk requests are generated out of order across the pool, but replies on a connection
+  // go out in the order the requests came in
+  struct ConnectionOrder {
+    std::uint64_t next_sequence = 0;
+    std::uint64_t next_to_send = 0;
+    std::map<std::uint64_t, Message> ready;
+  };
+  // what a client holds, edits to chunks outside it aren't sent to it. Section clients hold whole
+  // columns, chunk clients hold the chunks they asked for
+  struct Interest {
+    std::unordered_set<Location2D, Location2DHash> sections;
+    std::unordered_set<Location, LocationHash> chunks;
+    // sections added since the last tick, sent everything already edited in them
+    std::vector<Location2D> new_sections;
+
+    bool covers(const Location& loc) const;
+  };
+  // waits for the next tick, the client it came from already has it
+  struct PendingEdit {
+    Voxel voxel;
+    int origin;
+  };
+
+  void handle_request(MessageWithId& msg_with_id);
+  void handle_sections(int id, const fbs_request::Request& request);
+  void handle_chunks(int id, const flatbuffers::Vector<const fbs_common::Location*>* chunks);
+  void handle_edits(int id, const flatbuffers::Vector<flatbuffers::Offset<fbs_common::ChunkEdits>>* edits);
+  void update_interest(int id, const fbs_request::Request& request);
+  // sends every client the edits made in its interest since the last tick, one message each
+  void flush_edits();
+  void queue_section_job(SectionJob job);
+  // runs the most urgent queued job, the pool is handed one of these per queued job
+  void run_section_job();
+  // sends the job's sections as a batch. A failed job sends its locations as failed instead, a cancelled one
+  // only sends the final empty batch
+  void finish_section_job(PendingRequest& request, std::size_t begin, std::size_t end, JobOutcome outcome);
+  // with failed set the sections from begin to end go in the batch's failed list
+  Message build_update(const PendingRequest& request, std::size_t begin, std::size_t end, bool more, bool failed);
+  // chunks[i] is the chunk at locs[i], null if it failed
+  Message build_chunk_update(const std::vector<Location>& locs, const std::vector<std::shared_ptr<const EncodedChunk>>& chunks);
+  Message build_edit_update(const std::vector<ChunkEdits>& chunks);
+  // an empty message only advances the sequence
+  void send_in_order(int connection_id, std::uint64_t sequence, Message message);
+
+  static constexpr std::size_t sections_per_job = 16;
+  // sections sent without a priority go after every one sent with one
+  static constexpr std::uint16_t unprioritised = 0xffff;
+  // requests between tile cache reports
+  static constexpr std::uint64_t tile_report_interval = 1000;
+  static constexpr std::size_t chunk_cache_budget = 64 * 1024 * 1024;
+  static constexpr auto edit_tick = std::chrono::milliseconds(50);
+  // sections_per_second_ is averaged over this
+  static constexpr auto rate_interval = std::chrono::seconds(1);
+
   TCPServer& tcp_server_;
   WorldGenerator world_generator_;
+  ChunkStore chunk_store_;
+  EditStore edit_store_;
+  // only touched by the sim thread
+  std::unordered_map<int, Interest> interests_;
+  std::unordered_map<Location, std::map<std::uint16_t, PendingEdit>, LocationHash> pending_edits_;
+  // some interest has new_sections for the next tick
+  bool columns_to_catch_up_ = false;
+  std::mutex jobs_mutex_;
+  std::priority_queue<SectionJob> section_jobs_;
+  std::uint64_t next_job_order_ = 0;
+  // latest epoch each connection sent, jobs from earlier ones are dropped
+  std::unordered_map<int, std::uint64_t> epochs_;
+  std::atomic<std::uint64_t> sections_generated_{0};
+  std::atomic<std::uint64_t> sections_cancelled_{0};
+  std::atomic<double> sections_per_second_{0};
+  // per stage of a section request, in microseconds: tiles are waited on, the job waits for a worker,
+  // the tiles are rasterized into sections, the batch is serialized. Decode and write are kept by
+  // the tile fetcher and the tcp server
+  common::LatencyHistogram tile_latency_;
+  common::LatencyHistogram queue_latency_;
+  common::LatencyHistogram rasterize_latency_;
+  common::LatencyHistogram serialize_latency_;
+  std::mutex order_mutex_;
+  std::unordered_map<int, ConnectionOrder> connection_orders_;
+  // last so the workers are joined before anything they use goes away
+  WorkerPool worker_pool_;
 };
-#endif
\ No newline at end of file
+#endif
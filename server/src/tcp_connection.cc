@@ -1,54 +1,219 @@
 #include "tcp_connection.h"
+#include "compression.h"
+#include "handshake_generated.h"
 
-TCPConnection::TCPConnection(asio::io_context& io_context, int id, moodycamel::ReaderWriterQueue<MessageWithId>& q) : socket_(io_context), id_(id), q_(q) {}
+TCPConnection::TCPConnection(tcp::socket&& socket, int id, Channel<MessageWithId>& q, Latencies& latencies, CloseHandler on_close)
+    : id_(id), socket_(std::move(socket)), write_queue_(write_queue_soft_limit, write_queue_hard_limit),
+      q_(q), latencies_(latencies), on_close_(std::move(on_close)) {}
 
 tcp::socket& TCPConnection::socket() {
   return socket_;
 }
 
-TCPConnection::pointer TCPConnection::create(asio::io_context& io_context, int id, moodycamel::ReaderWriterQueue<MessageWithId>& q) {
-  return pointer(new TCPConnection(io_context, id, q));
+TCPConnection::pointer TCPConnection::create(tcp::socket&& socket, int id, Channel<MessageWithId>& q, Latencies& latencies, CloseHandler on_close) {
+  return pointer(new TCPConnection(std::move(socket), id, q, latencies, std::move(on_close)));
 }
 
 void TCPConnection::start() {
-  asio::async_read(
-    socket_,
-    asio::buffer(read_buffer_, header_length),
-    boost::bind(&TCPConnection::handle_read_header, this, asio::placeholders::error));
+  asio::error_code ignored_error;
+  socket_.set_option(tcp::no_delay(true), ignored_error);
+  asio::post(socket_.get_executor(), boost::bind(&TCPConnection::read_header, shared_from_this()));
 }
 
 void TCPConnection::write(const Message& message) {
-  asio::error_code ignored_error;
+  if (using_shm_.load()) {
+    bytes_out_ += message.size();
+    shm_->write(message);
+    return;
+  }
+  // compressed on the calling thread, the queue and socket are only touched on the connection's strand
+  auto frame = message;
+  if (compress_.load() && message.size() >= common::frame_header_length + common::compression_threshold) {
+    auto start = std::chrono::steady_clock::now();
+    frame = common::compress_frame(message);
+    latencies_.compress.record(
+      std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+  }
+  asio::post(socket_.get_executor(), boost::bind(&TCPConnection::queue_write, shared_from_this(), std::move(frame)));
+}
+
+std::uint64_t TCPConnection::get_bytes_in() const {
+  return bytes_in_;
+}
+
+std::uint64_t TCPConnection::get_bytes_out() const {
+  return bytes_out_;
+}
+
+bool TCPConnection::is_using_shm() const {
+  return using_shm_.load();
+}
+
+void TCPConnection::queue_write(const Message& message) {
+  if (closed_)
+    return;
+  bool idle = write_queue_.push(message);
+  if (write_queue_.over_hard_limit()) {
+    std::cerr << "dropping connection " << id_ << ", " << write_queue_.get_queued_bytes() << " bytes queued" << std::endl;
+    close();
+    return;
+  }
+  if (idle)
+    start_write();
+}
+
+void TCPConnection::start_write() {
+  auto& batch = write_queue_.start_batch();
+  write_buffers_.clear();
+  write_batch_bytes_ = 0;
+  for (auto& message : batch) {
+    write_buffers_.push_back(asio::buffer(message.data(), message.size()));
+    write_batch_bytes_ += message.size();
+  }
+  write_started_ = std::chrono::steady_clock::now();
   asio::async_write(
     socket_,
-    asio::buffer(message.data(), message.size()),
-    boost::bind(&TCPConnection::handle_write, this));
+    write_buffers_,
+    boost::bind(&TCPConnection::handle_write, shared_from_this(), asio::placeholders::error));
 }
 
-void TCPConnection::handle_read_header(const ::asio::error_code& error) {
-  if (error)
+void TCPConnection::handle_write(const asio::error_code& error) {
+  if (error) {
+    close();
+    write_queue_.clear();
     return;
+  }
+  bytes_out_ += write_batch_bytes_;
+  latencies_.write.record(
+    std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - write_started_).count());
+  if (write_queue_.finish_batch())
+    start_write();
+  if (reading_paused_ && write_queue_.drained()) {
+    reading_paused_ = false;
+    read_header();
+  }
+}
 
-  std::uint32_t body_length;
-  std::memcpy(&body_length, read_buffer_.data(), sizeof(body_length));
+void TCPConnection::close() {
+  if (closed_)
+    return;
+  closed_ = true;
+  if (shm_)
+    shm_->close();
+  asio::error_code ignored_error;
+  socket_.close(ignored_error);
+  on_close_(id_);
+}
 
+void TCPConnection::read_header() {
   asio::async_read(
     socket_,
-    asio::buffer(read_buffer_, body_length),
-    boost::bind(&TCPConnection::handle_read_body, this, asio::placeholders::error, body_length));
+    asio::buffer(header_buffer_),
+    boost::bind(&TCPConnection::handle_read_header, shared_from_this(), asio::placeholders::error));
 }
 
-void TCPConnection::handle_read_body(const asio::error_code& error, std::uint32_t body_length) {
-  if (error)
+void TCPConnection::handle_read_header(const ::asio::error_code& error) {
+  if (error) {
+    close();
     return;
-  MessageWithId msg_with_id = {Message(body_length), id_};
-  std::memcpy(msg_with_id.message.data(), read_buffer_.data(), body_length);
-  q_.enqueue(std::move(msg_with_id));
+  }
+
+  auto header = common::decode_frame_header(header_buffer_.data());
+  if (header.length > common::max_message_size) {
+    std::cerr << "dropping connection " << id_ << ", bad frame of " << header.length << " bytes" << std::endl;
+    close();
+    return;
+  }
+  body_buffer_ = common::MessagePool::instance()->acquire(header.length);
+  body_flags_ = header.flags;
 
   asio::async_read(
     socket_,
-    asio::buffer(read_buffer_, header_length),
-    boost::bind(&TCPConnection::handle_read_header, this, asio::placeholders::error));
+    asio::buffer(body_buffer_.data(), body_buffer_.size()),
+    boost::bind(&TCPConnection::handle_read_body, shared_from_this(), asio::placeholders::error));
+}
+
+void TCPConnection::handle_read_body(const asio::error_code& error) {
+  if (error) {
+    close();
+    return;
+  }
+  bytes_in_ += common::frame_header_length + body_buffer_.size();
+  if (!common::decompress_body(body_flags_, body_buffer_)) {
+    std::cerr << "dropping connection " << id_ << ", corrupt compressed frame" << std::endl;
+    close();
+    return;
+  }
+  if (!handshake_done_) {
+    handshake_done_ = true;
+    if (handle_handshake()) {
+      read_header();
+      return;
+    }
+  }
+  q_.push(MessageWithId{std::move(body_buffer_), id_});
+
+  // back-pressure, stop taking requests until the client has read what it asked for
+  if (write_queue_.over_soft_limit()) {
+    reading_paused_ = true;
+    return;
+  }
+  read_header();
 }
 
-void TCPConnection::handle_write() {}
+bool TCPConnection::handle_handshake() {
+  // a Request has no file identifier, so anything else is an older client going straight to requests
+  if (body_buffer_.size() < 8 || !fbs_handshake::HandshakeBufferHasIdentifier(body_buffer_.data()))
+    return false;
+  flatbuffers::Verifier verifier(body_buffer_.data(), body_buffer_.size());
+  const fbs_handshake::Hello* hello = nullptr;
+  if (fbs_handshake::VerifyHandshakeBuffer(verifier))
+    hello = fbs_handshake::GetHandshake(body_buffer_.data())->kind_as_Hello();
+
+  // only a peer on this machine can have made the segment it names, anyone else could be naming another
+  // client's segment to take it over
+  asio::error_code error;
+  auto remote = socket_.remote_endpoint(error);
+  bool local_peer = !error && remote.address().is_loopback();
+  std::unique_ptr<common::ShmChannel> channel;
+  if (hello && hello->shm_name() && local_peer)
+    channel = common::ShmChannel::open(hello->shm_name()->str());
+  if (channel) {
+    // the threads only hold a weak pointer, the connection is never destroyed on one of them
+    std::weak_ptr<TCPConnection> weak = shared_from_this();
+    auto executor = socket_.get_executor();
+    shm_ = std::make_unique<common::ShmConnection>(
+      std::move(channel),
+      write_queue_hard_limit,
+      // the reader is joined before the connection goes away
+      [this](Message body) {
+        bytes_in_ += common::frame_header_length + body.size();
+        q_.push(MessageWithId{std::move(body), id_});
+      },
+      [weak, executor] {
+        asio::post(executor, [weak] {
+          if (auto self = weak.lock())
+            self->close();
+        });
+      });
+  }
+
+  // compressing is only worth it on a socket, shared memory copies at memory speed
+  auto codec = fbs_handshake::Codec_None;
+  if (!shm_ && hello && hello->codec() == fbs_handshake::Codec_Lz)
+    codec = fbs_handshake::Codec_Lz;
+  compress_.store(codec == fbs_handshake::Codec_Lz);
+
+  flatbuffers::FlatBufferBuilder builder(64);
+  auto welcome = fbs_handshake::CreateWelcome(builder, shm_ != nullptr, codec);
+  auto handshake = fbs_handshake::CreateHandshake(builder, fbs_handshake::HandshakeKind_Welcome, welcome.Union());
+  fbs_handshake::FinishSizePrefixedHandshakeBuffer(builder, handshake);
+  queue_write(common::MessagePool::instance()->acquire(builder.GetBufferPointer(), builder.GetSize()));
+
+  if (shm_) {
+    std::cout << "connection " << id_ << " moved to shared memory" << std::endl;
+    shm_->start();
+    using_shm_.store(true);
+  }
+  return true;
+}
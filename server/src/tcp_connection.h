@@ -5,36 +5,91 @@
 #endif
 #include <boost/bind/bind.hpp>
 #include <asio.hpp>
-#include "readerwriterqueue.h"
-#include "types.h"
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include "channel.h"
 #include "common.h"
+#include "latency_histogram.h"
+#include "shm_transport.h"
+#include "types.h"
+#include "write_queue.h"
 
 using asio::ip::tcp;
 
 class TCPConnection;
 
+// Every handler runs on the strand the socket was accepted on, so a connection is only ever
+// touched by one io thread at a time. Pending handlers hold a pointer to the connection,
+// it goes away once it's closed and the last of them has run.
+// A client on the same machine can ask in its Hello to move the connection to shared memory. The socket then
+// only carries the Welcome and is kept open to notice the client going away. A client staying on TCP can
+// ask for compressed frames instead, see common/compression.h
 class TCPConnection : public std::enable_shared_from_this<TCPConnection> {
 public:
   typedef std::shared_ptr<TCPConnection> pointer;
+  using CloseHandler = std::function<void(int id)>;
+  // shared by every connection, in microseconds
+  struct Latencies {
+    // one socket write of a batch
+    common::LatencyHistogram write;
+    // one frame, on whichever thread wrote it
+    common::LatencyHistogram compress;
+  };
   tcp::socket& socket();
 
-  static pointer create(asio::io_context& io_context, int id, moodycamel::ReaderWriterQueue<MessageWithId>& q);
+  static pointer create(tcp::socket&& socket, int id, Channel<MessageWithId>& q, Latencies& latencies, CloseHandler on_close);
 
+  // safe to call from any thread
   void write(const Message& message);
   void start();
+  // frames in either direction, headers included. Over shared memory bytes out counts what was handed
+  // to the ring's writer rather than what reached it
+  std::uint64_t get_bytes_in() const;
+  std::uint64_t get_bytes_out() const;
+  bool is_using_shm() const;
 
 private:
-  TCPConnection(asio::io_context& io_context, int id, moodycamel::ReaderWriterQueue<MessageWithId>& q);
+  TCPConnection(tcp::socket&& socket, int id, Channel<MessageWithId>& q, Latencies& latencies, CloseHandler on_close);
+  void read_header();
   void handle_read_header(const ::asio::error_code& error);
-  void handle_read_body(const asio::error_code& error, std::uint32_t body_length);
-  void handle_write(); 
+  void handle_read_body(const asio::error_code& error);
+  // true if the body was a Hello, which is answered here and not passed on to the sim
+  bool handle_handshake();
+  void queue_write(const Message& message);
+  void start_write();
+  void handle_write(const asio::error_code& error);
+  void close();
 
   int id_;
   tcp::socket socket_;
-  static constexpr int header_length = 4;
-  std::array<std::uint8_t,common::max_msg_buffer_size> read_buffer_;
-  moodycamel::ReaderWriterQueue<MessageWithId>& q_;
+  std::array<std::uint8_t, common::frame_header_length> header_buffer_;
+  // bodies are read straight into a pooled buffer which is then handed to the sim
+  Message body_buffer_;
+  std::uint8_t body_flags_ = 0;
+  common::WriteQueue write_queue_;
+  std::vector<asio::const_buffer> write_buffers_;
+  std::size_t write_batch_bytes_ = 0;
+  std::chrono::steady_clock::time_point write_started_;
+  bool reading_paused_ = false;
+  bool closed_ = false;
+  bool handshake_done_ = false;
+  // before shm_, its reader thread counts into bytes_in_ until it's joined
+  std::atomic<std::uint64_t> bytes_in_{0};
+  std::atomic<std::uint64_t> bytes_out_{0};
+  // set on the strand before using_shm_, read from any thread after it
+  std::unique_ptr<common::ShmConnection> shm_;
+  std::atomic<bool> using_shm_ = false;
+  // the client asked for compressed frames in its Hello, set on the strand before the Welcome goes out
+  std::atomic<bool> compress_ = false;
+  // a client that stops reading first stops getting its requests read, then gets dropped
+  static constexpr std::size_t write_queue_soft_limit = 8 * 1024 * 1024;
+  static constexpr std::size_t write_queue_hard_limit = 2 * common::max_message_size;
+  Channel<MessageWithId>& q_;
+  Latencies& latencies_;
+  CloseHandler on_close_;
 };
 
 #endif
\ No newline at end of file
@@ -1,37 +1,76 @@
 #include "tcp_server.h"
+#include <algorithm>
 
-TCPServer::TCPServer(asio::io_context& io_context)
+TCPServer::TCPServer(asio::io_context& io_context, unsigned short port)
     : io_context_(io_context),
-      acceptor_(io_context, tcp::endpoint(tcp::v4(), 7331)), q_(100) {
+      acceptor_(io_context, tcp::endpoint(tcp::v4(), port)) {
   start_accept();
-  std::cout << "Started listening on port 7331" << std::endl;
+  std::cout << "Started listening on port " << port << std::endl;
 }
 void TCPServer::write(const MessageWithId& msg_with_id) {
-  auto connection = connections_[msg_with_id.id];
+  TCPConnection::pointer connection;
+  {
+    std::unique_lock<std::mutex> lock(connections_mutex_);
+    auto it = connections_.find(msg_with_id.id);
+    if (it == connections_.end())
+      return;
+    connection = it->second;
+  }
   connection->write(msg_with_id.message);
 }
 
-moodycamel::ReaderWriterQueue<MessageWithId>& TCPServer::get_queue() {
+Channel<MessageWithId>& TCPServer::get_queue() {
   return q_;
 }
 
+std::size_t TCPServer::get_num_connections() {
+  std::unique_lock<std::mutex> lock(connections_mutex_);
+  return connections_.size();
+}
+
+std::vector<TCPServer::ConnectionStats> TCPServer::get_connection_stats() {
+  std::vector<ConnectionStats> stats;
+  {
+    std::unique_lock<std::mutex> lock(connections_mutex_);
+    stats.reserve(connections_.size());
+    for (auto& [id, connection] : connections_)
+      stats.push_back(ConnectionStats{id, connection->is_using_shm(), connection->get_bytes_in(), connection->get_bytes_out()});
+  }
+  std::sort(stats.begin(), stats.end(), [](const ConnectionStats& a, const ConnectionStats& b) { return a.id < b.id; });
+  return stats;
+}
+
+const TCPConnection::Latencies& TCPServer::get_latencies() const {
+  return latencies_;
+}
+
 void TCPServer::start_accept() {
-  auto new_connection = TCPConnection::create(io_context_, connections_.size(), q_);
-  connections_.push_back(new_connection);
+  // only one accept is outstanding at a time, so the acceptor itself needs no strand
   acceptor_.async_accept(
-    new_connection->socket(),
-    boost::bind(
-      &TCPServer::handle_accept, this, new_connection,
-      asio::placeholders::error));
+    asio::make_strand(io_context_),
+    [this](const asio::error_code& error, tcp::socket socket) { handle_accept(error, std::move(socket)); });
 }
 
-void TCPServer::handle_accept(
-  TCPConnection::pointer new_connection,
-  const asio::error_code& error) {
-
+void TCPServer::handle_accept(const asio::error_code& error, tcp::socket socket) {
   if (!error) {
+    TCPConnection::pointer new_connection;
+    {
+      std::unique_lock<std::mutex> lock(connections_mutex_);
+      int id = next_connection_id_++;
+      new_connection = TCPConnection::create(std::move(socket), id, q_, latencies_, [this](int id) { remove_connection(id); });
+      connections_.insert({id, new_connection});
+    }
     new_connection->start();
   }
 
   start_accept();
 }
+
+void TCPServer::remove_connection(int id) {
+  {
+    std::unique_lock<std::mutex> lock(connections_mutex_);
+    connections_.erase(id);
+  }
+  // let the sim forget about it
+  q_.push(MessageWithId{Message(), id});
+}
@@ -1,23 +1,47 @@
 #ifndef TCP_SERVER_H
 #define TCP_SERVER_H
 
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "channel.h"
 #include "tcp_connection.h"
 
+// The io_context may be run by any number of threads, each connection gets its own strand
 class TCPServer {
 public:
-  TCPServer(asio::io_context& io_context);
+  struct ConnectionStats {
+    int id;
+    bool shm;
+    std::uint64_t bytes_in;
+    std::uint64_t bytes_out;
+  };
+
+  TCPServer(asio::io_context& io_context, unsigned short port = default_port);
+  // safe to call from any thread, replies to connections that have since closed are dropped
   void write(const MessageWithId& msg_with_id);
-  moodycamel::ReaderWriterQueue<MessageWithId>& get_queue();
+  Channel<MessageWithId>& get_queue();
+  std::size_t get_num_connections();
+  // open connections only, ordered by id
+  std::vector<ConnectionStats> get_connection_stats();
+  // across every connection
+  const TCPConnection::Latencies& get_latencies() const;
+
+  static constexpr unsigned short default_port = 7331;
 
 private:
   void start_accept();
+  void handle_accept(const asio::error_code& error, tcp::socket socket);
+  void remove_connection(int id);
 
-  void handle_accept(TCPConnection::pointer new_connection, const asio::error_code& error);
-
-  std::vector<TCPConnection::pointer> connections_;
+  std::mutex connections_mutex_;
+  std::unordered_map<int, TCPConnection::pointer> connections_;
+  int next_connection_id_ = 0;
   asio::io_context& io_context_;
   tcp::acceptor acceptor_;
-  moodycamel::ReaderWriterQueue<MessageWithId> q_;
+  // requests from every connection, drained by the sim. An empty message means the connection closed
+  Channel<MessageWithId> q_;
+  TCPConnection::Latencies latencies_;
 };
 
-#endif
\ No newline at end of file
+#endif
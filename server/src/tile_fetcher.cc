@@ -0,0 +1,255 @@
+#include "tile_fetcher.h"
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include "common.h"
+#include "stb_image.h"
+
+namespace {
+  // WorldCover colours as served by the landcover tiles
+  std::uint8_t landcover_of_colour(int red, int green, int blue) {
+    int val = ((red << 16) | (green << 8) | blue);
+    switch (val) {
+    case 25800:
+      return static_cast<std::uint8_t>(common::LandCover::water);
+    case 25600:
+      return static_cast<std::uint8_t>(common::LandCover::trees);
+    case 16777036:
+      return static_cast<std::uint8_t>(common::LandCover::grass);
+    case 16759586:
+      return static_cast<std::uint8_t>(common::LandCover::shrubs);
+    case 11842740:
+      return static_cast<std::uint8_t>(common::LandCover::bare);
+    case 15790320:
+      return static_cast<std::uint8_t>(common::LandCover::snow);
+    case 38560:
+      return static_cast<std::uint8_t>(common::LandCover::wetland);
+    case 53109:
+      return static_cast<std::uint8_t>(common::LandCover::mangroves);
+    case 16443040:
+      return static_cast<std::uint8_t>(common::LandCover::moss);
+    case 15767295:
+      return static_cast<std::uint8_t>(common::LandCover::grass);
+    default:
+      return Tile::landcover_unknown;
+    }
+  }
+} // namespace
+
+std::size_t Tile::get_memory_usage() const {
+  return sizeof(Tile) + elevation.capacity() * sizeof(std::int16_t) + landcover.capacity() * sizeof(std::uint8_t);
+}
+
+TileFetcher::TileFetcher(std::unique_ptr<TileProvider> provider, unsigned int max_concurrent_fetches, std::size_t cache_budget)
+    : provider_(std::move(provider)), cache_budget_(cache_budget), fetch_pool_(max_concurrent_fetches) {
+  std::cout << "Fetching tiles from " << provider_->get_name() << ", " << max_concurrent_fetches << " at a time, caching "
+            << cache_budget_ / (1024 * 1024) << "MB" << std::endl;
+}
+
+std::shared_ptr<const Tile> TileFetcher::decode(const TileKey& key, const std::string& bytes) {
+  int width, height, channels;
+  auto* data = stbi_load_from_memory(
+    reinterpret_cast<const stbi_uc*>(bytes.data()), bytes.size(), &width, &height, &channels, 3);
+  if (!data)
+    throw std::runtime_error(stbi_failure_reason());
+
+  auto tile = std::make_shared<Tile>();
+  tile->kind = key.kind;
+  tile->width = width;
+  tile->height = height;
+  std::size_t num_pixels = static_cast<std::size_t>(width) * height;
+  switch (key.kind) {
+  case TileKind::elevation:
+    // terrarium encoding
+    tile->elevation.resize(num_pixels);
+    for (std::size_t i = 0; i < num_pixels; ++i) {
+      int red = data[i * 3], green = data[i * 3 + 1], blue = data[i * 3 + 2];
+      tile->elevation[i] = static_cast<std::int16_t>((red * 256 + green + blue / 256) - 32768);
+    }
+    break;
+  case TileKind::landcover:
+    tile->landcover.resize(num_pixels);
+    for (std::size_t i = 0; i < num_pixels; ++i)
+      tile->landcover[i] = landcover_of_colour(data[i * 3], data[i * 3 + 1], data[i * 3 + 2]);
+    break;
+  }
+  stbi_image_free(data);
+  return tile;
+}
+
+std::shared_ptr<const Tile> TileFetcher::find(const TileKey& key) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto it = tiles_.find(key);
+  if (it == tiles_.end() || it->second.loading || it->second.failed)
+    return nullptr;
+  touch(it->second);
+  return it->second.tile;
+}
+
+std::shared_ptr<const Tile> TileFetcher::get(const TileKey& key) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    request(key, nullptr);
+    cv_.wait(lock, [this, &key] {
+      auto it = tiles_.find(key);
+      return it == tiles_.end() || !it->second.loading;
+    });
+    auto it = tiles_.find(key);
+    // evicted before we woke up, ask again
+    if (it == tiles_.end())
+      continue;
+    if (it->second.failed)
+      throw std::runtime_error("tile " + std::to_string(key.x) + "-" + std::to_string(key.y) + " failed to load");
+    return it->second.tile;
+  }
+}
+
+void TileFetcher::when_ready(const std::vector<TileKey>& keys, std::function<void()> callback) {
+  auto remaining = std::make_shared<std::atomic<int>>(1);
+  auto shared_callback = std::make_shared<std::function<void()>>(std::move(callback));
+  auto waiter = [remaining, shared_callback] {
+    if (remaining->fetch_sub(1, std::memory_order_acq_rel) == 1)
+      (*shared_callback)();
+  };
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (auto& key : keys) {
+      remaining->fetch_add(1, std::memory_order_relaxed);
+      if (request(key, waiter))
+        remaining->fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+  // drop the guard count, runs the callback here if nothing had to be waited on
+  waiter();
+}
+
+bool TileFetcher::request(const TileKey& key, std::function<void()> waiter) {
+  auto [it, inserted] = tiles_.try_emplace(key);
+  auto& entry = it->second;
+  if (!inserted && !entry.loading && entry.failed) {
+    // try failed tiles again
+    entry = Entry{};
+    inserted = true;
+  }
+  if (!entry.loading) {
+    ++hits_;
+    touch(entry);
+    return true;
+  }
+  if (waiter)
+    entry.waiters.push_back(std::move(waiter));
+  if (inserted) {
+    ++misses_;
+    ++fetches_;
+    fetch_pool_.submit([this, key] { fetch(key); });
+  } else {
+    ++deduplicated_;
+  }
+  return false;
+}
+
+void TileFetcher::touch(Entry& entry) {
+  lru_.splice(lru_.begin(), lru_, entry.lru_it);
+}
+
+void TileFetcher::evict() {
+  while (cache_bytes_ > cache_budget_ && !lru_.empty()) {
+    auto key = lru_.back();
+    lru_.pop_back();
+    auto it = tiles_.find(key);
+    cache_bytes_ -= it->second.tile->get_memory_usage();
+    tiles_.erase(it);
+    ++evictions_;
+  }
+}
+
+void TileFetcher::fetch(TileKey key) {
+  std::shared_ptr<const Tile> tile;
+  try {
+    auto bytes = provider_->fetch(key);
+    auto start = std::chrono::steady_clock::now();
+    tile = decode(key, bytes);
+    decode_latency_.record(
+      std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+  } catch (const std::exception& e) {
+    std::cerr << "failed to load tile " << key.x << "-" << key.y << ": " << e.what() << std::endl;
+    ++failures_;
+  }
+
+  std::vector<std::function<void()>> waiters;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto& entry = tiles_.at(key);
+    entry.loading = false;
+    entry.failed = !tile;
+    waiters = std::move(entry.waiters);
+    entry.waiters.clear();
+    if (tile) {
+      entry.tile = tile;
+      lru_.push_front(key);
+      entry.lru_it = lru_.begin();
+      cache_bytes_ += tile->get_memory_usage();
+      evict();
+    }
+  }
+  cv_.notify_all();
+  for (auto& waiter : waiters)
+    waiter();
+}
+
+std::uint64_t TileFetcher::get_fetches() const {
+  return fetches_;
+}
+
+std::uint64_t TileFetcher::get_deduplicated() const {
+  return deduplicated_;
+}
+
+std::uint64_t TileFetcher::get_failures() const {
+  return failures_;
+}
+
+std::uint64_t TileFetcher::get_hits() const {
+  return hits_;
+}
+
+std::uint64_t TileFetcher::get_misses() const {
+  return misses_;
+}
+
+std::uint64_t TileFetcher::get_evictions() const {
+  return evictions_;
+}
+
+std::size_t TileFetcher::get_cache_bytes() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return cache_bytes_;
+}
+
+std::size_t TileFetcher::get_cache_budget() const {
+  return cache_budget_;
+}
+
+const common::LatencyHistogram& TileFetcher::get_decode_latency() const {
+  return decode_latency_;
+}
+
+std::string TileFetcher::report() {
+  std::size_t tiles;
+  std::size_t bytes;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    tiles = lru_.size();
+    bytes = cache_bytes_;
+  }
+  std::stringstream stream;
+  stream << "tile cache: " << tiles << " tiles, " << bytes / 1024 << "/" << cache_budget_ / 1024 << "KB"
+         << ", hits " << hits_ << ", misses " << misses_ << ", deduplicated " << deduplicated_
+         << ", evictions " << evictions_ << ", failures " << failures_;
+  return stream.str();
+}
+
+const TileProvider& TileFetcher::get_provider() const {
+  return *provider_;
+}
@@ -0,0 +1,102 @@
+#ifndef TILE_FETCHER_H
+#define TILE_FETCHER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "latency_histogram.h"
+#include "tile_provider.h"
+#include "worker_pool.h"
+
+// A tile decoded once into what get_section reads instead of raw pixels:
+// metres for elevation tiles, a common::LandCover per pixel for landcover tiles
+struct Tile {
+  TileKind kind;
+  int width;
+  int height;
+  std::vector<std::int16_t> elevation;
+  std::vector<std::uint8_t> landcover;
+
+  // colours that aren't a known class
+  static constexpr std::uint8_t landcover_unknown = 0xff;
+
+  std::int16_t get_elevation(int x, int y) const { return elevation[y * width + x]; }
+  std::uint8_t get_landcover(int x, int y) const { return landcover[y * width + x]; }
+  std::size_t get_memory_usage() const;
+};
+
+// Loads and decodes tiles on a small pool of its own, so at most max_concurrent_fetches are outstanding.
+// A tile is only ever fetched once at a time, everyone asking for it while it's in flight is
+// parked on the same fetch. Loaded tiles are kept in an LRU bounded by cache_budget bytes,
+// callers hold a reference so evicting a tile in use is fine
+class TileFetcher {
+public:
+  TileFetcher(std::unique_ptr<TileProvider> provider, unsigned int max_concurrent_fetches, std::size_t cache_budget);
+  TileFetcher(const TileFetcher& other) = delete;
+  TileFetcher& operator=(const TileFetcher& other) = delete;
+
+  // nullptr if the tile isn't loaded
+  std::shared_ptr<const Tile> find(const TileKey& key);
+  // blocks until the tile is loaded, throws if the fetch failed
+  std::shared_ptr<const Tile> get(const TileKey& key);
+  // callback runs once every key has loaded or failed, inline if they all already have.
+  // Otherwise it runs on a fetch thread and should hand real work elsewhere
+  void when_ready(const std::vector<TileKey>& keys, std::function<void()> callback);
+
+  std::uint64_t get_fetches() const;
+  std::uint64_t get_deduplicated() const;
+  std::uint64_t get_failures() const;
+  std::uint64_t get_hits() const;
+  std::uint64_t get_misses() const;
+  std::uint64_t get_evictions() const;
+  std::size_t get_cache_bytes();
+  std::size_t get_cache_budget() const;
+  // time spent turning fetched bytes into a Tile, in microseconds
+  const common::LatencyHistogram& get_decode_latency() const;
+  std::string report();
+  const TileProvider& get_provider() const;
+
+private:
+  struct Entry {
+    bool loading = true;
+    bool failed = false;
+    std::shared_ptr<const Tile> tile;
+    std::vector<std::function<void()>> waiters;
+    // position in lru_ once loaded
+    std::list<TileKey>::iterator lru_it;
+  };
+  // must hold mutex_, returns true if the tile is done (loaded or failed)
+  bool request(const TileKey& key, std::function<void()> waiter);
+  // must hold mutex_
+  void touch(Entry& entry);
+  void evict();
+  void fetch(TileKey key);
+  static std::shared_ptr<const Tile> decode(const TileKey& key, const std::string& bytes);
+
+  std::unique_ptr<TileProvider> provider_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::unordered_map<TileKey, Entry, TileKeyHash> tiles_;
+  // loaded tiles, most recently used at the front
+  std::list<TileKey> lru_;
+  std::size_t cache_bytes_ = 0;
+  std::size_t cache_budget_;
+  std::atomic<std::uint64_t> fetches_{0};
+  std::atomic<std::uint64_t> deduplicated_{0};
+  std::atomic<std::uint64_t> failures_{0};
+  std::atomic<std::uint64_t> hits_{0};
+  std::atomic<std::uint64_t> misses_{0};
+  std::atomic<std::uint64_t> evictions_{0};
+  common::LatencyHistogram decode_latency_;
+  // last so fetches finish before the tiles go away
+  WorkerPool fetch_pool_;
+};
+
+#endif
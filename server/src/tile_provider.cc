@@ -0,0 +1,76 @@
+#include "tile_provider.h"
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <thread>
+#include "http_client.h"
+
+std::string get_tile_path(const std::string& dir, const TileKey& key) {
+  std::string kind_dir = key.kind == TileKind::elevation ? "/elevation/" : "/landcover/";
+  return dir + kind_dir + std::to_string(key.x) + "-" + std::to_string(key.y) + ".png";
+}
+
+namespace {
+  bool read_file(const std::string& path, std::string& contents) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+      return false;
+    contents.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return true;
+  }
+} // namespace
+
+HTTPTileProvider::HTTPTileProvider(const std::string& cache_dir) : cache_dir_(cache_dir) {}
+
+std::string HTTPTileProvider::get_url(const TileKey& key) const {
+  switch (key.kind) {
+  case TileKind::elevation:
+    return "https://s3.amazonaws.com/elevation-tiles-prod/terrarium/" + std::to_string(tile_zoom_level) +
+           "/" + std::to_string(key.x) + "/" + std::to_string(key.y) + ".png";
+  case TileKind::landcover:
+  default:
+    return "https://services.terrascope.be/wmts/v2?SERVICE=WMTS&REQUEST=GetTile&VERSION=1.0.0"
+           "&LAYER=WORLDCOVER_2021_MAP&STYLE=default&FORMAT=image/jpeg&TILEMATRIXSET=EPSG%3A3857&TILEMATRIX=EPSG:3857:" +
+           std::to_string(tile_zoom_level) + "&TILECOL=" + std::to_string(key.x) + "&TILEROW=" + std::to_string(key.y);
+  }
+}
+
+std::string HTTPTileProvider::fetch(const TileKey& key) {
+  auto path = get_tile_path(cache_dir_, key);
+  std::string contents;
+  if (read_file(path, contents))
+    return contents;
+
+  // curl handles can't be shared between threads
+  thread_local HTTPClient http_client;
+  contents = http_client.make_request(get_url(key));
+
+  // cache the bytes as served, write to a temporary name so a concurrent reader never sees half a file
+  auto tmp_path = path + ".tmp" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+  {
+    std::ofstream file(tmp_path, std::ios::binary);
+    file.write(contents.data(), contents.size());
+  }
+  std::error_code ignored_error;
+  std::filesystem::rename(tmp_path, path, ignored_error);
+  return contents;
+}
+
+std::string HTTPTileProvider::get_name() const {
+  return "http (cache " + cache_dir_ + ")";
+}
+
+LocalTileProvider::LocalTileProvider(const std::string& dir) : dir_(dir) {}
+
+std::string LocalTileProvider::fetch(const TileKey& key) {
+  auto path = get_tile_path(dir_, key);
+  std::string contents;
+  if (!read_file(path, contents))
+    throw std::runtime_error("missing local tile " + path);
+  return contents;
+}
+
+std::string LocalTileProvider::get_name() const {
+  return "local " + dir_;
+}
@@ -0,0 +1,69 @@
+#ifndef TILE_PROVIDER_H
+#define TILE_PROVIDER_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// web mercator zoom of every tile the server reads
+constexpr int tile_zoom_level = 15;
+
+enum class TileKind : std::uint8_t {
+  elevation,
+  landcover
+};
+
+struct TileKey {
+  TileKind kind;
+  int x;
+  int y;
+
+  bool operator==(const TileKey& other) const = default;
+};
+
+struct TileKeyHash {
+  std::size_t operator()(const TileKey& key) const noexcept {
+    std::uint64_t packed = (static_cast<std::uint64_t>(key.kind) << 48) ^
+                           (static_cast<std::uint64_t>(static_cast<std::uint32_t>(key.x)) << 24) ^
+                           static_cast<std::uint32_t>(key.y);
+    return std::hash<std::uint64_t>{}(packed);
+  }
+};
+
+// Source of encoded (png/jpeg) tile bytes. fetch may block and is called from several threads at once,
+// it throws if the tile can't be had
+class TileProvider {
+public:
+  virtual ~TileProvider() = default;
+  virtual std::string fetch(const TileKey& key) = 0;
+  virtual std::string get_name() const = 0;
+};
+
+// Downloads from the public elevation and landcover services, keeping the raw bytes in a disk cache
+class HTTPTileProvider : public TileProvider {
+public:
+  HTTPTileProvider(const std::string& cache_dir);
+  std::string fetch(const TileKey& key) override;
+  std::string get_name() const override;
+
+private:
+  std::string get_url(const TileKey& key) const;
+
+  std::string cache_dir_;
+};
+
+// Reads <dir>/elevation/<x>-<y>.png and <dir>/landcover/<x>-<y>.png, the same layout HTTPTileProvider caches to.
+// Never touches the network, for tests and load runs
+class LocalTileProvider : public TileProvider {
+public:
+  LocalTileProvider(const std::string& dir);
+  std::string fetch(const TileKey& key) override;
+  std::string get_name() const override;
+
+private:
+  std::string dir_;
+};
+
+std::string get_tile_path(const std::string& dir, const TileKey& key);
+
+#endif
@@ -10,9 +10,11 @@
 #include <utility>
 #include <vector>
 #include "common.h"
+#include "message_buffer.h"
 
 using Location = std::array<int, 3>;
 using Location2D = std::array<int, 2>;
+using Int3D = Location;
 
 struct LocationMath {
   static double distance(Location l1, Location l2) {
@@ -37,12 +39,23 @@ struct LocationHash {
   }
 };
 
-using Message = std::vector<uint8_t>;
+// framing is stripped, data() points at the flatbuffer
+using Message = common::MessageBuffer;
 struct MessageWithId {
   Message message;
   int id;
 };
 
+struct Location2DHash {
+  template <class T, std::size_t N>
+  size_t operator()(const std::array<T, N>& arr) const noexcept {
+    uintmax_t hash = std::hash<T>{}(arr[0]);
+    hash <<= sizeof(uintmax_t) * 4;
+    hash ^= std::hash<T>{}(arr[1]);
+    return std::hash<uintmax_t>{}(hash);
+  }
+};
+
 struct hash_pair final {
   template <class TFirst, class TSecond>
   size_t operator()(const std::pair<TFirst, TSecond>& p) const noexcept {
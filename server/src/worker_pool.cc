@@ -0,0 +1,53 @@
+#include "worker_pool.h"
+#include <algorithm>
+#include <exception>
+#include <iostream>
+
+WorkerPool::WorkerPool(unsigned int num_threads) {
+  if (num_threads == 0)
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  threads_.reserve(num_threads);
+  for (unsigned int i = 0; i < num_threads; ++i)
+    threads_.emplace_back(&WorkerPool::work, this);
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cv_.notify_all();
+  for (auto& thread : threads_)
+    thread.join();
+}
+
+void WorkerPool::submit(std::function<void()> job) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    jobs_.push_back(std::move(job));
+  }
+  cv_.notify_one();
+}
+
+unsigned int WorkerPool::get_num_threads() const {
+  return threads_.size();
+}
+
+void WorkerPool::work() {
+  while (true) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+      if (jobs_.empty())
+        return;
+      job = std::move(jobs_.front());
+      jobs_.pop_front();
+    }
+    try {
+      job();
+    } catch (const std::exception& e) {
+      std::cerr << "worker job failed: " << e.what() << std::endl;
+    }
+  }
+}
@@ -0,0 +1,33 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads pulling jobs off one queue, idle workers sleep on a condition variable
+class WorkerPool {
+public:
+  // 0 uses one thread per hardware thread
+  WorkerPool(unsigned int num_threads = 0);
+  ~WorkerPool();
+  WorkerPool(const WorkerPool& other) = delete;
+  WorkerPool& operator=(const WorkerPool& other) = delete;
+
+  void submit(std::function<void()> job);
+  unsigned int get_num_threads() const;
+
+private:
+  void work();
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::function<void()>> jobs_;
+  bool stopping_ = false;
+  std::vector<std::thread> threads_;
+};
+
+#endif
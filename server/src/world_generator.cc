@@ -1,134 +1,118 @@
 #include "world_generator.h"
+#include <algorithm>
 #include <numbers>
-#include <fstream>
 #include <functional>
-#include <iomanip>
-#include <sstream>
+#include <iostream>
+#include <tuple>
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
-#define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "common.h"
-#include "stb_image_write.h"
-
-WorldGenerator::Image WorldGenerator::get_image(
-  std::pair<int, int> tile,
-  std::string dir,
-  std::unordered_map<std::pair<int, int>, Image, hash_pair>& image_store,
-  std::string url) {
-
-  auto it = image_store.find(tile);
-  if (it != image_store.end()) {
-    return it->second;
-  } else {
-    // Look for it locally, if it's not there download it
-    std::string image_binary;
-    std::string output_filename = std::to_string(tile.first) + "-" + std::to_string(tile.second) + ".png";
-    std::string output_path = dir + output_filename;
-    std::ifstream file;
-    file.open(output_path, std::ios::binary);
-    if (file) {
-      image_binary.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-    } else {
-      image_binary = http_client_.make_request(url);
+
+WorldGenerator::WorldGenerator(std::unique_ptr<TileProvider> provider, std::unique_ptr<SectionDatabase> section_database)
+    : tile_fetcher_(std::move(provider), max_concurrent_fetches, tile_cache_budget), section_database_(std::move(section_database)) {
+  if (section_database_)
+    std::cout << "Serving baked sections from a " << section_database_->get_size() / 1024 << "KB database of "
+              << section_database_->get_num_blocks() << " blocks" << std::endl;
+}
+
+TileFetcher& WorldGenerator::get_tile_fetcher() {
+  return tile_fetcher_;
+}
+
+std::pair<int, int> WorldGenerator::get_tile_of_section(Location2D loc) {
+  double lng = 360.0 * (loc[0] * Chunk::sz_x) / common::equator_circumference;
+  double lat = 180.0 * (loc[1] * Chunk::sz_z) / (common::polar_circumference / 2);
+  return lat_lng_to_web_mercator(lat, lng, zoom_level);
+}
+
+std::pair<Location2D, Location2D> WorldGenerator::get_sections_of_tile(int x, int y) {
+  auto bounds = get_tile_bounds(x, y, zoom_level);
+  auto section_x = [](double lng) { return static_cast<int>(std::floor(lng * common::equator_circumference / 360.0 / Chunk::sz_x)); };
+  auto section_y = [](double lat) { return static_cast<int>(std::floor(lat * (common::polar_circumference / 2) / 180.0 / Chunk::sz_z)); };
+  // a section either side for rounding
+  return {Location2D{section_x(bounds.lng_min) - 1, section_y(bounds.lat_min) - 1},
+          Location2D{section_x(bounds.lng_max) + 1, section_y(bounds.lat_max) + 1}};
+}
+
+void WorldGenerator::get_landcover_coord(Location2D loc, int row, int col, double& lng, double& lat) {
+  auto loc_x = (loc[0] + col / static_cast<float>(common::landcover_cols_per_sector)) * Chunk::sz_x;
+  auto loc_z = (loc[1] + row / static_cast<float>(common::landcover_rows_per_sector)) * Chunk::sz_z;
+  lng = 360.0 * loc_x / common::equator_circumference;
+  lat = 180.0 * loc_z / (common::polar_circumference / 2);
+}
+
+void WorldGenerator::add_required_tiles(Location2D loc, std::vector<TileKey>& keys) const {
+  double lng = 360.0 * (loc[0] * Chunk::sz_x) / common::equator_circumference;
+  double lat = 180.0 * (loc[1] * Chunk::sz_z) / (common::polar_circumference / 2);
+  auto tile = lat_lng_to_web_mercator(lat, lng, zoom_level);
+  keys.push_back(TileKey{TileKind::elevation, tile.first, tile.second});
+  keys.push_back(TileKey{TileKind::landcover, tile.first, tile.second});
+  // samples near a tile edge can fall in the neighbouring tile
+  for (int row = 0; row < common::landcover_rows_per_sector; ++row) {
+    for (int col = 0; col < common::landcover_cols_per_sector; ++col) {
+      get_landcover_coord(loc, row, col, lng, lat);
+      auto [x, y] = pixel_of_coord(tile.first, tile.second, zoom_level, lng, lat);
+      if (x < 0 || x > tile_max_x || y < 0 || y > tile_max_y) {
+        auto sample_tile = lat_lng_to_web_mercator(lat, lng, zoom_level);
+        keys.push_back(TileKey{TileKind::landcover, sample_tile.first, sample_tile.second});
+      }
     }
-    // Load it and save it if necessary
-    unsigned char* data;
-    int width, height, channels;
-    data = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(image_binary.data()), image_binary.size(),
-                                 &width, &height, &channels, 0);
-    Image image = {data, width, height, channels};
-    image_store[tile] = image;
-    if (!file)
-      stbi_write_png(output_path.c_str(), width, height, channels, data, width * channels);
-    return image;
   }
 }
 
+void WorldGenerator::when_ready(const std::vector<Location2D>& locs, std::function<void()> callback) {
+  std::vector<TileKey> keys;
+  keys.reserve(locs.size() * 2);
+  Section baked;
+  for (auto& loc : locs) {
+    if (!section_database_ || !section_database_->find(loc, baked))
+      add_required_tiles(loc, keys);
+  }
+  // neighbouring sections mostly share tiles
+  std::sort(keys.begin(), keys.end(), [](const TileKey& a, const TileKey& b) {
+    return std::tie(a.kind, a.x, a.y) < std::tie(b.kind, b.x, b.y);
+  });
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  tile_fetcher_.when_ready(keys, std::move(callback));
+}
+
 Section WorldGenerator::get_section(Location2D loc) {
   Section section;
+  if (section_database_ && section_database_->find(loc, section))
+    return section;
 
   double lng = 360.0 * (loc[0] * Chunk::sz_x) / common::equator_circumference;
   double lat = 180.0 * (loc[1] * Chunk::sz_z) / (common::polar_circumference / 2);
   auto tile = lat_lng_to_web_mercator(lat, lng, zoom_level);
 
   {
-    auto image = get_image(
-      tile, common::get_data_dir() + std::string("/images/elevation/"), elevation_images_,
-      "https://s3.amazonaws.com/elevation-tiles-prod/terrarium/" + std::to_string(zoom_level) +
-        "/" + std::to_string(tile.first) + "/" + std::to_string(tile.second) + ".png");
-
-    auto [data, width, height, channels] = image;
+    auto elevation = tile_fetcher_.get(TileKey{TileKind::elevation, tile.first, tile.second});
     auto [x, y] = pixel_of_coord(tile.first, tile.second, zoom_level, lng, lat);
-    int pixel_index = (y * width + x) * channels;
-    int red = static_cast<int>(data[pixel_index]);
-    int green = static_cast<int>(data[pixel_index + 1]);
-    int blue = static_cast<int>(data[pixel_index + 2]);
-    section.elevation = (red * 256 + green + blue / 256) - 32768;
+    section.elevation = elevation->get_elevation(x, y);
   }
   {
     int num_rows = common::landcover_rows_per_sector;
     int num_cols = common::landcover_cols_per_sector;
-    std::string img_url =
-      "https://services.terrascope.be/wmts/v2?SERVICE=WMTS&REQUEST=GetTile&VERSION=1.0.0"
-      "&LAYER=WORLDCOVER_2021_MAP&STYLE=default&FORMAT=image/jpeg&TILEMATRIXSET=EPSG%3A3857&TILEMATRIX=EPSG:3857:" +
-      std::to_string(zoom_level) + "&TILECOL=" + std::to_string(tile.first) + "&TILEROW=" + std::to_string(tile.second);
-    auto image = get_image(tile, common::get_data_dir() + std::string("/images/landcover/"), landcover_images_, img_url);
+    auto landcover = tile_fetcher_.get(TileKey{TileKind::landcover, tile.first, tile.second});
 
+    section.landcover.fill(default_landcover);
     for (int row = 0; row < num_rows; ++row) {
       for (int col = 0; col < num_cols; ++col) {
-        auto loc_x = (loc[0] + col / static_cast<float>(num_cols)) * Chunk::sz_x;
-        auto loc_z = (loc[1] + row / static_cast<float>(num_rows)) * Chunk::sz_z;
-        double lng = 360.0 * loc_x / common::equator_circumference;
-        double lat = 180.0 * loc_z / (common::polar_circumference / 2);
+        double lng, lat;
+        get_landcover_coord(loc, row, col, lng, lat);
         auto [x, y] = pixel_of_coord(tile.first, tile.second, zoom_level, lng, lat);
 
+        // only this sample is in the neighbouring tile, the next one starts from the section's tile again
+        auto sample_landcover = landcover;
         if (x < 0 || x > tile_max_x || y < 0 || y > tile_max_y) {
-          tile = lat_lng_to_web_mercator(lat, lng, zoom_level);
-          std::tie(x, y) = pixel_of_coord(tile.first, tile.second, zoom_level, lng, lat);
-          image = get_image(tile, common::get_data_dir() + std::string("/images/landcover/"), landcover_images_, img_url);
+          auto sample_tile = lat_lng_to_web_mercator(lat, lng, zoom_level);
+          std::tie(x, y) = pixel_of_coord(sample_tile.first, sample_tile.second, zoom_level, lng, lat);
+          sample_landcover = tile_fetcher_.get(TileKey{TileKind::landcover, sample_tile.first, sample_tile.second});
         }
 
-        auto [data, width, height, channels] = image;
-
-        int pixel_index = (y * width + x) * channels;
-
-        int red = static_cast<int>(data[pixel_index]);
-        int green = static_cast<int>(data[pixel_index + 1]);
-        int blue = static_cast<int>(data[pixel_index + 2]);
-        int val = ((red << 16) | (green << 8) | blue);
-
-        switch (val) {
-        case 25800:
-          section.landcover[row * num_cols + col] = common::LandCover::water;
-          break;
-        case 25600:
-          section.landcover[row * num_cols + col] = common::LandCover::trees;
-          break;
-        case 16777036:
-          section.landcover[row * num_cols + col] = common::LandCover::grass;
-          break;
-        case 16759586:
-          section.landcover[row * num_cols + col] = common::LandCover::shrubs;
-          break;
-        case 11842740:
-          section.landcover[row * num_cols + col] = common::LandCover::bare;
-          break;
-        case 15790320:
-          section.landcover[row * num_cols + col] = common::LandCover::snow;
-          break;
-        case 38560:
-          section.landcover[row * num_cols + col] = common::LandCover::wetland;
-          break;
-        case 53109:
-          section.landcover[row * num_cols + col] = common::LandCover::mangroves;
-          break;
-        case 16443040:
-          section.landcover[row * num_cols + col] = common::LandCover::moss;
-          break;
-        case 15767295:
-          section.landcover[row * num_cols + col] = common::LandCover::grass;
-          break;
-        }
+        auto id = sample_landcover->get_landcover(x, y);
+        if (id != Tile::landcover_unknown)
+          section.landcover[row * num_cols + col] = static_cast<common::LandCover>(id);
       }
     }
   }
@@ -136,14 +120,126 @@ Section WorldGenerator::get_section(Location2D loc) {
   return section;
 }
 
-WorldGenerator::~WorldGenerator() {
-  for (auto& pair : elevation_images_) {
-    auto* image = pair.second.data;
-    stbi_image_free(image);
+void WorldGenerator::get_sections(std::span<const Location2D> locs, std::span<Section> sections) {
+  if (!section_database_) {
+    generate_sections(locs, sections);
+    return;
   }
-  for (auto& pair : landcover_images_) {
-    auto* image = pair.second.data;
-    stbi_image_free(image);
+  std::vector<Location2D> missing_locs;
+  std::vector<std::size_t> missing;
+  for (std::size_t i = 0; i < locs.size(); ++i) {
+    if (!section_database_->find(locs[i], sections[i])) {
+      missing_locs.push_back(locs[i]);
+      missing.push_back(i);
+    }
+  }
+  if (missing.empty())
+    return;
+  std::vector<Section> generated(missing.size());
+  generate_sections(missing_locs, generated);
+  for (std::size_t i = 0; i < missing.size(); ++i)
+    sections[missing[i]] = generated[i];
+}
+
+void WorldGenerator::generate_sections(std::span<const Location2D> locs, std::span<Section> sections) {
+  constexpr int samples_per_section = common::landcover_tiles_per_sector;
+
+  struct Item {
+    std::pair<int, int> tile;
+    std::size_t index;
+    double lng;
+    double lat;
+  };
+  std::vector<Item> items;
+  items.reserve(locs.size());
+  for (std::size_t i = 0; i < locs.size(); ++i) {
+    double lng = 360.0 * (locs[i][0] * Chunk::sz_x) / common::equator_circumference;
+    double lat = 180.0 * (locs[i][1] * Chunk::sz_z) / (common::polar_circumference / 2);
+    items.push_back(Item{lat_lng_to_web_mercator(lat, lng, zoom_level), i, lng, lat});
+  }
+  std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) { return a.tile < b.tile; });
+
+  // samples that spill over a tile edge mostly land in the same few neighbours
+  std::vector<std::pair<std::pair<int, int>, TileBounds>> bounds_cache;
+  auto bounds_of = [&bounds_cache](std::pair<int, int> tile) {
+    for (auto& [cached_tile, bounds] : bounds_cache) {
+      if (cached_tile == tile)
+        return bounds;
+    }
+    auto bounds = get_tile_bounds(tile.first, tile.second, zoom_level);
+    bounds_cache.emplace_back(tile, bounds);
+    return bounds;
+  };
+  std::vector<std::pair<std::pair<int, int>, std::shared_ptr<const Tile>>> landcover_cache;
+  auto landcover_of = [this, &landcover_cache](std::pair<int, int> tile) -> const Tile& {
+    for (auto& [cached_tile, landcover] : landcover_cache) {
+      if (cached_tile == tile)
+        return *landcover;
+    }
+    landcover_cache.emplace_back(tile, tile_fetcher_.get(TileKey{TileKind::landcover, tile.first, tile.second}));
+    return *landcover_cache.back().second;
+  };
+
+  std::vector<double> lngs;
+  std::vector<double> lats;
+  std::vector<int> pixel_xs;
+  std::vector<int> pixel_ys;
+  for (std::size_t group = 0; group < items.size();) {
+    auto tile = items[group].tile;
+    auto group_end = group;
+    while (group_end < items.size() && items[group_end].tile == tile)
+      ++group_end;
+    auto num_items = group_end - group;
+
+    // every section's elevation sample followed by its landcover samples
+    auto stride = 1 + samples_per_section;
+    auto num_samples = num_items * stride;
+    lngs.resize(num_samples);
+    lats.resize(num_samples);
+    for (std::size_t i = 0; i < num_items; ++i) {
+      auto& item = items[group + i];
+      lngs[i * stride] = item.lng;
+      lats[i * stride] = item.lat;
+      for (int row = 0; row < common::landcover_rows_per_sector; ++row) {
+        for (int col = 0; col < common::landcover_cols_per_sector; ++col) {
+          auto sample = i * stride + 1 + row * common::landcover_cols_per_sector + col;
+          get_landcover_coord(locs[item.index], row, col, lngs[sample], lats[sample]);
+        }
+      }
+    }
+
+    auto bounds = bounds_of(tile);
+    double lng_extent = std::abs(bounds.lng_min - bounds.lng_max);
+    double lat_extent = std::abs(bounds.lat_min - bounds.lat_max);
+    pixel_xs.resize(num_samples);
+    pixel_ys.resize(num_samples);
+    for (std::size_t i = 0; i < num_samples; ++i) {
+      pixel_xs[i] = tile_max_x * (std::abs(lngs[i] - bounds.lng_min)) / lng_extent;
+      pixel_ys[i] = tile_max_y * (std::abs(lats[i] - bounds.lat_max)) / lat_extent;
+    }
+
+    auto elevation = tile_fetcher_.get(TileKey{TileKind::elevation, tile.first, tile.second});
+    auto& landcover = landcover_of(tile);
+    for (std::size_t i = 0; i < num_items; ++i) {
+      auto& section = sections[items[group + i].index];
+      section.elevation = elevation->get_elevation(pixel_xs[i * stride], pixel_ys[i * stride]);
+      section.landcover.fill(default_landcover);
+      for (int sample = 0; sample < samples_per_section; ++sample) {
+        auto s = i * stride + 1 + sample;
+        int x = pixel_xs[s];
+        int y = pixel_ys[s];
+        const Tile* sample_landcover = &landcover;
+        if (x < 0 || x > tile_max_x || y < 0 || y > tile_max_y) {
+          auto sample_tile = lat_lng_to_web_mercator(lats[s], lngs[s], zoom_level);
+          std::tie(x, y) = pixel_of_coord(bounds_of(sample_tile), lngs[s], lats[s]);
+          sample_landcover = &landcover_of(sample_tile);
+        }
+        auto id = sample_landcover->get_landcover(x, y);
+        if (id != Tile::landcover_unknown)
+          section.landcover[sample] = static_cast<common::LandCover>(id);
+      }
+    }
+    group = group_end;
   }
 }
 
@@ -167,14 +263,19 @@ void WorldGenerator::calculate_bounding_box(int xtile, int ytile, int zoom, doub
 }
 
 std::pair<int, int> WorldGenerator::pixel_of_coord(int x, int y, int z, double lng, double lat) {
+  return pixel_of_coord(get_tile_bounds(x, y, z), lng, lat);
+}
 
-  double lng_deg_min, lat_deg_min;
-  double lng_deg_max, lat_deg_max;
-  calculate_bounding_box(x, y, z, lng_deg_min, lat_deg_max);
-  calculate_bounding_box(x + 1, y + 1, z, lng_deg_max, lat_deg_min);
+WorldGenerator::TileBounds WorldGenerator::get_tile_bounds(int x, int y, int z) {
+  TileBounds bounds;
+  calculate_bounding_box(x, y, z, bounds.lng_min, bounds.lat_max);
+  calculate_bounding_box(x + 1, y + 1, z, bounds.lng_max, bounds.lat_min);
+  return bounds;
+}
 
-  int pixel_x = tile_max_x * (std::abs(lng - lng_deg_min)) / (std::abs(lng_deg_min - lng_deg_max));
-  int pixel_y = tile_max_y * (std::abs(lat - lat_deg_max)) / (std::abs(lat_deg_min - lat_deg_max));
+std::pair<int, int> WorldGenerator::pixel_of_coord(const TileBounds& bounds, double lng, double lat) {
+  int pixel_x = tile_max_x * (std::abs(lng - bounds.lng_min)) / (std::abs(bounds.lng_min - bounds.lng_max));
+  int pixel_y = tile_max_y * (std::abs(lat - bounds.lat_max)) / (std::abs(bounds.lat_min - bounds.lat_max));
 
   return std::make_pair(pixel_x, pixel_y);
 }
@@ -1,43 +1,66 @@
 #ifndef WORLD_GENERATOR_H
 #define WORLD_GENERATOR_H
 
+#include <functional>
+#include <memory>
+#include <span>
 #include <string>
-#include <unordered_map>
+#include <vector>
 #include "chunk.h"
-#include "http_client.h"
+#include "section_database.h"
+#include "tile_fetcher.h"
+#include "tile_provider.h"
 #include "types.h"
 
+// get_section is safe to call from any number of threads
 class WorldGenerator {
 public:
+  // sections in section_database are read from it and never generated
+  WorldGenerator(std::unique_ptr<TileProvider> provider, std::unique_ptr<SectionDatabase> section_database = nullptr);
   // void fill_chunk(Chunk& chunk);
+  // blocks on any tile that isn't loaded yet, use when_ready first to avoid that
   Section get_section(Location2D loc);
-  ~WorldGenerator();
+  // same result as get_section for each loc, but sections are grouped by tile so the tile bounds
+  // and lookups happen once per tile and the pixel math runs over all of a tile's samples at once
+  void get_sections(std::span<const Location2D> locs, std::span<Section> sections);
+  // runs callback once every tile the sections need is loaded, possibly inline
+  void when_ready(const std::vector<Location2D>& locs, std::function<void()> callback);
+  TileFetcher& get_tile_fetcher();
+
+  // tile a section's elevation is read from
+  static std::pair<int, int> get_tile_of_section(Location2D loc);
+  // inclusive range of sections that can fall in a tile, check each with get_tile_of_section
+  static std::pair<Location2D, Location2D> get_sections_of_tile(int x, int y);
 
 private:
-  struct Image {
-    unsigned char* data;
-    int width;
-    int height;
-    int channels;
+  struct TileBounds {
+    double lng_min;
+    double lng_max;
+    double lat_min;
+    double lat_max;
   };
 
   static constexpr int tile_max_x = 255;
   static constexpr int tile_max_y = 255;
+  // for samples whose pixel isn't a known landcover class, jpeg tiles have a few at the edges between classes
+  static constexpr common::LandCover default_landcover = common::LandCover::grass;
 
-  Image get_image(
-    std::pair<int, int> tile,
-    std::string dir,
-    std::unordered_map<std::pair<int, int>, Image, hash_pair>& image_store,
-    std::string url);
+  void generate_sections(std::span<const Location2D> locs, std::span<Section> sections);
+  void add_required_tiles(Location2D loc, std::vector<TileKey>& keys) const;
+  static void get_landcover_coord(Location2D loc, int row, int col, double& lng, double& lat);
 
   static std::pair<int, int> lat_lng_to_web_mercator(double latitude, double longitude, int zoom);
   static void calculate_bounding_box(int xtile, int ytile, int zoom, double& lng_deg, double& lat_deg);
   static std::pair<int, int> pixel_of_coord(int x, int y, int z, double lng, double lat);
+  static TileBounds get_tile_bounds(int x, int y, int z);
+  static std::pair<int, int> pixel_of_coord(const TileBounds& bounds, double lng, double lat);
 
-  HTTPClient http_client_;
-  static constexpr int zoom_level = 15;
-  std::unordered_map<std::pair<int, int>, Image, hash_pair> elevation_images_;
-  std::unordered_map<std::pair<int, int>, Image, hash_pair> landcover_images_;
+  static constexpr int zoom_level = tile_zoom_level;
+  static constexpr unsigned int max_concurrent_fetches = 16;
+  // a 256x256 tile is 128KB of elevation or 64KB of landcover, so this is roughly 2000 tiles
+  static constexpr std::size_t tile_cache_budget = 256 * 1024 * 1024;
+  TileFetcher tile_fetcher_;
+  std::unique_ptr<SectionDatabase> section_database_;
 };
 
 #endif
\ No newline at end of file